@@ -0,0 +1,64 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+
+namespace NX
+{
+  /**
+   * Recycles the read buffers devices hand to scripts as ArrayBuffers.
+   *
+   * Sizes are rounded up to a power of two between MinSize and MaxSize, and each of those classes keeps a bounded
+   * number of free buffers, within a bound on the idle bytes of all classes together. Anything larger goes straight
+   * to the allocator. A buffer comes back through
+   * deallocate(), which is a JSTypedArrayBytesDeallocator, so the collector returns it to the pool once the script
+   * lets go of it.
+   */
+  class BufferPool: public boost::noncopyable
+  {
+  public:
+    static constexpr std::size_t MinSize = 4 * 1024;
+    static constexpr std::size_t MaxSize = 8 * 1024 * 1024;
+
+    /**
+     * A buffer of at least size bytes. capacity gets its real size, which release() and deallocate() need back.
+     */
+    static char * acquire(std::size_t size, std::size_t & capacity);
+
+    static void release(char * buffer, std::size_t capacity);
+
+    /**
+     * For JSObjectMakeArrayBufferWithBytesNoCopy, with context().
+     */
+    static void deallocate(void * bytes, void * context);
+    static void * context(std::size_t capacity) { return reinterpret_cast<void *>(capacity); }
+
+    /**
+     * Bytes sitting in free lists.
+     */
+    static std::size_t retained();
+  };
+}
+
+#endif // BUFFER_POOL_H
@@ -23,12 +23,15 @@
 #include <JavaScript.h>
 #include <string>
 #include <atomic>
-#include <unordered_map>
+#include <cstdint>
 #include <boost/noncopyable.hpp>
 #include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <utility>
 
 #include "object.h"
+#include "epoch.h"
+#include "inline_function.h"
 #include "classes/base.h"
 
 #include <wtf/FastMalloc.h>
@@ -56,60 +59,115 @@ namespace NX
       }
 
     public:
-      Emitter(): myMap(), myTidyLock() {}
+      /**
+       * Interned event name. The builtin ones cost nothing to use; any other name is interned once per
+       * construction, so hot paths should keep theirs around.
+       */
+      class Atom
+      {
+      public:
+        enum Builtin: std::uint32_t {
+          Data, End, Error, Close, Connection, Attempt, Connected, Completed, Aborted, Header, BuiltinCount
+        };
+
+        Atom(Builtin builtin): myId(builtin) {}
+        Atom(const std::string & name): myId(intern(name)) {}
+        Atom(const char * name): myId(intern(name)) {}
+
+        std::uint32_t id() const { return myId; }
+        const std::string & name() const;
+
+        bool operator == (const Atom & other) const { return myId == other.myId; }
+        bool operator != (const Atom & other) const { return myId != other.myId; }
+
+      private:
+        static std::uint32_t intern(const std::string & name);
+
+        std::uint32_t myId;
+      };
+
+      Emitter(): myTable(new Table()), myTidyLock() {}
 
-      ~Emitter() override = default;
+      ~Emitter() override { NX::Epoch::retire(myTable.load()); }
 
       typedef std::function<JSValueRef(JSContextRef, std::size_t argumentCount, const JSValueRef arguments[], JSValueRef *)> EventCallback;
 
-      virtual JSValueRef addListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, EventCallback callback) {
+      virtual JSValueRef addListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, EventCallback callback) {
         return addManyListener(ctx, thisObject, e, std::move(callback), -1);
       }
-      virtual JSValueRef addOnceListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, EventCallback callback) {
+      virtual JSValueRef addOnceListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, EventCallback callback) {
         return addManyListener(ctx, thisObject, e, std::move(callback), 1);
       }
-      virtual JSValueRef addManyListener( JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, EventCallback callback, int count );
+      virtual JSValueRef addManyListener( JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, EventCallback callback, int count );
 
-      virtual JSValueRef addListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, JSObjectRef callback) {
+      virtual JSValueRef addListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, JSObjectRef callback) {
         return addManyListener(ctx, thisObject, e, callback, -1);
       }
-      virtual JSValueRef addOnceListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, JSObjectRef callback) {
+      virtual JSValueRef addOnceListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, JSObjectRef callback) {
         return addManyListener(ctx, thisObject, e, callback, 1);
       }
-      virtual JSValueRef addManyListener( JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, JSObjectRef callback, int count );
-      virtual JSValueRef removeListener( JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, JSObjectRef callback );
-      virtual JSValueRef removeAllListeners( JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e );
+      virtual JSValueRef addManyListener( JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, JSObjectRef callback, int count );
+      virtual JSValueRef removeListener( JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, JSObjectRef callback );
+      virtual JSValueRef removeAllListeners( JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e );
 
       /* Returns a Promise! (slow) */
-      virtual JSObjectRef emit( JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e,
+      virtual JSObjectRef emit( JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e,
                                 std::size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception );
 
       /* Fast version that returns schedules the calls and returns the tasks */
-      virtual NX::TaskGroup emitFastAndSchedule( JSContextRef ctx, JSObjectRef thisObject, const std::string & e,
+      virtual NX::TaskGroup emitFastAndSchedule( JSContextRef ctx, JSObjectRef thisObject, const Atom & e,
                              std::size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception );
 
       /* Faster version that returns nothing */
-      virtual void emitFast( JSContextRef ctx, JSObjectRef thisObject, const std::string & e,
+      virtual void emitFast( JSContextRef ctx, JSObjectRef thisObject, const Atom & e,
                              std::size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception );
 
 
-      static const JSClassDefinition EventCallbackClass;
-
     protected:
-      virtual void tidy(JSContextRef ctx, const std::string & e);
+      virtual void tidy(JSContextRef ctx, const Atom & e);
 
     WTF_MAKE_FAST_ALLOCATED;
 
     private:
       struct Event: public boost::noncopyable {
-        Event(std::string name, NX::Object && handler, int count):
-          name(std::move(name)), handler(handler), count(count) { }
-        std::string name;
+        Event(NX::Object && handler, int count): handler(handler), native(), count(count) { }
+        Event(EventCallback && native, int count): handler(), native(std::move(native)), count(count) { }
+
+        /**
+         * Claims one call; false once a counted listener is used up, even if other emits raced for it.
+         */
+        bool take() {
+          int left = count.load(std::memory_order_relaxed);
+          while (left > 0 && !count.compare_exchange_weak(left, left - 1, std::memory_order_relaxed));
+          return left != 0;
+        }
+
+        JSValueRef invoke(JSContextRef ctx, std::size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception);
+
         NX::Object handler;
+        // set for listeners added from C++, those are called directly and never reach JSC
+        EventCallback native;
         std::atomic_int count;
         WTF_MAKE_FAST_ALLOCATED;
       };
-      std::unordered_map<std::string, std::vector<std::shared_ptr<NX::Classes::Emitter::Event>>> myMap;
+      // most events have one or two listeners, those live inside the map node
+      typedef NX::InlineList<std::shared_ptr<Event>, 2> Listeners;
+      typedef boost::unordered_map<std::uint32_t, Listeners> Table;
+
+      template<typename Modify>
+      void update(Modify modify);
+
+      // what one emit calls, on the stack unless there are more listeners than that
+      typedef NX::InlineList<std::shared_ptr<Event>, 8> Snapshot;
+
+      /**
+       * Claims a call on each listener of e into events, returning whether a counted one got used up. The guard is
+       * held for the copy only, a listener may well suspend its coroutine and must not pin the epoch meanwhile.
+       */
+      bool take(const Atom & e, Snapshot & events);
+
+      // read under an Epoch::Guard without locking; writers serialize on myTidyLock, copy and swap
+      std::atomic<Table*> myTable;
       boost::shared_mutex myTidyLock;
     };
   }
@@ -21,6 +21,7 @@
 #define CLASSES_IO_DEVICE_H
 
 #include <JavaScript.h>
+#include <functional>
 #include <iosfwd>
 
 #include "classes/emitter.h"
@@ -81,9 +82,18 @@ namespace NX
 
       struct PullSourceDevice: public virtual SourceDevice {
 
+        typedef std::function<void(const boost::system::error_code & error, char * data, std::size_t size,
+                                   JSTypedArrayBytesDeallocator deallocator, void * deallocatorContext)> ReadCompletion;
+
         SourceType sourceDeviceType() const override { return PullType; }
         virtual std::size_t deviceRead(char * dest, std::size_t length) = 0;
 
+        /**
+         * Devices that can read without blocking a worker start the read and return true. The completion gets a
+         * buffer of the device's choosing along with the deallocator that gives it back.
+         */
+        virtual bool deviceReadAsync(std::size_t length, ReadCompletion completion) { return false; }
+
         static NX::Classes::IO::PullSourceDevice * FromObject(JSObjectRef obj) {
           return dynamic_cast<NX::Classes::IO::PullSourceDevice *>(NX::Classes::Base::FromObject(obj));
         }
@@ -122,6 +132,28 @@ namespace NX
         virtual std::size_t recommendedWriteBufferSize() const { return maxWriteBufferSize(); }
         virtual std::size_t deviceWrite(const char * buffer, std::size_t length) = 0;
 
+        typedef std::function<void(const boost::system::error_code & error, std::size_t written)> WriteCompletion;
+
+        /**
+         * Same as deviceReadAsync, for writes. buffer has to stay valid until the completion runs.
+         */
+        virtual bool deviceWriteAsync(const char * buffer, std::size_t length, WriteCompletion completion) {
+          return false;
+        }
+
+        /**
+         * Sinks sitting on a socket can take [offset, offset + length) of a regular file straight from the page cache.
+         * Returns false, having written nothing, when the device can't.
+         */
+        virtual bool deviceTransferFrom(int fd, std::size_t offset, std::size_t length, WriteCompletion completion) {
+          return false;
+        }
+
+        /**
+         * The descriptor writes end up on, for wrappers that batch several buffers into one syscall. -1 if there's none.
+         */
+        virtual int deviceDescriptor() { return -1; }
+
         static NX::Classes::IO::SinkDevice * FromObject(JSObjectRef obj) {
           return dynamic_cast<NX::Classes::IO::SinkDevice *>(NX::Classes::Base::FromObject(obj));
         }
@@ -0,0 +1,171 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLASSES_IO_DEVICES_ASYNC_FILE_H
+#define CLASSES_IO_DEVICES_ASYNC_FILE_H
+
+#include <JavaScriptCore/API/JSObjectRef.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "classes/io/device.h"
+#include "uring.h"
+
+namespace NX {
+
+  class Nexus;
+  class Context;
+  class Scheduler;
+  namespace Classes {
+    namespace IO {
+      namespace Devices {
+        /**
+         * A descriptor and the io_uring slot it is registered in. Transfers in flight hold a reference, so the slot is
+         * only handed back and the descriptor only closed once the last of them is done, even if the device closed first.
+         */
+        struct AsyncFileHandle {
+          AsyncFileHandle(std::shared_ptr<NX::Uring> uring, int fd, bool fixed, bool close);
+          ~AsyncFileHandle();
+
+          std::shared_ptr<NX::Uring> uring;
+          int fd, slot;
+          bool close;
+        };
+
+        /**
+         * File source whose reads are submitted to the scheduler's io_uring and never block a worker.
+         * Falls back to pread where io_uring isn't available.
+         */
+        class AsyncFilePullDevice : public virtual SeekableSourceDevice {
+        public:
+          AsyncFilePullDevice(NX::Scheduler * scheduler, const std::string & path);
+
+          ~AsyncFilePullDevice() override { deviceClose(); }
+
+        private:
+          static const JSClassDefinition Class;
+          static const JSStaticValue Properties[];
+          static const JSStaticFunction Methods[];
+
+          static JSObjectRef Constructor(JSContextRef ctx, JSObjectRef constructor, size_t argumentCount,
+                                         const JSValueRef arguments[], JSValueRef *exception);
+
+          static void Finalize(JSObjectRef object) {}
+
+        public:
+          static JSClassRef createClass(NX::Context *context);
+
+          static JSObjectRef getConstructor(NX::Context *context);
+
+          static NX::Classes::IO::Devices::AsyncFilePullDevice *FromObject(JSObjectRef obj) {
+            return dynamic_cast<NX::Classes::IO::Devices::AsyncFilePullDevice *>(Base::FromObject(obj));
+          }
+
+          std::size_t devicePosition() override { return std::min(myOffset.load(), sourceSize()); }
+          std::size_t deviceRead(char *dest, std::size_t length) override;
+          bool deviceReadAsync(std::size_t length, ReadCompletion completion) override;
+
+          bool deviceReady() const override { return myFd >= 0 && !myError; }
+          bool deviceOpen() const override { return myFd >= 0; }
+          void deviceClose() override;
+
+          const boost::system::error_code & deviceError() const override { return myError; }
+
+          std::size_t deviceSeek(std::size_t pos, Position from) override;
+
+          bool eof() const override { return myOffset >= mySize; }
+
+          std::size_t sourceSize() override;
+
+          std::size_t deviceBytesAvailable() override {
+            std::size_t size = sourceSize(), offset = myOffset;
+            return offset < size ? size - offset : 0;
+          }
+
+        private:
+          std::shared_ptr<NX::Uring> myUring;
+          std::shared_ptr<AsyncFileHandle> myFile;
+          int myFd;
+          std::atomic_size_t myOffset, mySize;
+          boost::system::error_code myError;
+        };
+
+        /**
+         * File sink whose writes go through the scheduler's io_uring straight from the caller's buffer.
+         * Falls back to pwrite (or write, for descriptors that can't seek) where io_uring isn't available.
+         */
+        class AsyncFileSinkDevice : public virtual SeekableSinkDevice {
+        public:
+          AsyncFileSinkDevice(NX::Scheduler * scheduler, const std::string & path);
+          AsyncFileSinkDevice(NX::Scheduler * scheduler, int fd, bool close);
+
+          ~AsyncFileSinkDevice() override { deviceClose(); }
+
+        private:
+          static const JSClassDefinition Class;
+          static const JSStaticValue Properties[];
+          static const JSStaticFunction Methods[];
+
+          static JSObjectRef Constructor(JSContextRef ctx, JSObjectRef constructor, size_t argumentCount,
+                                         const JSValueRef arguments[], JSValueRef *exception);
+
+          static void Finalize(JSObjectRef object) {}
+
+        public:
+          static JSClassRef createClass(NX::Context *context);
+
+          static JSObjectRef getConstructor(NX::Context *context);
+
+          static NX::Classes::IO::Devices::AsyncFileSinkDevice *FromObject(JSObjectRef obj) {
+            return dynamic_cast<NX::Classes::IO::Devices::AsyncFileSinkDevice *>(Base::FromObject(obj));
+          }
+
+          std::size_t devicePosition() override { return myOffset; }
+
+          bool deviceReady() const override { return myFd >= 0 && !myError; }
+          bool deviceOpen() const override { return myFd >= 0; }
+          void deviceClose() override;
+
+          const boost::system::error_code & deviceError() const override { return myError; }
+
+          std::size_t deviceSeek(std::size_t pos, Position from) override;
+
+          std::size_t recommendedWriteBufferSize() const override { return 8 * 1024 * 1024; }
+          std::size_t maxWriteBufferSize() const override { return 8 * 1024 * 1024; }
+
+          std::size_t deviceWrite(const char *buffer, std::size_t length) override;
+          bool deviceWriteAsync(const char * buffer, std::size_t length, WriteCompletion completion) override;
+
+        private:
+          void open(NX::Scheduler * scheduler);
+
+          std::shared_ptr<NX::Uring> myUring;
+          std::shared_ptr<AsyncFileHandle> myFile;
+          int myFd;
+          bool myClose, mySeekable;
+          std::atomic_size_t myOffset;
+          boost::system::error_code myError;
+        };
+      }
+    }
+  }
+}
+
+#endif // CLASSES_IO_DEVICES_ASYNC_FILE_H
@@ -0,0 +1,116 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLASSES_IO_DEVICES_BUFFERED_SINK_H
+#define CLASSES_IO_DEVICES_BUFFERED_SINK_H
+
+#include <JavaScriptCore/API/JSObjectRef.h>
+#include <memory>
+
+#include "classes/io/device.h"
+
+namespace NX {
+
+  class Nexus;
+  class Context;
+  class Scheduler;
+  namespace Classes {
+    namespace IO {
+      namespace Devices {
+        /**
+         * Wraps another sink and turns many small writes into few large ones.
+         *
+         * Small writes are copied into a pooled buffer and complete right away; large ones are queued as they are and
+         * complete once written. The queue goes out when it reaches flushSize bytes, flushInterval milliseconds after
+         * the first queued write, on write(null), or on close. Sinks with a descriptor get the whole queue in one
+         * writev, the rest get one deviceWrite per flush.
+         */
+        class BufferedSinkDevice : public virtual SinkDevice {
+        public:
+          enum Durability {
+            None,
+            // fdatasync once everything is flushed on close
+            SyncOnClose,
+            // one fdatasync for all the writes of the last syncInterval milliseconds, and again on close
+            Periodic
+          };
+
+          struct Options {
+            std::size_t flushSize = 64 * 1024;
+            unsigned flushInterval = 10;
+            Durability durability = None;
+            unsigned syncInterval = 1000;
+          };
+
+          struct Stats {
+            std::size_t writes, flushes, syscalls, bytes;
+          };
+
+          BufferedSinkDevice(NX::Scheduler * scheduler, JSContextRef ctx, JSObjectRef sink, const Options & options);
+
+          ~BufferedSinkDevice() override;
+
+        private:
+          static const JSClassDefinition Class;
+          static const JSStaticValue Properties[];
+          static const JSStaticFunction Methods[];
+
+          static JSObjectRef Constructor(JSContextRef ctx, JSObjectRef constructor, size_t argumentCount,
+                                         const JSValueRef arguments[], JSValueRef *exception);
+
+          static void Finalize(JSObjectRef object) {}
+
+        public:
+          static JSClassRef createClass(NX::Context *context);
+
+          static JSObjectRef getConstructor(NX::Context *context);
+
+          static NX::Classes::IO::Devices::BufferedSinkDevice *FromObject(JSObjectRef obj) {
+            return dynamic_cast<NX::Classes::IO::Devices::BufferedSinkDevice *>(Base::FromObject(obj));
+          }
+
+          static Durability durabilityFromString(const std::string & durability);
+
+          void flush();
+          void sync();
+
+          Stats stats() const;
+
+          bool deviceReady() const override;
+          bool deviceOpen() const override;
+          void deviceClose() override;
+
+          const boost::system::error_code & deviceError() const override;
+
+          std::size_t maxWriteBufferSize() const override { return SIZE_MAX; }
+
+          std::size_t deviceWrite(const char *buffer, std::size_t length) override;
+          bool deviceWriteAsync(const char * buffer, std::size_t length, WriteCompletion completion) override;
+
+        private:
+          // shared with pending timers, which may outlive the device
+          struct State;
+          std::shared_ptr<State> myState;
+        };
+      }
+    }
+  }
+}
+
+#endif // CLASSES_IO_DEVICES_BUFFERED_SINK_H
@@ -23,15 +23,17 @@
 #include <JavaScriptCore/API/JSObjectRef.h>
 #include <fstream>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sys/types.h>
 #include "classes/io/device.h"
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 
+#include "file_watcher.h"
 #include "task.h"
 #include "globals/promise.h"
 
-#define FILE_PUSH_DEVICE_BUFFER_SIZE (size_t)(8 * 1024 * 1024) // 8MB buffer size. TODO: Make it adjustable!
-
 namespace NX {
 
   class Nexus;
@@ -124,7 +126,7 @@ namespace NX {
         public:
           FilePushDevice(NX::Scheduler *scheduler, const std::string &path);
 
-          ~FilePushDevice() override { myStream.close(); }
+          ~FilePushDevice() override;
 
         private:
           static const JSClassDefinition Class;
@@ -143,10 +145,18 @@ namespace NX {
                 return nullptr;
               }
               NX::Value path(ctx, arguments[0]);
-              return JSObjectMake(ctx, fileSourceClass,
-                                  dynamic_cast<NX::Classes::Base *>(
-                                      new NX::Classes::IO::Devices::FilePushDevice(context->nexus()->scheduler(),
-                                                                                   path.toString())));
+              auto device = new NX::Classes::IO::Devices::FilePushDevice(context->nexus()->scheduler(),
+                                                                        path.toString());
+              if (argumentCount > 1 && JSValueGetType(ctx, arguments[1]) == kJSTypeNumber)
+                device->chunkSize(static_cast<std::size_t>(std::max(0.0, NX::Value(ctx, arguments[1]).toNumber())));
+              else if (argumentCount > 1 && JSValueIsObject(ctx, arguments[1])) {
+                NX::Object options(ctx, arguments[1]);
+                auto chunkSize = options["chunkSize"];
+                if (JSValueGetType(ctx, chunkSize->value()) == kJSTypeNumber)
+                  device->chunkSize(static_cast<std::size_t>(std::max(0.0, chunkSize->toNumber())));
+                device->follow(options["follow"]->toBoolean());
+              }
+              return JSObjectMake(ctx, fileSourceClass, dynamic_cast<NX::Classes::Base *>(device));
             } catch (const std::exception &e) {
               JSWrapException(ctx, e, exception);
               return JSObjectMake(ctx, nullptr, nullptr);
@@ -182,6 +192,8 @@ namespace NX {
           JSObjectRef pause(JSContextRef ctx, JSObjectRef thisObject) override {
             if (myState == Resumed) {
               myState.store(Paused);
+              // a run waiting for the file to grow has nothing left to do
+              settleFollow(Cancelled);
               return myPromise;
             } else {
               NX::Context *context = NX::Context::FromJsContext(ctx);
@@ -198,14 +210,62 @@ namespace NX {
 
           State state() const override { return myState; }
 
+          /**
+           * While set, resume() hands the rest of the file to the sink in the kernel instead of emitting 'data',
+           * falling back to the usual path when the sink can't take it. A null sink switches it back off.
+           */
+          void spliceTo(JSContextRef ctx, JSObjectRef sink);
+
+          /**
+           * Bytes read per 'data' event. 0, the default, sizes chunks by how fast they are consumed.
+           */
+          std::size_t chunkSize() const { return myChunkSize; }
+          void chunkSize(std::size_t size) { myChunkSize.store(size); }
+
+          /**
+           * While set, reaching the end of the file waits for it to grow, like tail -f, instead of emitting 'end'.
+           * 'end' only comes once the file is deleted or replaced; a truncated file is read again from the start.
+           * Splicing is off while following.
+           */
+          bool follow() const { return myFollow; }
+          void follow(bool follow) { myFollow.store(follow); }
+
+          static constexpr std::size_t MinChunkSize = 64 * 1024;
+          static constexpr std::size_t MaxChunkSize = 8 * 1024 * 1024;
+
         private:
+          enum FollowResult { Grew, Gone, Cancelled };
+          typedef std::function<void(FollowResult result)> FollowHandler;
+
+          void awaitGrowth(FollowHandler handler);
+          bool checkGrowth();
+          void pollGrowth(FollowHandler keep);
+          void settleFollow(FollowResult result);
+
+          std::size_t nextChunkSize();
+          void adaptChunkSize(std::chrono::steady_clock::duration consumed);
+
+          typedef std::function<void(const boost::system::error_code & error)> SpliceCompletion;
+
+          bool splice(NX::Classes::IO::SinkDevice * sink, SpliceCompletion completion);
+
           NX::Scheduler *myScheduler;
           std::string myPath;
           std::atomic<State> myState;
           std::atomic<NX::AbstractTask *> myTask;
           std::ifstream myStream;
           NX::Object myPromise;
+          NX::Object mySpliceTarget;
+          NX::Classes::IO::SinkDevice * mySink;
+          std::size_t mySize;
+          std::atomic_size_t myChunkSize, myAdaptiveChunkSize;
           boost::system::error_code myError;
+          std::atomic_bool myFollow;
+          std::mutex myFollowMutex;
+          FollowHandler myFollowHandler;
+          NX::FileWatcher::Handle myFollowWatch;
+          std::streamoff myFollowPosition;
+          ino_t myFollowInode;
         };
 
         class FileSinkDevice : public virtual SeekableSinkDevice {
@@ -250,6 +310,8 @@ namespace NX {
           bool deviceOpen() const override { return myStream.is_open(); }
           void deviceClose() override { myStream.close(); }
 
+          int deviceDescriptor() override { return myStream.is_open() ? myStream->handle() : -1; }
+
           std::size_t deviceSeek(std::size_t pos, Position from) override {
             myStream.seekp(pos, (std::ios_base::seekdir)from);
             return static_cast<size_t>(myStream.tellp());
@@ -274,9 +336,82 @@ namespace NX {
         };
 
 
-        class BidirectionalFileDevice: public BidirectionalDualSeekableDevice {
-          explicit BidirectionalFileDevice(const std::string &path) {}
-          explicit BidirectionalFileDevice(int fd) {}
+        /**
+         * Read-write file built on pread and pwrite. read() and write() claim their range off separate cursors
+         * atomically, and readAt()/writeAt() leave the cursors alone, so any number of tasks can use it at once.
+         */
+        class BidirectionalFileDevice: public virtual BidirectionalDualSeekableDevice {
+        public:
+          explicit BidirectionalFileDevice(const std::string &path);
+          BidirectionalFileDevice(int fd, bool close);
+
+          ~BidirectionalFileDevice() override { deviceClose(); }
+
+        private:
+          static const JSClassDefinition Class;
+          static const JSStaticValue Properties[];
+          static const JSStaticFunction Methods[];
+
+          static JSObjectRef Constructor(JSContextRef ctx, JSObjectRef constructor, size_t argumentCount,
+                                         const JSValueRef arguments[], JSValueRef *exception);
+
+          static void Finalize(JSObjectRef object) {}
+
+        public:
+          static JSClassRef createClass(NX::Context *context);
+
+          static JSObjectRef getConstructor(NX::Context *context);
+
+          static NX::Classes::IO::Devices::BidirectionalFileDevice *FromObject(JSObjectRef obj) {
+            return dynamic_cast<NX::Classes::IO::Devices::BidirectionalFileDevice *>(Base::FromObject(obj));
+          }
+
+          std::size_t readAt(char *dest, std::size_t offset, std::size_t length);
+          std::size_t writeAt(const char *source, std::size_t offset, std::size_t length);
+
+          /**
+           * Reserves disk space for the range, growing the file if it ends past its end.
+           */
+          void allocate(std::size_t offset, std::size_t length);
+
+          /**
+           * Writes the range back and waits for it. Without a length it is an fdatasync of the whole file, which is
+           * what to use when the metadata (the size, say) has to be durable too.
+           */
+          void syncRange(std::size_t offset, std::size_t length);
+
+          std::size_t size() const;
+
+          std::size_t deviceReadPosition() override { return myReadOffset; }
+          std::size_t deviceWritePosition() override { return myWriteOffset; }
+          std::size_t deviceReadSeek(std::size_t pos, Position from) override;
+          std::size_t deviceWriteSeek(std::size_t pos, Position from) override;
+
+          std::size_t deviceRead(char *dest, std::size_t length) override;
+          bool deviceReadAsync(std::size_t length, ReadCompletion completion) override;
+
+          std::size_t recommendedWriteBufferSize() const override { return 8 * 1024 * 1024; }
+          std::size_t maxWriteBufferSize() const override { return 8 * 1024 * 1024; }
+          std::size_t deviceWrite(const char *buffer, std::size_t length) override;
+
+          bool eof() const override { return myReadOffset >= size(); }
+
+          bool deviceReady() const override { return myFd >= 0; }
+          bool deviceOpen() const override { return myFd >= 0; }
+          void deviceClose() override;
+
+          const boost::system::error_code & deviceError() const override { return myError; }
+
+        private:
+          std::size_t claim(std::size_t length, std::size_t & offset);
+          std::size_t transfer(bool write, char * data, std::size_t offset, std::size_t length,
+                               boost::system::error_code & error);
+
+          int myFd;
+          bool myClose;
+          std::atomic_size_t myReadOffset, myWriteOffset;
+          // calls run concurrently and throw their own errors, so this stays clear
+          boost::system::error_code myError;
         };
       }
     }
@@ -0,0 +1,125 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLASSES_IO_DEVICES_FILE_MAP_H
+#define CLASSES_IO_DEVICES_FILE_MAP_H
+
+#include <JavaScriptCore/API/JSObjectRef.h>
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <memory>
+
+#include "classes/io/device.h"
+
+namespace NX {
+
+  class Nexus;
+  class Context;
+  namespace Classes {
+    namespace IO {
+      namespace Devices {
+        /**
+         * Maps a file once and reads by handing out ArrayBuffers over the mapping instead of copies.
+         *
+         * The device's own mapping is read-only. Each view and each streamed chunk gets a private mapping of its
+         * range, so writing into one copies just the pages written and neither the file nor any other view sees it.
+         * Those mappings don't refer back to the device, so the file is closed with the device and views outlive it.
+         */
+        class FileMapDevice : public virtual SeekableSourceDevice {
+        public:
+          enum Advice { Normal, Sequential, Random, WillNeed };
+
+          FileMapDevice(const std::string & path, Advice advice);
+
+          ~FileMapDevice() override = default;
+
+        private:
+          struct Mapping: public boost::noncopyable {
+            Mapping(char * data, std::size_t size, int fd): data(data), size(size), fd(fd) {}
+            ~Mapping();
+            char * data;
+            std::size_t size;
+            int fd; // views map their own ranges from it
+          };
+
+          static const JSClassDefinition Class;
+          static const JSStaticValue Properties[];
+          static const JSStaticFunction Methods[];
+
+          static JSObjectRef Constructor(JSContextRef ctx, JSObjectRef constructor, size_t argumentCount,
+                                         const JSValueRef arguments[], JSValueRef *exception);
+
+          static void Finalize(JSObjectRef object) {}
+
+        public:
+          static JSClassRef createClass(NX::Context *context);
+
+          static JSObjectRef getConstructor(NX::Context *context);
+
+          static NX::Classes::IO::Devices::FileMapDevice *FromObject(JSObjectRef obj) {
+            return dynamic_cast<NX::Classes::IO::Devices::FileMapDevice *>(Base::FromObject(obj));
+          }
+
+          static Advice adviceFromString(const std::string & advice);
+
+          /**
+           * An ArrayBuffer over [offset, offset + length) of the file, clamped to its end.
+           */
+          JSObjectRef view(JSContextRef ctx, std::size_t offset, std::size_t length, JSValueRef * exception);
+
+          void advise(Advice advice, std::size_t offset = 0, std::size_t length = 0);
+
+          std::size_t devicePosition() override { return myOffset; }
+          std::size_t deviceRead(char *dest, std::size_t length) override;
+          bool deviceReadAsync(std::size_t length, ReadCompletion completion) override;
+
+          bool deviceReady() const override { return deviceOpen() && !myError; }
+          bool deviceOpen() const override { return !!std::atomic_load(&myMapping); }
+          void deviceClose() override { std::atomic_store(&myMapping, std::shared_ptr<Mapping>()); }
+
+          const boost::system::error_code & deviceError() const override { return myError; }
+
+          std::size_t deviceSeek(std::size_t pos, Position from) override;
+
+          bool eof() const override { return myOffset >= mySize; }
+
+          std::size_t sourceSize() override { return mySize; }
+          std::size_t deviceBytesAvailable() override {
+            std::size_t offset = myOffset;
+            return offset < mySize ? mySize - offset : 0;
+          }
+
+        private:
+          std::size_t claim(std::size_t length, std::size_t & offset);
+          // a copy-on-write mapping of [offset, offset + length), given back through releaseView
+          char * isolate(const Mapping & mapping, std::size_t offset, std::size_t length, void *& context,
+                         boost::system::error_code & error);
+
+          std::shared_ptr<Mapping> myMapping; // swapped atomically, a read holds it only while it maps its range
+          std::size_t mySize;
+          std::atomic_size_t myOffset;
+          std::atomic<Advice> myAdvice;
+          boost::system::error_code myError;
+        };
+      }
+    }
+  }
+}
+
+#endif // CLASSES_IO_DEVICES_FILE_MAP_H
@@ -0,0 +1,123 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLASSES_IO_DEVICES_FILE_WATCH_H
+#define CLASSES_IO_DEVICES_FILE_WATCH_H
+
+#include <JavaScriptCore/API/JSObjectRef.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "classes/io/device.h"
+#include "file_watcher.h"
+#include "globals/promise.h"
+
+namespace NX {
+
+  class Nexus;
+  class Context;
+  class Scheduler;
+  namespace Classes {
+    namespace IO {
+      namespace Devices {
+        /**
+         * Emits a 'change' event for every inotify event on a file or directory while resumed.
+         *
+         * Nothing is watched while paused, so an idle device costs no more than its kernel watch. Events that arrive
+         * together go out from a single task. The resume() promise settles on pause(), on close, or once the watched
+         * file is gone, which also emits 'end'.
+         */
+        class FileWatchDevice : public virtual PushSourceDevice {
+        public:
+          FileWatchDevice(NX::Scheduler * scheduler, const std::string & path, std::uint32_t mask);
+
+          ~FileWatchDevice() override;
+
+        private:
+          static const JSClassDefinition Class;
+          static const JSStaticValue Properties[];
+          static const JSStaticFunction Methods[];
+
+          static JSObjectRef Constructor(JSContextRef ctx, JSObjectRef constructor, size_t argumentCount,
+                                         const JSValueRef arguments[], JSValueRef *exception);
+
+          static void Finalize(JSObjectRef object) {}
+
+        public:
+          static JSClassRef createClass(NX::Context *context);
+
+          static JSObjectRef getConstructor(NX::Context *context);
+
+          static NX::Classes::IO::Devices::FileWatchDevice *FromObject(JSObjectRef obj) {
+            return dynamic_cast<NX::Classes::IO::Devices::FileWatchDevice *>(Base::FromObject(obj));
+          }
+
+          /**
+           * IN_* bits for event names like 'modify' or 'create'; an empty list means all of them.
+           */
+          static std::uint32_t maskFromNames(const std::vector<std::string> & names);
+
+          const std::string & path() const { return myPath; }
+
+          bool deviceReady() const override { return myOpen; }
+          bool deviceOpen() const override { return myOpen; }
+          void deviceClose() override;
+
+          const boost::system::error_code & deviceError() const override { return myError; }
+
+          bool eof() const override { return !myOpen; }
+
+          State state() const override { return myState; }
+
+          JSObjectRef reset(JSContextRef ctx, JSObjectRef thisObject) override {
+            return NX::Globals::Promise::resolve(ctx, thisObject);
+          }
+
+          JSObjectRef pause(JSContextRef ctx, JSObjectRef thisObject) override;
+          JSObjectRef resume(JSContextRef ctx, JSObjectRef thisObject) override;
+
+        private:
+          void stop();
+          void onEvent(const NX::FileWatcher::Event & event);
+          void schedule(std::unique_lock<std::mutex> & lock);
+          void flush();
+
+          NX::Scheduler * myScheduler;
+          std::shared_ptr<NX::FileWatcher> myWatcher;
+          const std::string myPath;
+          const std::uint32_t myMask;
+          std::atomic<State> myState;
+          std::atomic_bool myOpen;
+          std::mutex myMutex;
+          NX::FileWatcher::Handle myWatch;
+          std::deque<NX::FileWatcher::Event> myEvents;
+          bool myFlushing, myGone;
+          // held while resumed, and let go of by the last flush only, so queued events always have a target
+          NX::Object myThis, myPromise;
+          NX::ResolveRejectHandler myResolve, myReject;
+          boost::system::error_code myError;
+        };
+      }
+    }
+  }
+}
+
+#endif // CLASSES_IO_DEVICES_FILE_WATCH_H
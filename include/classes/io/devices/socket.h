@@ -120,6 +120,11 @@ namespace NX {
           std::size_t recommendedWriteBufferSize() const override { return maxWriteBufferSize(); }
           bool eof() const override { return !mySocket->is_open(); }
           std::size_t deviceWrite ( const char * buffer, std::size_t length ) override;
+          bool deviceTransferFrom(int fd, std::size_t offset, std::size_t length, WriteCompletion completion) override {
+            sendFile(mySocket, fd, offset, length, std::move(completion));
+            return true;
+          }
+          int deviceDescriptor() override { return mySocket && mySocket->is_open() ? mySocket->native_handle() : -1; }
           JSObjectRef pause ( JSContextRef ctx, JSObjectRef thisObject ) override;
           JSObjectRef reset ( JSContextRef ctx, JSObjectRef thisObject ) override;
           JSObjectRef resume ( JSContextRef ctx, JSObjectRef thisObject ) override;
@@ -130,6 +135,12 @@ namespace NX {
 
           NX::Scheduler * scheduler() const override { return myScheduler; }
 
+          /**
+           * sendfile()s the range into the socket, waiting on the reactor instead of blocking when the socket is full.
+           */
+          static void sendFile(const std::shared_ptr<boost::asio::ip::tcp::socket> & socket, int fd, std::size_t offset,
+                               std::size_t length, WriteCompletion completion);
+
         private:
           NX::Scheduler * myScheduler;
           std::shared_ptr< boost::asio::ip::tcp::socket> mySocket;
@@ -71,7 +71,7 @@ namespace NX {
 
           void close() override {
             NX::Classes::IO::Devices::TCPSocket::close();
-            emitFastAndSchedule(myContext->toJSContext(), myThisObject, "close", 0, nullptr, nullptr);
+            emitFastAndSchedule(myContext->toJSContext(), myThisObject, Atom::Close, 0, nullptr, nullptr);
             myThisObject.clear();
           }
 
@@ -74,6 +74,7 @@ namespace NX {
           bool deviceReady() const override { return myConnection->deviceReady(); }
           bool deviceOpen() const override { return myConnection->deviceOpen(); }
           std::size_t deviceWrite ( const char * buffer, std::size_t length ) override;
+          bool deviceTransferFrom(int fd, std::size_t offset, std::size_t length, WriteCompletion completion) override;
 
           void send(JSContextRef context, JSValueRef body) override;
 
@@ -134,6 +135,7 @@ namespace NX {
           std::unique_ptr<BeastResponse> myRes;
           std::unique_ptr<Writer> myWriter;
           std::atomic_bool myHeadersSentFlag;
+          std::atomic_bool myCompletedFlag;
           unsigned int myStatus;
           bool myContinuationFlag;
         };
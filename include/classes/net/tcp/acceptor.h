@@ -22,6 +22,7 @@
 
 #include "nexus.h"
 #include <boost/asio.hpp>
+#include <atomic>
 
 #include "classes/emitter.h"
 #include "util.h"
@@ -39,7 +40,7 @@ namespace NX
         class Acceptor: public NX::Classes::Emitter {
         protected:
           Acceptor (NX::Scheduler * scheduler, const std::shared_ptr< boost::asio::ip::tcp::acceptor> & acceptor):
-            myScheduler(scheduler), myHolder(scheduler), myAcceptor(acceptor), myThisObject()
+            myScheduler(scheduler), myHolder(scheduler), myAcceptor(acceptor), myShards(), myThisObject(), myClosed(false)
           {
           }
 
@@ -86,9 +87,16 @@ namespace NX
           JSValueRef bind ( JSContextRef ctx, JSObjectRef thisObject, const std::string & addr, short unsigned int port, bool reuse, JSValueRef * exception );
           JSValueRef listen ( JSContextRef ctx, const NX::Object & thisObject, int maxConnections, JSValueRef * exception );
 
+          /**
+           * Stops accepting connections and lets the program exit once nothing else holds it.
+           */
+          void close();
+
         protected:
 
           virtual void beginAccept(NX::Context* context, const NX::Object & thisObject);
+          void beginAccept(NX::Context* context, const NX::Object & thisObject,
+                           const std::shared_ptr<boost::asio::ip::tcp::acceptor> & acceptor);
           virtual void handleAccept(NX::Context* context, const NX::Object & thisObject,
                                    const std::shared_ptr<boost::asio::ip::tcp::socket> & socket,
                                    bool continuation, const boost::system::error_code& error);
@@ -96,11 +104,18 @@ namespace NX
           NX::Scheduler * scheduler() { return myScheduler; }
           std::shared_ptr<boost::asio::ip::tcp::acceptor> acceptor() { return myAcceptor; }
 
+          /**
+           * The listener (or SO_REUSEPORT shard) that lives on the given io_service.
+           */
+          std::shared_ptr<boost::asio::ip::tcp::acceptor> acceptorFor(boost::asio::io_service & service);
+
         private:
           NX::Scheduler * myScheduler;
           NX::Scheduler::Holder myHolder;
           std::shared_ptr<boost::asio::ip::tcp::acceptor> myAcceptor;
+          std::vector<std::shared_ptr<boost::asio::ip::tcp::acceptor>> myShards;
           NX::Object myThisObject;
+          std::atomic_bool myClosed;
         };
       }
     }
@@ -25,8 +25,11 @@
 #endif
 
 #include <JavaScriptCore/runtime/JSInternalPromise.h>
+#include <JavaScriptCore/runtime/Microtask.h>
 #include <JavaScriptCore/API/JSCallbackObject.h>
 
+#include <deque>
+#include <mutex>
 #include <string>
 #include <boost/unordered_map.hpp>
 
@@ -69,17 +72,27 @@ namespace NX {
 
     void registerThread();
 
+    /**
+     * Queues a promise reaction. The first one into an empty queue schedules a single task that drains them all.
+     */
+    void queueMicrotask(WTF::Ref<JSC::Microtask> && task);
+
     std::size_t garbageCollect();
 
   protected:
 
     JSC::JSGlobalObject * createGlobalObject();
 
+    void drainMicrotasks();
+
     NX::Context * myParent;
     NX::Nexus * myNexus;
     WTF::Ref<JSC::VM> myVM;
     JSC::JSGlobalObject * myGlobal;
     boost::unordered_map<std::string, JSValueRef> myGlobals;
+    std::mutex myMicrotasksMutex;
+    std::deque<JSC::Microtask*> myMicrotasks;
+    bool myMicrotaskDrainScheduled;
   };
 }
 
@@ -0,0 +1,127 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DIRECTORY_SCANNER_H
+#define DIRECTORY_SCANNER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NX
+{
+  class Scheduler;
+
+  /**
+   * Lists, walks and stats on the scheduler's blocking lane.
+   *
+   * A walk fans out one lane job per directory, reading entries with getdents64 and, if asked to, stat'ing them
+   * relative to the open directory with statx. Entries come back in batches, in order with each other and with the
+   * completion, on ordinary scheduler tasks, so the handlers are free to run JavaScript.
+   */
+  class DirectoryScanner: public boost::noncopyable, public std::enable_shared_from_this<DirectoryScanner>
+  {
+  public:
+    struct Entry {
+      std::string path; // relative to the root of the scan
+      boost::filesystem::file_type type;
+      bool statted;
+      std::uint64_t size;
+      std::time_t lastModified;
+      boost::filesystem::perms permissions;
+      boost::system::error_code error; // why stat'ing it failed, when type is status_error
+    };
+
+    typedef std::vector<Entry> Batch;
+
+    /**
+     * Returns false to stop the scan; the completion then gets operation_aborted.
+     */
+    typedef std::function<bool(Batch && batch)> BatchHandler;
+    typedef std::function<void(const boost::system::error_code & error, std::size_t total)> CompletionHandler;
+    typedef std::function<void(Batch && results)> StatHandler;
+
+    struct Options {
+      Options(): recursive(true), stat(false), pattern(), batchSize(512) {}
+      bool recursive, stat;
+      std::string pattern; // glob over the relative path, '**' spans directories
+      std::size_t batchSize;
+    };
+
+    static const std::size_t StatChunkSize = 256;
+
+    static std::shared_ptr<DirectoryScanner> scan(NX::Scheduler * scheduler, const std::string & root,
+                                                  const Options & options, BatchHandler onBatch,
+                                                  CompletionHandler onComplete);
+
+    /**
+     * Stats every path, following symlinks, in chunks spread over the lane. The results line up with paths; one
+     * that doesn't exist comes back as file_not_found, one that couldn't be stat'ed for any other reason as
+     * status_error with the error set.
+     */
+    static void statMany(NX::Scheduler * scheduler, std::vector<std::string> paths, StatHandler onComplete);
+
+    /**
+     * Splits a glob into the directory to scan, which has no wildcards in it, and the pattern under it.
+     */
+    static std::pair<std::string, std::string> splitGlob(const std::string & glob);
+
+    static bool match(const std::string & pattern, const std::string & path);
+
+    /**
+     * Whether anything under the directory could still match, so the walk knows to skip it otherwise.
+     */
+    static bool mayMatchBelow(const std::string & pattern, const std::string & directory);
+
+    DirectoryScanner(NX::Scheduler * scheduler, const std::string & root, const Options & options,
+                     BatchHandler onBatch, CompletionHandler onComplete);
+
+    void cancel() { myCancelled.store(true); }
+
+  private:
+    void scanDirectory(const std::string & relative);
+    void leave();
+    void deliver(Batch && batch, bool last);
+    void drain();
+
+    NX::Scheduler * myScheduler;
+    const std::string myRoot;
+    const Options myOptions;
+    BatchHandler myOnBatch;
+    CompletionHandler myOnComplete;
+    std::atomic_size_t myPending, myDelivered;
+    std::atomic_bool myCancelled;
+    std::mutex myMutex;
+    std::deque<Batch> myQueue;
+    bool myDraining, myFinished, myCompleted;
+    boost::system::error_code myError;
+  };
+}
+
+#endif // DIRECTORY_SCANNER_H
@@ -0,0 +1,83 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace NX
+{
+  /**
+   * Epoch based reclamation for read-mostly structures published through an atomic pointer.
+   *
+   * Readers hold a Guard while they use what they loaded; writers swap in a new version and retire the old one,
+   * which is deleted once every guard that could still see it is gone. A guard is not tied to a thread, so it
+   * may be held across a coroutine yield, but a long-lived guard holds back every retirement made meanwhile.
+   */
+  class Epoch: public boost::noncopyable
+  {
+    struct Record {
+      std::atomic<std::uint64_t> epoch;
+      std::atomic<bool> used;
+      Record * next;
+    };
+
+  public:
+    class Guard: public boost::noncopyable
+    {
+    public:
+      Guard();
+      ~Guard();
+
+    private:
+      Record * myRecord;
+    };
+
+    template<typename T>
+    static void retire(T * object) {
+      retire(object, [](void * p) { delete static_cast<T*>(p); });
+    }
+
+    static void retire(void * object, void (*deleter)(void *));
+
+    /**
+     * Frees whatever no guard can reach anymore. Retiring calls this on its own, and so does every so many guard
+     * releases on a thread while anything is pending.
+     */
+    static void collect();
+
+    static std::size_t pending();
+
+  private:
+    static Record * acquire();
+    static bool tryAdvance();
+
+    // never freed, there are only ever as many records as guards held at once
+    static std::atomic<Record*> myRecords;
+    // a coroutine may release its guard on another thread, so this is only a hint
+    static thread_local Record * myLastRecord;
+  };
+}
+
+#endif // EPOCH_H
@@ -0,0 +1,90 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NX
+{
+  class Scheduler;
+
+  /**
+   * A single inotify descriptor, read by the scheduler's reactor, shared by everything watching files.
+   *
+   * Watches on the same file share one kernel watch. Listeners run on the reactor thread, so they should only hand
+   * the event on. Every watch holds the scheduler until it is removed, and once unwatch() returns its listener won't
+   * be called again.
+   */
+  class FileWatcher: public boost::noncopyable
+  {
+  public:
+    struct Event {
+      std::uint32_t mask; // IN_* bits; IN_IGNORED means the watch is gone, IN_Q_OVERFLOW that events were lost
+      std::uint32_t cookie;
+      std::string name; // set for events on a directory's entries
+    };
+
+    typedef std::function<void(const Event & event)> Listener;
+    typedef std::size_t Handle;
+
+    FileWatcher(NX::Scheduler * scheduler, boost::asio::io_service & service);
+    ~FileWatcher();
+
+    bool available() const { return myFd >= 0; }
+
+    /**
+     * Throws if the file can't be watched; that includes running out of the user's inotify watches.
+     */
+    Handle watch(const std::string & path, std::uint32_t mask, Listener listener);
+
+    void unwatch(Handle handle);
+
+  private:
+    struct Watch {
+      int descriptor;
+      std::uint32_t mask;
+      Listener listener;
+    };
+
+    void arm();
+    void dispatch(std::size_t length);
+    void remove(std::map<Handle, Watch>::iterator watch, bool kernel);
+
+    NX::Scheduler * myScheduler;
+    int myFd;
+    boost::asio::posix::stream_descriptor myEvents;
+    std::vector<char> myBuffer;
+    std::recursive_mutex myMutex; // also held while listeners run, see unwatch()
+    std::map<Handle, Watch> myWatches;
+    std::multimap<int, Handle> myDescriptors;
+    Handle myNextHandle;
+  };
+}
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,101 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FREE_LIST_H
+#define FREE_LIST_H
+
+#include <cstddef>
+#include <new>
+
+namespace NX
+{
+  /**
+   * Per-thread intrusive free list for one object size.
+   *
+   * Freed blocks are threaded through their own storage and handed back out by the next allocation on the same
+   * thread, so steady-state churn never reaches the system allocator. Objects freed on another thread join that
+   * thread's list. Anything past MaxCached goes back to the heap.
+   */
+  template<std::size_t Size>
+  class FreeList
+  {
+    static_assert(Size >= sizeof(void*), "FreeList blocks must fit a pointer");
+
+    struct Node { Node * next; };
+
+    struct Cache {
+      Cache(): head(nullptr), count(0) {}
+      ~Cache() {
+        gone() = true;
+        while (head) {
+          Node * next = head->next;
+          ::operator delete(head);
+          head = next;
+        }
+      }
+      Node * head;
+      std::size_t count;
+    };
+
+    // plain flag, still readable by objects freed during thread teardown after the cache itself is gone
+    static bool & gone() { static thread_local bool flag = false; return flag; }
+    static Cache & cache() { static thread_local Cache instance; return instance; }
+
+  public:
+    static const std::size_t MaxCached = 4096;
+
+    static void * allocate(std::size_t size) {
+      if (size == Size && !gone()) {
+        Cache & local = cache();
+        if (Node * node = local.head) {
+          local.head = node->next;
+          local.count--;
+          return node;
+        }
+      }
+      return ::operator new(size);
+    }
+
+    static void deallocate(void * ptr, std::size_t size) {
+      if (ptr && size == Size && !gone()) {
+        Cache & local = cache();
+        if (local.count < MaxCached) {
+          Node * node = static_cast<Node*>(ptr);
+          node->next = local.head;
+          local.head = node;
+          local.count++;
+          return;
+        }
+      }
+      ::operator delete(ptr);
+    }
+  };
+}
+
+/**
+ * Routes a class' operator new/delete through NX::FreeList, derived classes of a different size fall through to
+ * the heap.
+ */
+#define NX_MAKE_FREE_LIST_ALLOCATED(Type) \
+public: \
+  static void * operator new(std::size_t size) { return NX::FreeList<sizeof(Type)>::allocate(size); } \
+  static void operator delete(void * ptr, std::size_t size) { NX::FreeList<sizeof(Type)>::deallocate(ptr, size); } \
+private:
+
+#endif // FREE_LIST_H
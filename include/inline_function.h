@@ -0,0 +1,240 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef INLINE_FUNCTION_H
+#define INLINE_FUNCTION_H
+
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace NX
+{
+  template<typename Signature, std::size_t Capacity = 64>
+  class InlineFunction;
+
+  /**
+   * Move-only callable that keeps anything up to Capacity bytes in place instead of on the heap.
+   * Bigger (or throwing-move) callables still work, they just take one allocation like std::function would.
+   */
+  template<typename R, typename... Args, std::size_t Capacity>
+  class InlineFunction<R(Args...), Capacity>
+  {
+    struct Ops {
+      R (*invoke)(void * storage, Args &&... args);
+      void (*move)(void * to, void * from);
+      void (*destroy)(void * storage);
+    };
+
+    template<typename F>
+    struct Inline {
+      static R invoke(void * storage, Args &&... args) { return (*static_cast<F*>(storage))(std::forward<Args>(args)...); }
+      static void move(void * to, void * from) { new (to) F(std::move(*static_cast<F*>(from))); static_cast<F*>(from)->~F(); }
+      static void destroy(void * storage) { static_cast<F*>(storage)->~F(); }
+      static const Ops ops;
+    };
+
+    template<typename F>
+    struct Boxed {
+      static F *& box(void * storage) { return *static_cast<F**>(storage); }
+      static R invoke(void * storage, Args &&... args) { return (*box(storage))(std::forward<Args>(args)...); }
+      static void move(void * to, void * from) { new (to) F*(box(from)); box(from) = nullptr; }
+      static void destroy(void * storage) { delete box(storage); }
+      static const Ops ops;
+    };
+
+    template<typename F>
+    using fits = std::integral_constant<bool, sizeof(F) <= Capacity && alignof(F) <= alignof(std::max_align_t) &&
+                                              std::is_nothrow_move_constructible<F>::value>;
+
+    template<typename F>
+    void assign(F && f, std::true_type) {
+      typedef typename std::decay<F>::type Fn;
+      new (myStorage) Fn(std::forward<F>(f));
+      myOps = &Inline<Fn>::ops;
+    }
+
+    template<typename F>
+    void assign(F && f, std::false_type) {
+      typedef typename std::decay<F>::type Fn;
+      new (myStorage) Fn*(new Fn(std::forward<F>(f)));
+      myOps = &Boxed<Fn>::ops;
+    }
+
+  public:
+    InlineFunction() noexcept: myOps(nullptr) {}
+    InlineFunction(std::nullptr_t) noexcept: myOps(nullptr) {}
+
+    template<typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, InlineFunction>::value &&
+      !std::is_same<typename std::decay<F>::type, std::function<R(Args...)>>::value>::type>
+    InlineFunction(F && f): myOps(nullptr) {
+      assign(std::forward<F>(f), fits<typename std::decay<F>::type>());
+    }
+
+    // an empty std::function must stay empty
+    InlineFunction(std::function<R(Args...)> && f): myOps(nullptr) {
+      if (f) assign(std::move(f), fits<std::function<R(Args...)>>());
+    }
+    InlineFunction(const std::function<R(Args...)> & f): myOps(nullptr) {
+      if (f) assign(f, fits<std::function<R(Args...)>>());
+    }
+
+    InlineFunction(InlineFunction && other) noexcept: myOps(other.myOps) {
+      if (myOps) {
+        myOps->move(myStorage, other.myStorage);
+        other.myOps = nullptr;
+      }
+    }
+
+    InlineFunction & operator = (InlineFunction && other) noexcept {
+      if (this != &other) {
+        reset();
+        if ((myOps = other.myOps)) {
+          myOps->move(myStorage, other.myStorage);
+          other.myOps = nullptr;
+        }
+      }
+      return *this;
+    }
+
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction & operator = (const InlineFunction &) = delete;
+
+    ~InlineFunction() { reset(); }
+
+    void reset() {
+      if (myOps) {
+        myOps->destroy(myStorage);
+        myOps = nullptr;
+      }
+    }
+
+    explicit operator bool() const { return myOps != nullptr; }
+
+    R operator()(Args... args) {
+      if (!myOps)
+        throw std::bad_function_call();
+      return myOps->invoke(myStorage, std::forward<Args>(args)...);
+    }
+
+  private:
+    alignas(std::max_align_t) unsigned char myStorage[Capacity];
+    const Ops * myOps;
+  };
+
+  template<typename R, typename... Args, std::size_t Capacity>
+  template<typename F>
+  const typename InlineFunction<R(Args...), Capacity>::Ops InlineFunction<R(Args...), Capacity>::Inline<F>::ops {
+    &Inline<F>::invoke, &Inline<F>::move, &Inline<F>::destroy
+  };
+
+  template<typename R, typename... Args, std::size_t Capacity>
+  template<typename F>
+  const typename InlineFunction<R(Args...), Capacity>::Ops InlineFunction<R(Args...), Capacity>::Boxed<F>::ops {
+    &Boxed<F>::invoke, &Boxed<F>::move, &Boxed<F>::destroy
+  };
+
+  /**
+   * Append-only list that keeps its first N elements inside the owning object.
+   */
+  template<typename T, std::size_t N>
+  class InlineList: public boost::noncopyable
+  {
+  public:
+    InlineList(): myData(reinterpret_cast<T*>(myInline)), mySize(0), myCapacity(N) {}
+
+    ~InlineList() {
+      clear();
+      if (myData != reinterpret_cast<T*>(myInline))
+        ::operator delete(myData);
+    }
+
+    template<typename... Params>
+    void emplace_back(Params &&... params) {
+      if (mySize == myCapacity)
+        grow();
+      new (myData + mySize) T(std::forward<Params>(params)...);
+      mySize++;
+    }
+
+    void push_back(const T & value) { emplace_back(value); }
+    void push_back(T && value) { emplace_back(std::move(value)); }
+
+    void clear() {
+      for (std::size_t i = 0; i < mySize; i++)
+        myData[i].~T();
+      mySize = 0;
+    }
+
+    /**
+     * Drops every element matching pred, keeping the order of the rest.
+     */
+    template<typename Predicate>
+    std::size_t remove_if(Predicate pred) {
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < mySize; i++) {
+        if (pred(myData[i]))
+          continue;
+        if (kept != i)
+          myData[kept] = std::move(myData[i]);
+        kept++;
+      }
+      const std::size_t removed = mySize - kept;
+      for (std::size_t i = kept; i < mySize; i++)
+        myData[i].~T();
+      mySize = kept;
+      return removed;
+    }
+
+    T & operator[] (std::size_t index) { return myData[index]; }
+    const T & operator[] (std::size_t index) const { return myData[index]; }
+
+    T * begin() { return myData; }
+    T * end() { return myData + mySize; }
+    const T * begin() const { return myData; }
+    const T * end() const { return myData + mySize; }
+    std::size_t size() const { return mySize; }
+    bool empty() const { return mySize == 0; }
+
+  private:
+    void grow() {
+      std::size_t capacity = myCapacity * 2;
+      T * data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+      for (std::size_t i = 0; i < mySize; i++) {
+        new (data + i) T(std::move(myData[i]));
+        myData[i].~T();
+      }
+      if (myData != reinterpret_cast<T*>(myInline))
+        ::operator delete(myData);
+      myData = data;
+      myCapacity = capacity;
+    }
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type myInline[N];
+    T * myData;
+    std::size_t mySize, myCapacity;
+  };
+}
+
+#endif // INLINE_FUNCTION_H
@@ -0,0 +1,131 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace NX
+{
+  /**
+   * HDR-style histogram of nanosecond durations: every power of two is split into 16 linear buckets, so any
+   * recorded value is reported within 1/16th of itself.
+   *
+   * Recording is meant for a single writer (one scheduler worker) and never does a read-modify-write on a shared
+   * line; readers merge any number of histograms into a Snapshot whenever they want numbers.
+   */
+  class LatencyHistogram: public boost::noncopyable
+  {
+  public:
+    static const std::size_t SubBuckets = 16;
+    static const std::size_t Buckets = (64 - 3) * SubBuckets;
+
+    struct Summary {
+      std::uint64_t count, mean, max, p50, p99, p999;
+    };
+
+    class Snapshot
+    {
+    public:
+      Snapshot(): myCounts(Buckets, 0), myCount(0), mySum(0), myMax(0) {}
+
+      void merge(const LatencyHistogram & histogram) {
+        for (std::size_t i = 0; i < Buckets; i++)
+          myCounts[i] += histogram.myCounts[i].load(std::memory_order_relaxed);
+        myCount += histogram.myCount.load(std::memory_order_relaxed);
+        mySum += histogram.mySum.load(std::memory_order_relaxed);
+        myMax = std::max<std::uint64_t>(myMax, histogram.myMax.load(std::memory_order_relaxed));
+      }
+
+      std::uint64_t percentile(double fraction) const {
+        // counters are read one by one while the writers keep going, so the total is taken from the buckets
+        std::uint64_t total = 0;
+        for (auto count : myCounts)
+          total += count;
+        if (!total)
+          return 0;
+        std::uint64_t rank = static_cast<std::uint64_t>(fraction * total + 0.5);
+        rank = std::max<std::uint64_t>(rank, 1);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < Buckets; i++) {
+          if ((seen += myCounts[i]) >= rank)
+            return std::min(highestIn(i), myMax);
+        }
+        return myMax;
+      }
+
+      Summary summary() const {
+        return Summary { myCount, myCount ? mySum / myCount : 0, myMax,
+                         percentile(0.5), percentile(0.99), percentile(0.999) };
+      }
+
+    private:
+      std::vector<std::uint64_t> myCounts;
+      std::uint64_t myCount, mySum, myMax;
+    };
+
+    LatencyHistogram(): myCount(0), mySum(0), myMax(0) {
+      for (auto & count : myCounts)
+        count.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Owner only.
+     */
+    void record(std::uint64_t nanos) {
+      bump(myCounts[indexOf(nanos)], 1);
+      bump(myCount, 1);
+      bump(mySum, nanos);
+      if (nanos > myMax.load(std::memory_order_relaxed))
+        myMax.store(nanos, std::memory_order_relaxed);
+    }
+
+    static std::size_t indexOf(std::uint64_t value) {
+      if (value < SubBuckets)
+        return static_cast<std::size_t>(value);
+      const std::size_t exponent = 63 - __builtin_clzll(value);
+      return (exponent - 3) * SubBuckets + ((value >> (exponent - 4)) & (SubBuckets - 1));
+    }
+
+    static std::uint64_t highestIn(std::size_t index) {
+      if (index < SubBuckets)
+        return index;
+      const std::size_t exponent = index / SubBuckets + 3;
+      const std::uint64_t lowest = (SubBuckets + index % SubBuckets) << (exponent - 4);
+      return lowest + (std::uint64_t(1) << (exponent - 4)) - 1;
+    }
+
+  private:
+    static void bump(std::atomic<std::uint64_t> & counter, std::uint64_t by) {
+      counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uint64_t> myCounts[Buckets];
+    std::atomic<std::uint64_t> myCount, mySum, myMax;
+  };
+}
+
+#endif // LATENCY_HISTOGRAM_H
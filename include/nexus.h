@@ -59,6 +59,11 @@ namespace NX
     NX::Scheduler * scheduler() { return myScheduler.get(); }
     const std::string & scriptPath() { return myScriptPath; }
 
+    /**
+     * Microtasks a context runs per drain before it gives the worker back to the scheduler, zero for no limit.
+     */
+    std::size_t microtaskBudget() const { return myMicrotaskBudget; }
+
     JSClassRef defineOrGetClass(const JSClassDefinition & def) {
       if (myClasses.find(def.className) != myClasses.end())
         return myClasses[def.className];
@@ -74,6 +79,15 @@ namespace NX
     static void ReportException(JSContextRef ctx, JSValueRef exception);
     static void ReportException(const std::exception & e);
     static void ReportSyntaxError(const JSC::SourceCode & code, const JSC::ParserError &error);
+    /**
+     * A promise rejected with nothing to handle it is reported and fails the run, unless a handler turns up later.
+     */
+    static void ReportRejection(JSContextRef ctx, const void * promise, JSValueRef reason, bool handled);
+
+    /**
+     * Non-zero once an error went uncaught or a rejection is still unhandled.
+     */
+    static int ExitStatus();
   private:
     Nexus ( const Nexus& other );
   protected:
@@ -86,6 +100,7 @@ namespace NX
     std::string myScriptPath;
     std::shared_ptr<NX::Scheduler> myScheduler;
     boost::program_options::variables_map myOptions;
+    std::size_t myMicrotaskBudget;
     boost::unordered_map<std::string, JSClassRef> myClasses;
   };
 }
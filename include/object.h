@@ -92,6 +92,10 @@ namespace NX {
       return JSObjectCallAsFunction(myContext, myObject, thisObject, args.size(), &args[0], exception);
     }
 
+    JSValueRef call(JSObjectRef thisObject, std::size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception) const {
+      return JSObjectCallAsFunction(myContext, myObject, thisObject, argumentCount, arguments, exception);
+    }
+
     JSObjectRef bind(JSObjectRef thisObject, size_t argumentCount,
                      const JSValueRef arguments[], JSValueRef * exception)
     {
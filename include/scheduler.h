@@ -28,16 +28,26 @@
 #include <boost/asio.hpp>
 #undef B0 // JavaSCriptCore will complain if this is defined.
 #include <boost/asio/handler_type.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/lockfree/queue.hpp>
 #include <boost/atomic.hpp>
 #include <boost/assert.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/unordered_map.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <thread>
 #include <WTF/wtf/ThreadGroup.h>
 #include <WTF/wtf/PriorityQueue.h>
 #include "exception.h"
+#include "work_queue.h"
+#include "timer_wheel.h"
+#include "inline_function.h"
+#include "latency_histogram.h"
 
 namespace NX
 {
@@ -45,38 +55,183 @@ namespace NX
   class AbstractTask;
   class Task;
   class CoroutineTask;
+  class Uring;
+  class FileWatcher;
   class Scheduler: public boost::noncopyable
   {
   public:
     typedef boost::asio::deadline_timer timer_type;
     typedef timer_type::duration_type duration;
     typedef std::function<void(void)> CompletionHandler;
+    typedef NX::InlineFunction<void(void)> TaskHandler;
+    typedef NX::InlineList<CompletionHandler, 2> HandlerList;
     typedef boost::lockfree::queue<NX::AbstractTask*> TaskQueue;
+    typedef NX::WorkStealingQueue<NX::AbstractTask*> LocalTaskQueue;
+
+    /**
+     * Per-thread dispatcher state; tasks scheduled from inside a running task land on the worker's own deque.
+     * With an io_service per worker, the worker is also the only thread that runs its reactor.
+     * A pool thread that takes the slot pins itself to the slot's cpus, if placement assigned any.
+     */
+    struct Worker: public boost::noncopyable {
+      explicit Worker(std::size_t index): index(index), queue(), active(false), parked(false), service(), work(),
+                                          cpus(), node(0), relocated(false), tasks(0), steals(0), injected(0),
+                                          parks(0), idleNanos(0), runningSince(0), lastWait(0), waitTime(), runTime() {}
+      const std::size_t index;
+      LocalTaskQueue queue;
+      std::atomic_bool active, parked;
+      std::shared_ptr<boost::asio::io_service> service;
+      std::shared_ptr<boost::asio::io_service::work> work;
+      std::vector<int> cpus;
+      std::size_t node;
+      bool relocated;
+      // written only by the thread holding the slot, summed up by stats()
+      std::atomic<std::uint64_t> tasks, steals, injected, parks, idleNanos;
+      std::atomic<std::int64_t> runningSince;
+      // how long the task started at runningSince sat in the queue
+      std::atomic<std::int64_t> lastWait;
+      NX::LatencyHistogram waitTime, runTime;
+    };
+
+    /**
+     * Lets a coroutine wait off the run queue. Whoever it waits on keeps a reference and calls wake() once the
+     * condition may have changed; the handle outlives the task, so a late wake-up never touches a finished one.
+     */
+    struct Wakeup: public boost::noncopyable {
+      enum State { RUNNING, SUSPENDING, SUSPENDED, WOKEN };
+      explicit Wakeup(NX::AbstractTask * task): task(task), state(RUNNING) {}
+      NX::AbstractTask * const task;
+      std::atomic<int> state;
+    };
+
+    /**
+     * A task caught running past its budget, with the JavaScript stack it was on at the time.
+     */
+    struct OverBudgetTask {
+      enum Action { REPORTED, YIELDED, ABORTED };
+      std::string stack;
+      std::int64_t runTime;
+      Action action;
+    };
+
+    /**
+     * Point-in-time view of the pool. Durations are in nanoseconds.
+     */
+    struct Stats {
+      struct WorkerStats {
+        std::size_t index, node, queueDepth;
+        bool active;
+        std::vector<int> cpus;
+        std::uint64_t tasks, steals, injected, parks, idleTime;
+      };
+      std::size_t threads, poolThreads, queued, active, timers;
+      std::uint64_t overBudget;
+      std::vector<WorkerStats> workers;
+      std::vector<OverBudgetTask> recentOverBudget;
+      NX::LatencyHistogram::Summary waitTime, runTime;
+    };
   public:
-    Scheduler(NX::Nexus *, unsigned int maxThreads);
+    Scheduler(NX::Nexus *, unsigned int maxThreads, bool servicePerWorker = false);
     virtual ~Scheduler();
   public:
     void start();
     void pause() { myPauseTasks.store(true); }
-    void resume() { myPauseTasks.store(false); }
+    void resume() { myPauseTasks.store(false); wakeAll(); }
     void stop();
     void join();
     void joinPool();
 
     NX::AbstractTask * scheduleAbstractTask(NX::AbstractTask * task);
 
-    NX::Task * scheduleTask(CompletionHandler && handler);
-    NX::Task * scheduleTask(const duration & time, CompletionHandler && handler);
-    NX::CoroutineTask * scheduleCoroutine(CompletionHandler && handler);
-    NX::CoroutineTask * scheduleCoroutine(const duration & time, CompletionHandler && handler);
+    /**
+     * Publishes several tasks at once: one counter update, one enqueue and at most one wake-up.
+     */
+    void scheduleAbstractTasks(NX::AbstractTask * const * tasks, std::size_t count);
 
-    NX::Task * scheduleThreadInitTask(CompletionHandler && handler);
+    std::vector<NX::AbstractTask*> scheduleBatch(std::vector<TaskHandler> && handlers);
+
+    NX::Task * scheduleTask(TaskHandler && handler);
+    NX::Task * scheduleTask(const duration & time, TaskHandler && handler);
+    NX::CoroutineTask * scheduleCoroutine(TaskHandler && handler);
+    NX::CoroutineTask * scheduleCoroutine(const duration & time, TaskHandler && handler);
+
+    NX::Task * scheduleThreadInitTask(TaskHandler && handler);
+
+    /**
+     * Pulls a task scheduled with a delay off the timer wheel before it fires, aborts and frees it.
+     * Returns false if the timer already fired, in which case the task is left alone.
+     */
+    bool cancelTimer(NX::AbstractTask * task);
+
+    std::size_t timers() const;
+
+    /**
+     * Aggregates the per-worker counters and histograms; recording them costs the workers no shared writes.
+     */
+    Stats stats() const;
 
     void yield();
 
+    /**
+     * The running coroutine's wake-up handle; throws outside of a coroutine, like yield().
+     */
+    std::shared_ptr<Wakeup> wakeup();
+
+    /**
+     * Parks the running coroutine until its handle is woken, or returns right away if a wake-up is already
+     * pending. Callers re-check what they are waiting for, a wake-up may be left over from an earlier wait.
+     */
+    void suspend();
+
+    /**
+     * Puts a suspended coroutine back on the run queue exactly once; if it hasn't suspended yet, the wake-up is
+     * kept for it instead.
+     */
+    void wake(const std::shared_ptr<Wakeup> & wakeup);
+
     NX::Nexus * nexus() { return myNexus; }
 
     std::size_t concurrency() const { return myThreadCount; }
+    std::size_t poolThreads() const { return myPoolThreads; }
+    std::size_t minThreads() const { return myMinThreads; }
+    std::size_t maxThreads() const { return myMaxThreads; }
+
+    /**
+     * Pool sizing: never fewer than minThreads pool threads once started; a new thread is only added once queued
+     * work has waited growDelay with nobody idle, at most one per growDelay; pool threads idle for idleTimeout
+     * retire down to the minimum. Growth is decided by a monitor thread, so it happens even while every worker is
+     * stuck in a long task.
+     */
+    void setMinThreads(std::size_t threads) { myMinThreads.store(std::min<std::size_t>(threads, myMaxThreads)); }
+    void setGrowDelay(std::chrono::microseconds delay) { myGrowDelay.store(delay.count()); }
+    void setIdleTimeout(std::chrono::milliseconds timeout) { myIdleTimeout.store(timeout.count()); }
+
+    /**
+     * Worker placement, call before start(). With pinCpus every slot gets a core of its own; with numaAware slots
+     * are spread round-robin over the NUMA nodes, pinned to their node, steal from their own node first and move
+     * their run queue into node-local memory once pinned. Only pool threads pin, the thread in joinPool() doesn't.
+     */
+    void setPlacement(bool pinCpus, bool numaAware);
+
+    /**
+     * The cpu the worker owning this io_service is pinned to, or -1 if it isn't pinned to a single one.
+     */
+    int serviceCpu(const boost::asio::io_service & service) const;
+
+    /**
+     * CPU time budget per task run, zero for none. Enforced by the JavaScript watchdog: a coroutine over budget
+     * yields back to the scheduler, a plain task is reported and, with abortOverBudget, terminated.
+     */
+    void setTaskBudget(std::chrono::microseconds budget) { myTaskBudget.store(budget.count()); }
+    std::chrono::microseconds taskBudget() const { return std::chrono::microseconds(myTaskBudget.load()); }
+    void setAbortOverBudget(bool abort) { myAbortOverBudget.store(abort); }
+    bool abortOverBudget() const { return myAbortOverBudget; }
+
+    /**
+     * Nanoseconds the task running on this thread has been going since it was last entered, zero outside a task.
+     */
+    std::int64_t currentTaskRunTime() const;
+    void reportOverBudget(OverBudgetTask && task);
     std::size_t queued() const { return myTaskCount; }
     std::size_t active() const { return myActiveTaskCount; }
     std::size_t remaining() const { return (std::size_t)myTaskCount + (std::size_t)myActiveTaskCount; }
@@ -94,10 +249,44 @@ namespace NX
     };
 
     void hold() { myHoldCount++; }
-    void release() { myHoldCount--; }
+    void release() { if (--myHoldCount == 0) wakeAll(); }
+
+    /**
+     * In low-latency mode idle workers keep spinning instead of parking in the kernel.
+     */
+    void setLowLatency(bool enabled) { myLowLatency.store(enabled); }
+    bool lowLatency() const { return myLowLatency; }
+
+    /**
+     * The io_service new I/O objects should be bound to.
+     * With an io_service per worker this is the calling worker's own; other threads are spread round-robin.
+     */
+    std::shared_ptr<boost::asio::io_service> service() const;
+
+    /**
+     * Every io_service that runs I/O, one per worker slot or just the shared one.
+     */
+    std::vector<std::shared_ptr<boost::asio::io_service>> services() const;
+
+    bool servicePerWorker() const { return myServicePerWorker; }
 
-    const std::shared_ptr<boost::asio::io_service> service() const { return myService; }
-    std::shared_ptr<boost::asio::io_service> service() { return myService; }
+    /**
+     * The io_uring instance file I/O is submitted to, created on first use and reaped by the first io_service.
+     * Check available() before relying on it.
+     */
+    std::shared_ptr<NX::Uring> uring();
+
+    /**
+     * The inotify instance file watches share, created on first use and read by the first io_service.
+     */
+    std::shared_ptr<NX::FileWatcher> fileWatcher();
+
+    /**
+     * Runs handler on the blocking lane: a few threads of its own, started on first use, for system calls that can
+     * stall (directory scans, stat storms) so they never tie up a worker. Handlers must not touch JavaScript; they
+     * schedule a task with their result. The scheduler is held until the handler returns.
+     */
+    void scheduleBlocking(TaskHandler && handler);
 
     /**
      * Internal use only!
@@ -108,21 +297,70 @@ namespace NX
 
   protected:
     void addThread();
+    bool reserveThread();
+    bool retireThread();
     void balanceThreads();
-    void dispatcher();
+    void monitor();
+    std::int64_t queueDelay(std::int64_t now) const;
+    void dispatcher(bool pooled = false);
     std::size_t drainTasks();
+    NX::AbstractTask * nextTask(Worker * worker);
+    void requeue(NX::AbstractTask * task);
+    static std::int64_t clock();
+    Worker * acquireWorker();
+    void releaseWorker(Worker * worker);
+    bool drained() const { return !myTaskCount && !myActiveTaskCount && !myHoldCount; }
+    void park(Worker * worker);
+    void wakeOne();
+    void wakeAll();
+    void scheduleTimer(NX::AbstractTask * task, const duration & time);
+    void armTimers();
+    void onTimers(const boost::system::error_code & error);
   private:
     NX::Nexus * myNexus;
     std::atomic_size_t myMaxThreads;
-    std::atomic_size_t myThreadCount;
+    std::atomic_size_t myThreadCount, myPoolThreads, myMinThreads;
+    std::atomic<std::int64_t> myGrowDelay, myIdleTimeout;
+    // the last time the monitor saw the queue empty
+    std::atomic<std::int64_t> myBacklogSince;
+    std::unique_ptr<boost::thread> myMonitor;
+    std::mutex myMonitorMutex;
+    std::condition_variable myMonitorWake;
+    bool myMonitorStop;
     std::shared_ptr<boost::asio::io_service> myService;
     std::shared_ptr<boost::asio::io_service::work> myWork;
-    boost::thread_group myThreadGroup;
+    std::mutex myThreadsMutex;
+    boost::unordered_map<boost::thread::id, std::unique_ptr<boost::thread>> myThreads;
     boost::thread_specific_ptr<NX::AbstractTask> myCurrentTask;
-    TaskQueue myTaskQueue;
+    boost::thread_specific_ptr<Worker> myCurrentWorker;
+    std::vector<std::unique_ptr<Worker>> myWorkers;
+    TaskQueue myTaskQueue; // global injector, fed from outside the workers
     std::vector<NX::AbstractTask*> myThreadInitQueue;
     std::atomic_size_t myTaskCount, myActiveTaskCount, myHoldCount;
     std::atomic_bool myPauseTasks;
+    std::atomic<std::uint32_t> myIdleEpoch;
+    std::atomic_size_t myParkedCount;
+    std::atomic_bool myReactorParked, myLowLatency;
+    const bool myServicePerWorker;
+    bool myNumaAware;
+    std::atomic<std::int64_t> myTaskBudget;
+    std::atomic_bool myAbortOverBudget;
+    std::atomic<std::uint64_t> myOverBudgetCount;
+    mutable std::mutex myOverBudgetMutex;
+    std::deque<OverBudgetTask> myOverBudget;
+    mutable std::atomic_size_t myNextService;
+    NX::TimerWheel myTimers;
+    mutable std::mutex myTimersMutex;
+    std::shared_ptr<boost::asio::steady_timer> myTimerDriver;
+    NX::TimerWheel::tick_type myTimerArmed;
+    std::once_flag myUringOnce;
+    std::shared_ptr<NX::Uring> myUring;
+    std::once_flag myFileWatcherOnce;
+    std::shared_ptr<NX::FileWatcher> myFileWatcher;
+    std::once_flag myBlockingOnce;
+    std::shared_ptr<boost::asio::io_service> myBlockingService;
+    std::shared_ptr<boost::asio::io_service::work> myBlockingWork;
+    boost::thread_group myBlockingThreads;
   };
 }
 #endif // SCHEDULER_H
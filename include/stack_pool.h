@@ -0,0 +1,64 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STACK_POOL_H
+#define STACK_POOL_H
+
+#include <boost/context/stack_context.hpp>
+
+#include <cstddef>
+
+namespace NX
+{
+  /**
+   * Recycles coroutine stacks instead of mapping a fresh one for every CoroutineTask.
+   *
+   * Each thread keeps its own free list, a stack goes back to whichever thread happens to destroy the coroutine.
+   * Stacks are mmap'd with a guard page below them, like boost::context::protected_fixedsize_stack.
+   */
+  class StackPool
+  {
+  public:
+    struct Stats {
+      std::size_t hits;
+      std::size_t misses;
+      std::size_t stackSize;
+      std::size_t poolSize;
+    };
+
+    /**
+     * Call before any coroutine runs. A stack size of 0 keeps boost::context's default.
+     */
+    static void configure(std::size_t stackSize, std::size_t poolSize);
+
+    static Stats stats();
+
+    /**
+     * Models boost::context's StackAllocator.
+     */
+    class Allocator
+    {
+    public:
+      boost::context::stack_context allocate();
+      void deallocate(boost::context::stack_context & sctx);
+    };
+  };
+}
+
+#endif // STACK_POOL_H
@@ -26,6 +26,7 @@
 
 #include "scheduler.h"
 #include "exception.h"
+#include "free_list.h"
 
 #include <wtf/FastMalloc.h>
 
@@ -44,8 +45,12 @@ namespace NX
   protected:
 
     NX::Scheduler::Holder myHolder;
+    NX::TimerWheel::Handle myTimer;
+    std::int64_t myQueuedAt;
+    std::shared_ptr<NX::Scheduler::Wakeup> myWakeup;
 
-    AbstractTask(NX::Scheduler * scheduler, bool hold): myHolder(hold ? scheduler : nullptr) {}
+    AbstractTask(NX::Scheduler * scheduler, bool hold): myHolder(hold ? scheduler : nullptr), myTimer(), myQueuedAt(0),
+                                                        myWakeup() {}
 
     virtual ~AbstractTask() = default;
 
@@ -79,10 +84,10 @@ namespace NX
   protected:
     ~Task() override { }
 
-    WTF_MAKE_FAST_ALLOCATED;
+    NX_MAKE_FREE_LIST_ALLOCATED(Task)
 
   public:
-    Task(NX::Scheduler::CompletionHandler && handler, NX::Scheduler * scheduler, bool hold = true):
+    Task(NX::Scheduler::TaskHandler && handler, NX::Scheduler * scheduler, bool hold = true):
       AbstractTask(scheduler, hold), myHandler(std::move(handler)), myScheduler(scheduler), myStatus(INACTIVE)
     {
     }
@@ -104,16 +109,18 @@ namespace NX
     void await() override {
       if (myStatus == Status::FINISHED || myStatus == Status::ABORTED)
         return;
-      std::atomic_bool finished(false);
-      myCancellationHandlers.emplace_back([&] { finished.store(true); });
-      myCompletionHandlers.emplace_back([&] { finished.store(true); });
-      while (!finished)
-        myScheduler->yield();
+      auto finished = std::make_shared<std::atomic_bool>(false);
+      auto wakeup = myScheduler->wakeup();
+      NX::Scheduler * scheduler = myScheduler;
+      myCancellationHandlers.emplace_back([=] { finished->store(true); scheduler->wake(wakeup); });
+      myCompletionHandlers.emplace_back([=] { finished->store(true); scheduler->wake(wakeup); });
+      while (!*finished)
+        myScheduler->suspend();
     }
 
   protected:
-    NX::Scheduler::CompletionHandler myHandler;
-    std::vector<NX::Scheduler::CompletionHandler> myCancellationHandlers, myCompletionHandlers;
+    NX::Scheduler::TaskHandler myHandler;
+    NX::Scheduler::HandlerList myCancellationHandlers, myCompletionHandlers;
     NX::Scheduler * myScheduler;
     boost::atomic<Status> myStatus;
   };
@@ -123,13 +130,13 @@ namespace NX
     typedef coro_t::push_type push_type;
     typedef boost::coroutines2::coroutine<void>::pull_type pull_type;
 
-  WTF_MAKE_FAST_ALLOCATED;
+  NX_MAKE_FREE_LIST_ALLOCATED(CoroutineTask)
 
   protected:
     ~CoroutineTask() override = default;
 
   public:
-    CoroutineTask(NX::Scheduler::CompletionHandler &&, NX::Scheduler *, bool hold = false);
+    CoroutineTask(NX::Scheduler::TaskHandler &&, NX::Scheduler *, bool hold = false);
 
     Scheduler * scheduler() override { return myScheduler; }
 
@@ -151,18 +158,20 @@ namespace NX
     void await() override {
       if (myStatus == Status::FINISHED || myStatus == Status::ABORTED)
         return;
-      std::atomic_bool finished(false);
-      myCancellationHandlers.emplace_back([&] { finished.store(true); });
-      myCompletionHandlers.emplace_back([&] { finished.store(true); });
-      while (!finished)
-        myScheduler->yield();
+      auto finished = std::make_shared<std::atomic_bool>(false);
+      auto wakeup = myScheduler->wakeup();
+      NX::Scheduler * scheduler = myScheduler;
+      myCancellationHandlers.emplace_back([=] { finished->store(true); scheduler->wake(wakeup); });
+      myCompletionHandlers.emplace_back([=] { finished->store(true); scheduler->wake(wakeup); });
+      while (!*finished)
+        myScheduler->suspend();
     }
 
   protected:
     void coroutine(pull_type & ca);
   protected:
-    NX::Scheduler::CompletionHandler myHandler;
-    std::vector<NX::Scheduler::CompletionHandler> myCancellationHandlers, myCompletionHandlers;
+    NX::Scheduler::TaskHandler myHandler;
+    NX::Scheduler::HandlerList myCancellationHandlers, myCompletionHandlers;
     NX::Scheduler * myScheduler;
     std::shared_ptr<push_type> myCoroutine;
     pull_type * myPullCa;
@@ -172,14 +181,33 @@ namespace NX
   class TaskGroup: public std::vector<NX::AbstractTask*> {
   public:
     explicit TaskGroup(NX::Scheduler * scheduler): std::vector<NX::AbstractTask*>(), myScheduler(scheduler),
-                                                   myFinished(nullptr) { attach(); }
+      myFinished(nullptr), myWaiter(std::make_shared<std::shared_ptr<NX::Scheduler::Wakeup>>()) { attach(); }
     TaskGroup(std::vector<NX::AbstractTask*> tasks, NX::Scheduler * scheduler):
-      std::vector<NX::AbstractTask*>(std::move(tasks)), myScheduler(scheduler), myFinished(nullptr) { attach(); }
+      std::vector<NX::AbstractTask*>(std::move(tasks)), myScheduler(scheduler), myFinished(nullptr),
+      myWaiter(std::make_shared<std::shared_ptr<NX::Scheduler::Wakeup>>()) { attach(); }
     TaskGroup(std::vector<NX::AbstractTask*> && tasks, NX::Scheduler * scheduler):
-      std::vector<NX::AbstractTask*>(tasks), myScheduler(scheduler), myFinished(nullptr) { attach(); }
+      std::vector<NX::AbstractTask*>(tasks), myScheduler(scheduler), myFinished(nullptr),
+      myWaiter(std::make_shared<std::shared_ptr<NX::Scheduler::Wakeup>>()) { attach(); }
+
+    /**
+     * Creates a task per handler and publishes them as one batch, after the group is attached to all of them.
+     */
+    TaskGroup(NX::Scheduler * scheduler, std::vector<NX::Scheduler::TaskHandler> && handlers):
+      std::vector<NX::AbstractTask*>(), myScheduler(scheduler), myFinished(std::make_shared<std::atomic_size_t>(0)),
+      myWaiter(std::make_shared<std::shared_ptr<NX::Scheduler::Wakeup>>())
+    {
+      reserve(handlers.size());
+      for (auto & handler : handlers) {
+        auto * task = new NX::Task(std::move(handler), scheduler);
+        attach(task);
+        std::vector<NX::AbstractTask*>::push_back(task);
+      }
+      scheduler->scheduleAbstractTasks(data(), size());
+    }
 
     TaskGroup(NX::TaskGroup && other):
-      std::vector<NX::AbstractTask*>(other), myScheduler(other.myScheduler), myFinished(other.myFinished)
+      std::vector<NX::AbstractTask*>(other), myScheduler(other.myScheduler), myFinished(other.myFinished),
+      myWaiter(other.myWaiter)
     {
     }
 
@@ -208,19 +236,30 @@ namespace NX
         (*myFinished)++;
       else {
         std::shared_ptr<std::atomic_size_t> finished(myFinished);
-        task->addCompletionHandler([finished] { (*finished)++; });
-        task->addCancellationHandler([finished] { (*finished)++; });
+        auto waiter = myWaiter;
+        NX::Scheduler * scheduler = myScheduler;
+        auto done = [finished, waiter, scheduler] {
+          (*finished)++;
+          // the group may be gone by now, the waiter slot is shared with it
+          if (auto wakeup = std::atomic_load(waiter.get()))
+            scheduler->wake(wakeup);
+        };
+        task->addCompletionHandler(done);
+        task->addCancellationHandler(done);
       }
     }
 
     void await() {
+      std::atomic_store(myWaiter.get(), myScheduler->wakeup());
       while (*myFinished < size())
-        myScheduler->yield();
+        myScheduler->suspend();
+      std::atomic_store(myWaiter.get(), std::shared_ptr<NX::Scheduler::Wakeup>());
     }
 
   private:
     NX::Scheduler * myScheduler;
     std::shared_ptr<std::atomic_size_t> myFinished;
+    std::shared_ptr<std::shared_ptr<NX::Scheduler::Wakeup>> myWaiter;
   };
 }
 
@@ -0,0 +1,126 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace NX
+{
+  class AbstractTask;
+
+  /**
+   * Hashed hierarchical timer wheel (Varghese & Lauck), 1ms ticks.
+   *
+   * Four levels of 256 slots cover ~49 days; later deadlines park in the top level and get re-filed as the
+   * wheel turns. Insert and cancel are O(1), entries come from a free list so millions of pending timers cost
+   * one small node each. Not thread-safe on its own, the scheduler serializes access.
+   */
+  class TimerWheel: public boost::noncopyable
+  {
+  public:
+    typedef std::chrono::steady_clock clock;
+    typedef std::uint64_t tick_type;
+
+    /**
+     * Identifies a pending timer; stale handles (fired or cancelled) are ignored by cancel().
+     */
+    struct Handle {
+      Handle(): entry(nullptr), generation(0) {}
+      void * entry;
+      std::uint64_t generation;
+    };
+
+    TimerWheel();
+    ~TimerWheel();
+
+    static tick_type toTicks(clock::duration duration);
+
+    tick_type now() const;
+    clock::time_point timeOf(tick_type tick) const { return myEpoch + std::chrono::milliseconds(tick); }
+    tick_type current() const { return myCurrent; }
+    std::size_t size() const { return mySize; }
+    bool empty() const { return mySize == 0; }
+
+    Handle insert(NX::AbstractTask * task, tick_type deadline);
+
+    /**
+     * Returns the task the timer was holding, or nullptr if the handle is stale.
+     */
+    NX::AbstractTask * cancel(const Handle & handle);
+
+    /**
+     * Turns the wheel up to the given tick, appending every expired task to the list.
+     */
+    void advance(tick_type to, std::vector<NX::AbstractTask*> & expired);
+
+    /**
+     * The next tick worth waking up for: a non-empty slot, or the next cascade. Only valid if not empty.
+     */
+    tick_type nextTick() const;
+
+  private:
+    static constexpr std::size_t Levels = 4;
+    static constexpr std::size_t SlotBits = 8;
+    static constexpr std::size_t Slots = 1 << SlotBits;
+    static constexpr tick_type SlotMask = Slots - 1;
+    static constexpr std::size_t EntriesPerBlock = 4096;
+
+    struct Entry;
+
+    struct Slot {
+      Slot(): head(nullptr) {}
+      Entry * head;
+    };
+
+    struct Entry {
+      Entry * prev;
+      Entry * next;
+      Slot * slot;
+      std::size_t level;
+      tick_type deadline;
+      std::uint64_t generation;
+      NX::AbstractTask * task;
+    };
+
+    Entry * allocate();
+    void release(Entry * entry);
+    void link(Entry * entry);
+    void unlink(Entry * entry);
+    void cascade(std::size_t level);
+
+    std::array<std::array<Slot, Slots>, Levels> myWheel;
+    std::array<std::size_t, Levels> myLevelSizes;
+    std::vector<std::unique_ptr<Entry[]>> myBlocks;
+    Entry * myFreeList;
+    clock::time_point myEpoch;
+    tick_type myCurrent;
+    std::size_t mySize;
+  };
+}
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,55 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+namespace NX
+{
+  /**
+   * CPU and NUMA layout, as far as this process is allowed to use it.
+   */
+  namespace Topology
+  {
+    /**
+     * CPUs this process may run on.
+     */
+    std::vector<int> cpus();
+
+    /**
+     * Usable CPUs grouped by NUMA node; a single group on machines (or platforms) without NUMA information.
+     */
+    std::vector<std::vector<int>> nodes();
+
+    /**
+     * Parses a kernel cpulist such as "0-3,8,10-11".
+     */
+    std::vector<int> parseCpuList(const std::string & list);
+
+    /**
+     * Restricts the calling thread to the given CPUs. Returns false if the platform refused or doesn't support it.
+     */
+    bool pinCurrentThread(const std::vector<int> & cpus);
+  }
+}
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,130 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct io_uring_sqe;
+
+namespace NX
+{
+  class Scheduler;
+
+  /**
+   * A single io_uring instance whose completions are reaped by the scheduler's reactor through an eventfd.
+   *
+   * Submitting never blocks: operations past the capacity of either queue wait in a backlog until earlier ones
+   * complete. Every operation in flight holds the scheduler, so it won't wind down under pending I/O.
+   * Completions run on the reactor thread with the kernel's result (bytes transferred or -errno), and so does the
+   * -errno of a submission the kernel refused.
+   */
+  class Uring: public boost::noncopyable, public std::enable_shared_from_this<Uring>
+  {
+  public:
+    typedef std::function<void(int result)> Completion;
+
+    /**
+     * A slot of the registered buffer slab; index is -1 if none was free.
+     */
+    struct Buffer {
+      char * data;
+      std::size_t size;
+      int index;
+    };
+
+    static const std::size_t BufferCount = 16;
+    static const std::size_t BufferSize = 256 * 1024;
+
+    Uring(NX::Scheduler * scheduler, boost::asio::io_service & service, unsigned int entries = 256);
+    ~Uring();
+
+    /**
+     * False if the kernel (or a seccomp policy) refused io_uring; callers fall back to blocking I/O then.
+     */
+    bool available() const { return myFd >= 0; }
+
+    /**
+     * Adds fd to the registered file table. Returns the slot, or -1 if it has to be used unregistered.
+     */
+    int registerFile(int fd);
+    void unregisterFile(int slot);
+
+    Buffer acquireBuffer();
+    void releaseBuffer(int index);
+
+    /**
+     * fd is used as is when slot is -1. A buffer index other than -1 means dest lies in that registered buffer.
+     */
+    void read(int fd, int slot, char * dest, std::size_t length, std::uint64_t offset, int buffer, Completion completion);
+    void write(int fd, int slot, const char * source, std::size_t length, std::uint64_t offset, Completion completion);
+    void fsync(int fd, int slot, bool dataOnly, Completion completion);
+
+  private:
+    struct Operation {
+      std::uint8_t opcode;
+      int fd;
+      bool fixedFile;
+      std::uint64_t address;
+      std::uint32_t length;
+      std::uint64_t offset;
+      std::uint32_t flags;
+      int buffer;
+      Completion completion;
+    };
+
+    void submit(Operation && operation);
+    void push(Operation & operation);
+    void arm();
+    void reap();
+
+    bool full() const;
+
+    NX::Scheduler * myScheduler;
+    boost::asio::io_service & myService;
+    int myFd, myEventFd;
+    boost::asio::posix::stream_descriptor myEvents;
+    std::uint64_t myEventCount;
+    void * mySqRing, * myCqRing, * mySqes;
+    std::size_t mySqRingSize, myCqRingSize, mySqesSize;
+    unsigned * mySqHead, * mySqTail, * mySqMask, * mySqArray;
+    unsigned * myCqHead, * myCqTail, * myCqMask;
+    void * myCqes;
+    unsigned mySqEntries, myCqEntries;
+    std::mutex myMutex;
+    std::size_t myInFlight;
+    std::deque<Operation> myBacklog;
+    std::vector<int> myFiles, myFreeFiles;
+    bool myFilesRegistered;
+    char * mySlab;
+    std::vector<int> myFreeBuffers;
+  };
+}
+
+#endif // URING_H
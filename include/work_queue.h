@@ -0,0 +1,176 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace NX
+{
+  /**
+   * Chase-Lev work-stealing deque.
+   *
+   * The owning worker pushes and pops at the bottom (LIFO), any other thread may steal from the top (FIFO).
+   * The ring grows on demand; retired rings are kept alive until the queue is destroyed since a thief may
+   * still be reading from one.
+   */
+  template<typename T>
+  class WorkStealingQueue: public boost::noncopyable
+  {
+    static_assert(std::is_pointer<T>::value, "WorkStealingQueue only stores pointers");
+
+    struct Ring {
+      explicit Ring(std::size_t capacity): mask(capacity - 1), items(new std::atomic<T>[capacity]) {}
+
+      std::size_t capacity() const { return mask + 1; }
+
+      T get(std::int64_t index) const { return items[index & mask].load(std::memory_order_relaxed); }
+      void put(std::int64_t index, T value) { items[index & mask].store(value, std::memory_order_relaxed); }
+
+      Ring * copy(std::int64_t top, std::int64_t bottom, std::size_t capacity) const {
+        auto ring = new Ring(capacity);
+        for (std::int64_t i = top; i < bottom; i++)
+          ring->put(i, get(i));
+        return ring;
+      }
+
+      const std::size_t mask;
+      std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+  public:
+    explicit WorkStealingQueue(std::size_t capacity = 256): myTop(0), myBottom(0), myRing(nullptr), myRetired() {
+      std::size_t size = 1;
+      while (size < capacity) size <<= 1;
+      myRing.store(new Ring(size), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingQueue() {
+      delete myRing.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Owner only.
+     */
+    void push(T value) {
+      std::int64_t bottom = myBottom.load(std::memory_order_relaxed);
+      std::int64_t top = myTop.load(std::memory_order_acquire);
+      Ring * ring = myRing.load(std::memory_order_relaxed);
+      if (bottom - top > static_cast<std::int64_t>(ring->capacity()) - 1) {
+        myRetired.emplace_back(ring);
+        ring = ring->copy(top, bottom, ring->capacity() * 2);
+        myRing.store(ring, std::memory_order_release);
+      }
+      ring->put(bottom, value);
+      std::atomic_thread_fence(std::memory_order_release);
+      myBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Owner only. Publishes all values with a single fence and bottom update.
+     */
+    void push(const T * values, std::size_t count) {
+      std::int64_t bottom = myBottom.load(std::memory_order_relaxed);
+      std::int64_t top = myTop.load(std::memory_order_acquire);
+      Ring * ring = myRing.load(std::memory_order_relaxed);
+      while (bottom - top + static_cast<std::int64_t>(count) > static_cast<std::int64_t>(ring->capacity())) {
+        myRetired.emplace_back(ring);
+        ring = ring->copy(top, bottom, ring->capacity() * 2);
+        myRing.store(ring, std::memory_order_release);
+      }
+      for (std::size_t i = 0; i < count; i++)
+        ring->put(bottom + i, values[i]);
+      std::atomic_thread_fence(std::memory_order_release);
+      myBottom.store(bottom + count, std::memory_order_relaxed);
+    }
+
+    /**
+     * Owner only. Moves the contents into a freshly allocated ring, so that it lands in memory local to the
+     * calling thread.
+     */
+    void relocate() {
+      std::int64_t bottom = myBottom.load(std::memory_order_relaxed);
+      std::int64_t top = myTop.load(std::memory_order_acquire);
+      Ring * ring = myRing.load(std::memory_order_relaxed);
+      myRetired.emplace_back(ring);
+      myRing.store(ring->copy(top, bottom, ring->capacity()), std::memory_order_release);
+    }
+
+    /**
+     * Owner only.
+     */
+    bool pop(T & value) {
+      std::int64_t bottom = myBottom.load(std::memory_order_relaxed) - 1;
+      Ring * ring = myRing.load(std::memory_order_relaxed);
+      myBottom.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t top = myTop.load(std::memory_order_relaxed);
+      if (top > bottom) {
+        myBottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+      }
+      value = ring->get(bottom);
+      if (top == bottom) {
+        // last item, race against thieves for it
+        bool won = myTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        myBottom.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+      }
+      return true;
+    }
+
+    /**
+     * Any thread.
+     */
+    bool steal(T & value) {
+      std::int64_t top = myTop.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t bottom = myBottom.load(std::memory_order_acquire);
+      if (top >= bottom)
+        return false;
+      Ring * ring = myRing.load(std::memory_order_consume);
+      value = ring->get(top);
+      return myTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    std::size_t size() const {
+      std::int64_t bottom = myBottom.load(std::memory_order_relaxed);
+      std::int64_t top = myTop.load(std::memory_order_relaxed);
+      return bottom > top ? static_cast<std::size_t>(bottom - top) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+  private:
+    alignas(64) std::atomic<std::int64_t> myTop;
+    alignas(64) std::atomic<std::int64_t> myBottom;
+    std::atomic<Ring*> myRing;
+    std::vector<std::unique_ptr<Ring>> myRetired;
+  };
+}
+
+#endif // WORK_QUEUE_H
@@ -0,0 +1,108 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "buffer_pool.h"
+
+#include <boost/thread/mutex.hpp>
+#include <wtf/FastMalloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace {
+  constexpr std::size_t ClassCount = 12; // 4 KiB .. 8 MiB
+  // a class keeps at most this much memory idle, but always at least two buffers
+  constexpr std::size_t RetainedPerClass = 32 * 1024 * 1024;
+  // and all of them together no more than this, past it buffers go back to the allocator
+  constexpr std::size_t RetainedTotal = 64 * 1024 * 1024;
+
+  struct SizeClass {
+    boost::mutex mutex;
+    std::vector<char *> free;
+  };
+
+  SizeClass classes[ClassCount];
+  std::atomic_size_t retainedBytes(0);
+
+  std::size_t classIndex(std::size_t size) {
+    std::size_t index = 0;
+    for (std::size_t classSize = NX::BufferPool::MinSize; classSize < size; classSize <<= 1)
+      index++;
+    return index;
+  }
+
+  std::size_t classLimit(std::size_t index) {
+    return std::max<std::size_t>(2, RetainedPerClass / (NX::BufferPool::MinSize << index));
+  }
+}
+
+constexpr std::size_t NX::BufferPool::MinSize;
+constexpr std::size_t NX::BufferPool::MaxSize;
+
+char * NX::BufferPool::acquire(std::size_t size, std::size_t & capacity)
+{
+  if (size > MaxSize) {
+    capacity = size;
+    return static_cast<char *>(WTF::fastMalloc(size));
+  }
+  const std::size_t index = classIndex(size);
+  capacity = MinSize << index;
+  {
+    SizeClass & sizeClass = classes[index];
+    boost::mutex::scoped_lock lock(sizeClass.mutex);
+    if (!sizeClass.free.empty()) {
+      char * buffer = sizeClass.free.back();
+      sizeClass.free.pop_back();
+      retainedBytes -= capacity;
+      return buffer;
+    }
+  }
+  return static_cast<char *>(WTF::fastMalloc(capacity));
+}
+
+void NX::BufferPool::release(char * buffer, std::size_t capacity)
+{
+  if (!buffer)
+    return;
+  if (capacity <= MaxSize && capacity >= MinSize && !(capacity & (capacity - 1))) {
+    const std::size_t index = classIndex(capacity);
+    SizeClass & sizeClass = classes[index];
+    boost::mutex::scoped_lock lock(sizeClass.mutex);
+    if (sizeClass.free.size() < classLimit(index)) {
+      // reserved before it is checked, so classes releasing at once can't overshoot together
+      if (retainedBytes.fetch_add(capacity) + capacity <= RetainedTotal) {
+        sizeClass.free.push_back(buffer);
+        return;
+      }
+      retainedBytes -= capacity;
+    }
+  }
+  WTF::fastFree(buffer);
+}
+
+void NX::BufferPool::deallocate(void * bytes, void * context)
+{
+  release(static_cast<char *>(bytes), reinterpret_cast<std::size_t>(context));
+}
+
+std::size_t NX::BufferPool::retained()
+{
+  return retainedBytes.load(std::memory_order_relaxed);
+}
@@ -17,6 +17,7 @@
  *
  */
 
+#include <deque>
 #include <utility>
 
 #include "classes/emitter.h"
@@ -25,11 +26,55 @@
 #include "util.h"
 #include "nexus.h"
 
-const JSClassDefinition NX::Classes::Emitter::EventCallbackClass {
-  0, kJSClassAttributeNone, "EventCallback", nullptr, nullptr, nullptr, nullptr, [](JSObjectRef thisObject) {
-    delete reinterpret_cast<EventCallback*>(JSObjectGetPrivate(thisObject));
+namespace {
+  struct AtomTable {
+    AtomTable(): lock(), ids(), names() {
+      static const char * builtins[] {
+        "data", "end", "error", "close", "connection", "attempt", "connected", "completed", "aborted", "header"
+      };
+      static_assert(sizeof(builtins) / sizeof(*builtins) == NX::Classes::Emitter::Atom::BuiltinCount,
+                    "every builtin atom needs a name");
+      for (auto name : builtins) {
+        ids[name] = static_cast<std::uint32_t>(names.size());
+        names.emplace_back(name);
+      }
+    }
+    boost::shared_mutex lock;
+    boost::unordered_map<std::string, std::uint32_t> ids;
+    std::deque<std::string> names; // stable references for Atom::name()
+  };
+
+  AtomTable & atoms() {
+    static AtomTable table;
+    return table;
   }
-};
+}
+
+std::uint32_t NX::Classes::Emitter::Atom::intern(const std::string & name)
+{
+  AtomTable & table = atoms();
+  {
+    boost::shared_lock<boost::shared_mutex> lock(table.lock);
+    auto it = table.ids.find(name);
+    if (it != table.ids.end())
+      return it->second;
+  }
+  boost::unique_lock<boost::shared_mutex> lock(table.lock);
+  auto it = table.ids.find(name);
+  if (it != table.ids.end())
+    return it->second;
+  auto id = static_cast<std::uint32_t>(table.names.size());
+  table.names.push_back(name);
+  table.ids.emplace(name, id);
+  return id;
+}
+
+const std::string & NX::Classes::Emitter::Atom::name() const
+{
+  AtomTable & table = atoms();
+  boost::shared_lock<boost::shared_mutex> lock(table.lock);
+  return table.names[myId];
+}
 
 JSClassRef NX::Classes::Emitter::createClass (NX::Context * context)
 {
@@ -56,53 +101,80 @@ JSObjectRef NX::Classes::Emitter::getConstructor (NX::Context * context)
   return JSObjectMakeConstructor(context->toJSContext(), createClass(context), NX::Classes::Emitter::Constructor);
 }
 
-JSValueRef NX::Classes::Emitter::addManyListener (JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, JSObjectRef callback, int count)
+template<typename Modify>
+void NX::Classes::Emitter::update(Modify modify)
+{
+  boost::unique_lock<boost::shared_mutex> lock(myTidyLock);
+  Table * current = myTable.load(std::memory_order_acquire);
+  Table * next = new Table();
+  for (const auto & entry : *current) {
+    Listeners & listeners = (*next)[entry.first];
+    for (const auto & event : entry.second)
+      listeners.push_back(event);
+  }
+  modify(*next);
+  myTable.store(next, std::memory_order_release);
+  NX::Epoch::retire(current);
+}
+
+JSValueRef NX::Classes::Emitter::addManyListener (JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, JSObjectRef callback, int count)
 {
-  JSC::JSLockHolder lock(toJS(ctx));
-  myMap[e].emplace_back(std::make_shared<Event>(e, NX::Object(ctx, callback), count));
+  auto event = std::make_shared<Event>(NX::Object(ctx, callback), count);
+  update([&](Table & table) { table[e.id()].push_back(std::move(event)); });
   return JSValueMakeUndefined(ctx);
 }
 
-JSValueRef NX::Classes::Emitter::addManyListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const std::__cxx11::string & e, EventCallback callback, int count)
+JSValueRef NX::Classes::Emitter::addManyListener(JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, EventCallback callback, int count)
 {
-  NX::Context * context = NX::Context::FromJsContext(ctx);
-  JSObjectRef thisObjectForBind = JSObjectMake(ctx,
-                                               context->nexus()->defineOrGetClass(NX::Classes::Emitter::EventCallbackClass),
-                                               new EventCallback(std::move(callback)));
-  JSObjectRef jsCallback = JSBindFunction(ctx, JSObjectMakeFunctionWithCallback(ctx, ScopedString("addManyListenersCallback"),
-    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
-       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
-      NX::Context * context = NX::Context::FromJsContext(ctx);
-      auto cn = reinterpret_cast<EventCallback*>(JSObjectGetPrivate(thisObject));
-      try {
-        return cn->operator()(context->toJSContext(), argumentCount, arguments, exception);
-      } catch(const std::exception & e) {
-        return JSWrapException(context->toJSContext(), e, exception);
-      }
-      return JSValueMakeUndefined(ctx);
-    }), thisObjectForBind, 0, nullptr, nullptr);
-  return addManyListener(ctx, thisObject, e, jsCallback, count);
+  auto event = std::make_shared<Event>(std::move(callback), count);
+  update([&](Table & table) { table[e.id()].push_back(std::move(event)); });
+  return JSValueMakeUndefined(ctx);
 }
 
-JSObjectRef NX::Classes::Emitter::emit (JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, std::size_t
+JSValueRef NX::Classes::Emitter::Event::invoke(JSContextRef ctx, std::size_t argumentCount, const JSValueRef arguments[],
+                                               JSValueRef * exception)
+{
+  if (!native)
+    return handler.call(nullptr, argumentCount, arguments, exception);
+  try {
+    return native(ctx, argumentCount, arguments, exception);
+  } catch(const std::exception & e) {
+    return JSWrapException(ctx, e, exception);
+  }
+}
+
+bool NX::Classes::Emitter::take(const Atom & e, Snapshot & events)
+{
+  bool exhausted = false;
+  NX::Epoch::Guard guard;
+  const Table & table = *myTable.load(std::memory_order_acquire);
+  auto item = table.find(e.id());
+  if (item == table.end())
+    return exhausted;
+  for (const auto & event : item->second) {
+    if (!event->take())
+      continue;
+    exhausted |= event->count.load(std::memory_order_relaxed) == 0;
+    events.push_back(event);
+  }
+  return exhausted;
+}
+
+JSObjectRef NX::Classes::Emitter::emit (JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, std::size_t
                                         argumentCount, const JSValueRef arguments[], JSValueRef * exception)
 {
-  JSC::JSLockHolder lock(toJS(ctx));
-  auto item = myMap.find(e);
-  if (item != myMap.end()) {
+  Snapshot events;
+  const bool exhausted = take(e, events);
+  if (!events.empty()) {
     ProtectedArguments args(ctx, argumentCount, arguments);
     std::vector<JSValueRef> promises;
-    for(auto & i: item->second)
+    for(auto & event : events)
     {
       JSValueProtect(ctx, thisObject);
-      if (i->count > 0)
-        i->count--;
-      NX::Object func(i->handler);
       promises.emplace_back(NX::Globals::Promise::createPromise(ctx,
         [=](JSContextRef ctx, ResolveRejectHandler resolve, ResolveRejectHandler reject) {
-          NX::Object funcCopy(func);
           JSValueRef exp = nullptr;
-          JSValueRef val = funcCopy.call(nullptr, args, &exp);
+          JSValueRef val = event->invoke(ctx, args.size(), args, &exp);
           if (exp)
             reject(ctx, exp);
           else
@@ -110,7 +182,8 @@ JSObjectRef NX::Classes::Emitter::emit (JSGlobalContextRef ctx, JSObjectRef this
           JSValueUnprotect(ctx, thisObject);
         }));
     }
-    tidy(ctx, e);
+    if (exhausted)
+      tidy(ctx, e);
     return NX::Globals::Promise::all(ctx, promises);
   } else {
     std::vector<JSValueRef> emptyArrayValues;
@@ -120,66 +193,63 @@ JSObjectRef NX::Classes::Emitter::emit (JSGlobalContextRef ctx, JSObjectRef this
 }
 
 
-void NX::Classes::Emitter::emitFast (JSContextRef ctx, JSObjectRef thisObject, const std::string & e, std::size_t
+void NX::Classes::Emitter::emitFast (JSContextRef ctx, JSObjectRef thisObject, const Atom & e, std::size_t
                                      argumentCount, const JSValueRef arguments[], JSValueRef * exception)
 {
-  JSC::JSLockHolder lock(toJS(ctx));
-  auto item = myMap.find(e);
-  if (item != myMap.end()) {
-    for(const auto &i: item->second)
-    {
-      if (i->count > 0)
-        i->count--;
-      i->handler.call(nullptr, std::vector<JSValueRef>(arguments, arguments + argumentCount), exception);
-    }
+  // the copies keep their listeners alive, whatever the listeners do to the emitter meanwhile
+  Snapshot events;
+  const bool exhausted = take(e, events);
+  for (const auto & event : events)
+    event->invoke(ctx, argumentCount, arguments, exception);
+  if (exhausted)
     tidy(ctx, e);
-  }
 }
 
-NX::TaskGroup NX::Classes::Emitter::emitFastAndSchedule(JSContextRef ctx, JSObjectRef thisObject, const std::string & e,
+NX::TaskGroup NX::Classes::Emitter::emitFastAndSchedule(JSContextRef ctx, JSObjectRef thisObject, const Atom & e,
                                                std::size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception)
 {
   NX::Context * context = NX::Context::FromJsContext(ctx);
-  JSC::JSLockHolder lock(toJS(ctx));
-  NX::TaskGroup tasks(context->nexus()->scheduler());
-  auto item = myMap.find(e);
-  if (item != myMap.end()) {
-    for(const auto &i: item->second)
+  std::vector<NX::Scheduler::TaskHandler> handlers;
+  Snapshot events;
+  const bool exhausted = take(e, events);
+  if (!events.empty()) {
+    // one protected copy of the arguments, shared by every listener
+    auto args = std::make_shared<ProtectedArguments>(context->toJSContext(), argumentCount, arguments);
+    handlers.reserve(events.size());
+    for(auto & event : events)
     {
-      if (i->count > 0)
-        i->count--;
-      ProtectedArguments args(context->toJSContext(), argumentCount, arguments);
-      NX::Object func(i->handler);
-      auto task = context->nexus()->scheduler()->scheduleTask([=]() {
+      handlers.emplace_back([=]() {
         JSValueRef exp = nullptr;
-        func.call(nullptr, args, &exp);
+        event->invoke(context->toJSContext(), args->size(), *args, &exp);
         if (exp)
           NX::Nexus::ReportException(context->toJSContext(), exp);
       });
-      tasks.emplace_back(task);
     }
-    tidy(ctx, e);
+    if (exhausted)
+      tidy(ctx, e);
   }
-  return std::move(tasks);
+  return NX::TaskGroup(context->nexus()->scheduler(), std::move(handlers));
 }
 
 
-JSValueRef NX::Classes::Emitter::removeAllListeners (JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e)
+JSValueRef NX::Classes::Emitter::removeAllListeners (JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e)
 {
-  JSC::JSLockHolder lock(toJS(ctx));
-  myMap.erase(e);
+  update([&](Table & table) { table.erase(e.id()); });
   return JSValueMakeUndefined(ctx);
 }
 
-JSValueRef NX::Classes::Emitter::removeListener (JSGlobalContextRef ctx, JSObjectRef thisObject, const std::string & e, JSObjectRef callback)
+JSValueRef NX::Classes::Emitter::removeListener (JSGlobalContextRef ctx, JSObjectRef thisObject, const Atom & e, JSObjectRef callback)
 {
-  JSC::JSLockHolder lock(toJS(ctx));
-  auto item = myMap.find(e);
-  if (item != myMap.end()) {
-    item->second.erase(std::remove_if(item->second.begin(), item->second.end(), [&](auto & event) {
-      return JSValueIsStrictEqual(ctx, callback, event->handler);
-    }), item->second.end());
-  }
+  update([&](Table & table) {
+    auto item = table.find(e.id());
+    if (item != table.end()) {
+      item->second.remove_if([&](const std::shared_ptr<Event> & event) {
+        return !event->native && JSValueIsStrictEqual(ctx, callback, event->handler);
+      });
+      if (item->second.empty())
+        table.erase(item);
+    }
+  });
   return JSValueMakeUndefined(ctx);
 }
 
@@ -294,22 +364,13 @@ const JSStaticFunction NX::Classes::Emitter::Methods[] {
   { nullptr, nullptr, 0 }
 };
 
-void NX::Classes::Emitter::tidy(JSContextRef ctx, const std::string &e) {
-  JSC::JSLockHolder lock(toJS(ctx));
-  auto item = myMap.find(e);
-  if (item != myMap.end()) {
-    auto & vec = item->second;
-    std::vector<std::vector<std::shared_ptr<NX::Classes::Emitter::Event>>::iterator> toRemove;
-    for(auto i = vec.begin(); i != vec.end();)
-    {
-      if ((*i)->count == 0) {
-        toRemove.push_back(i);
-      }
-      i++;
+void NX::Classes::Emitter::tidy(JSContextRef ctx, const Atom & e) {
+  update([&](Table & table) {
+    auto item = table.find(e.id());
+    if (item != table.end()) {
+      item->second.remove_if([](const std::shared_ptr<Event> & event) { return event->count == 0; });
+      if (item->second.empty())
+        table.erase(item);
     }
-    for(auto & i : toRemove)
-      vec.erase(i);
-    if (vec.empty())
-      myMap.erase(item);
-  }
+  });
 }
@@ -333,6 +333,23 @@ JSStaticFunction NX::Classes::IO::PullSourceDevice::Methods[] {
               if (readLength == 0)
                 throw NX::Exception("must supply read length for non-seekable device");
             }
+            if (dev->deviceReady() && dev->deviceReadAsync(readLength,
+              [=](const boost::system::error_code & error, char * data, std::size_t size,
+                  JSTypedArrayBytesDeallocator deallocator, void * deallocatorContext) {
+                JSValueRef exp = nullptr;
+                if (error) {
+                  reject(context->toJSContext(), NX::Exception(error).toError(context->toJSContext()));
+                } else {
+                  JSObjectRef arrayBuffer = JSObjectMakeArrayBufferWithBytesNoCopy(context->toJSContext(), data, size,
+                                                                                   deallocator, deallocatorContext, &exp);
+                  if (exp)
+                    reject(context->toJSContext(), exp);
+                  else
+                    resolve(context->toJSContext(), arrayBuffer);
+                }
+                JSValueUnprotect(context->toJSContext(), thisObject);
+              }))
+              return;
             buffer = (char *)WTF::fastMalloc(readLength);
             if(!dev->deviceReady()) {
               return reject(context->toJSContext(), NX::Exception("device not ready").toError(context->toJSContext()));
@@ -469,6 +486,16 @@ JSStaticFunction NX::Classes::IO::SinkDevice::Methods[] {
         NX::Context * context = NX::Context::FromJsContext(ctx);
         auto writeHandler = [=](auto writeHandler, std::size_t written) {
           try {
+            if (!written && dev->deviceReady() && dev->deviceWriteAsync(buffer, length,
+              [=](const boost::system::error_code & error, std::size_t) {
+                if (error)
+                  reject(context->toJSContext(), NX::Exception(error).toError(context->toJSContext()));
+                else
+                  resolve(context->toJSContext(), JSValueMakeUndefined(context->toJSContext()));
+                JSValueUnprotect(context->toJSContext(), arrayBuffer);
+                JSValueUnprotect(context->toJSContext(), thisObject);
+              }))
+              return;
             while (written < length) {
               if (!dev->deviceReady() && dev->deviceOpen()) {
                 if (auto ec = dev->deviceError()) {
@@ -0,0 +1,385 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "util.h"
+#include "nexus.h"
+#include "scheduler.h"
+#include "classes/io/device.h"
+#include "classes/io/devices/async_file.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  typedef std::function<void(const boost::system::error_code &, std::size_t)> TransferHandler;
+
+  // io_uring lengths are 32 bit
+  const std::size_t MaxTransfer = 1 << 30;
+
+  boost::system::error_code lastError() {
+    return boost::system::error_code(errno, boost::system::system_category());
+  }
+
+  /**
+   * Keeps submitting until length bytes moved, the file ended, or the kernel reported an error.
+   */
+  void transfer(std::shared_ptr<NX::Classes::IO::Devices::AsyncFileHandle> file, bool write, char * data,
+                std::size_t length, std::uint64_t offset, int buffer, TransferHandler done, std::size_t transferred = 0)
+  {
+    auto next = [=](int result) {
+      if (result < 0)
+        return done(boost::system::error_code(-result, boost::system::system_category()), transferred);
+      const std::size_t total = transferred + static_cast<std::size_t>(result);
+      if (!result || total == length)
+        return done(boost::system::error_code(), total);
+      transfer(file, write, data, length, offset, buffer, done, total);
+    };
+    const std::size_t chunk = std::min(length - transferred, MaxTransfer);
+    if (write)
+      file->uring->write(file->fd, file->slot, data + transferred, chunk, offset + transferred, std::move(next));
+    else
+      file->uring->read(file->fd, file->slot, data + transferred, chunk, offset + transferred, buffer, std::move(next));
+  }
+
+  // hands a registered buffer back once JSC collects the ArrayBuffer over it
+  struct Lease {
+    std::shared_ptr<NX::Uring> uring;
+    int index;
+  };
+
+  void releaseLease(void *, void * context) {
+    auto lease = static_cast<Lease *>(context);
+    lease->uring->releaseBuffer(lease->index);
+    delete lease;
+  }
+
+  void releaseFastMalloc(void * bytes, void *) {
+    WTF::fastFree(bytes);
+  }
+
+  std::size_t seekTarget(std::size_t current, std::size_t size, std::size_t pos,
+                         NX::Classes::IO::Device::Position from)
+  {
+    switch (from) {
+      case NX::Classes::IO::Device::Current: return current + pos;
+      case NX::Classes::IO::Device::End: return size + pos;
+      default: return pos;
+    }
+  }
+}
+
+NX::Classes::IO::Devices::AsyncFileHandle::AsyncFileHandle(std::shared_ptr<NX::Uring> uring, int fd, bool fixed,
+                                                           bool close):
+  uring(std::move(uring)), fd(fd), slot(-1), close(close)
+{
+  if (fixed && this->uring->available())
+    slot = this->uring->registerFile(fd);
+}
+
+NX::Classes::IO::Devices::AsyncFileHandle::~AsyncFileHandle()
+{
+  uring->unregisterFile(slot);
+  if (close)
+    ::close(fd);
+}
+
+NX::Classes::IO::Devices::AsyncFilePullDevice::AsyncFilePullDevice(NX::Scheduler * scheduler, const std::string & path):
+  myUring(scheduler->uring()), myFile(), myFd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)), myOffset(0), mySize(0),
+  myError()
+{
+  if (myFd < 0)
+    throw NX::Exception("could not open file '" + path + "': " + std::strerror(errno));
+  myFile = std::make_shared<AsyncFileHandle>(myUring, myFd, true, true);
+  sourceSize();
+}
+
+std::size_t NX::Classes::IO::Devices::AsyncFilePullDevice::sourceSize()
+{
+  struct stat info;
+  if (myFd >= 0 && !fstat(myFd, &info))
+    mySize.store(static_cast<std::size_t>(info.st_size));
+  return mySize;
+}
+
+std::size_t NX::Classes::IO::Devices::AsyncFilePullDevice::deviceSeek(std::size_t pos, Position from)
+{
+  std::size_t target = seekTarget(myOffset, sourceSize(), pos, from);
+  myOffset.store(target);
+  return target;
+}
+
+void NX::Classes::IO::Devices::AsyncFilePullDevice::deviceClose()
+{
+  if (myFd < 0)
+    return;
+  myFd = -1;
+  // the descriptor goes once no transfer needs it any more
+  std::atomic_store(&myFile, std::shared_ptr<AsyncFileHandle>());
+}
+
+std::size_t NX::Classes::IO::Devices::AsyncFilePullDevice::deviceRead(char * dest, std::size_t length)
+{
+  std::size_t offset = myOffset;
+  while (!myOffset.compare_exchange_weak(offset, offset + length));
+  std::size_t done = 0;
+  while (done < length) {
+    ssize_t result = pread(myFd, dest + done, length - done, offset + done);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result < 0) {
+      myError = lastError();
+      break;
+    }
+    if (!result)
+      break;
+    done += static_cast<std::size_t>(result);
+  }
+  // whatever lay past the end wasn't read, a later read starts there
+  if (done < length) {
+    std::size_t expected = offset + length;
+    myOffset.compare_exchange_strong(expected, offset + done);
+  }
+  return done;
+}
+
+bool NX::Classes::IO::Devices::AsyncFilePullDevice::deviceReadAsync(std::size_t length, ReadCompletion completion)
+{
+  if (!myUring->available())
+    return false;
+  auto file = std::atomic_load(&myFile);
+  if (!file) {
+    completion(boost::asio::error::bad_descriptor, nullptr, 0, nullptr, nullptr);
+    return true;
+  }
+  // claim the range up front so concurrent reads queue up behind each other instead of overlapping
+  const std::size_t size = sourceSize();
+  std::size_t offset = myOffset, claimed;
+  do {
+    claimed = offset < size ? std::min(length, size - offset) : 0;
+  } while (!myOffset.compare_exchange_weak(offset, offset + claimed));
+  NX::Uring::Buffer fixed { nullptr, 0, -1 };
+  if (claimed && claimed <= NX::Uring::BufferSize)
+    fixed = myUring->acquireBuffer();
+  char * data;
+  JSTypedArrayBytesDeallocator deallocator;
+  void * deallocatorContext;
+  if (fixed.index >= 0) {
+    data = fixed.data;
+    deallocator = releaseLease;
+    deallocatorContext = new Lease { myUring, fixed.index };
+  } else {
+    data = static_cast<char *>(WTF::fastMalloc(std::max<std::size_t>(claimed, 1)));
+    deallocator = releaseFastMalloc;
+    deallocatorContext = nullptr;
+  }
+  if (!claimed) {
+    completion(boost::system::error_code(), data, 0, deallocator, deallocatorContext);
+    return true;
+  }
+  transfer(file, false, data, claimed, offset, fixed.index,
+    [=](const boost::system::error_code & error, std::size_t read) {
+      if (error) {
+        deallocator(data, deallocatorContext);
+        completion(error, nullptr, 0, nullptr, nullptr);
+      } else
+        completion(error, data, read, deallocator, deallocatorContext);
+    });
+  return true;
+}
+
+JSObjectRef NX::Classes::IO::Devices::AsyncFilePullDevice::Constructor(JSContextRef ctx, JSObjectRef constructor,
+                                                                      size_t argumentCount, const JSValueRef arguments[],
+                                                                      JSValueRef * exception)
+{
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  JSClassRef deviceClass = createClass(context);
+  try {
+    if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+      throw NX::Exception("argument must be a string path");
+    NX::Value path(ctx, arguments[0]);
+    return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+      new NX::Classes::IO::Devices::AsyncFilePullDevice(context->nexus()->scheduler(), path.toString())));
+  } catch (const std::exception & e) {
+    JSWrapException(ctx, e, exception);
+    return JSObjectMake(ctx, nullptr, nullptr);
+  }
+}
+
+JSClassRef NX::Classes::IO::Devices::AsyncFilePullDevice::createClass(NX::Context * context)
+{
+  JSClassDefinition def = NX::Classes::IO::Devices::AsyncFilePullDevice::Class;
+  def.parentClass = NX::Classes::IO::SeekableSourceDevice::createClass(context);
+  return context->nexus()->defineOrGetClass(def);
+}
+
+JSObjectRef NX::Classes::IO::Devices::AsyncFilePullDevice::getConstructor(NX::Context * context)
+{
+  return JSObjectMakeConstructor(context->toJSContext(), createClass(context),
+                                 NX::Classes::IO::Devices::AsyncFilePullDevice::Constructor);
+}
+
+const JSClassDefinition NX::Classes::IO::Devices::AsyncFilePullDevice::Class {
+  0, kJSClassAttributeNone, "AsyncFilePullDevice", nullptr, NX::Classes::IO::Devices::AsyncFilePullDevice::Properties,
+  NX::Classes::IO::Devices::AsyncFilePullDevice::Methods, nullptr, NX::Classes::IO::Devices::AsyncFilePullDevice::Finalize
+};
+
+const JSStaticValue NX::Classes::IO::Devices::AsyncFilePullDevice::Properties[] {
+  { nullptr, nullptr, nullptr, 0 }
+};
+
+const JSStaticFunction NX::Classes::IO::Devices::AsyncFilePullDevice::Methods[] {
+  { nullptr, nullptr, 0 }
+};
+
+
+NX::Classes::IO::Devices::AsyncFileSinkDevice::AsyncFileSinkDevice(NX::Scheduler * scheduler, const std::string & path):
+  myUring(), myFile(), myFd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)), myClose(true),
+  mySeekable(true), myOffset(0), myError()
+{
+  if (myFd < 0)
+    throw NX::Exception("could not open file '" + path + "': " + std::strerror(errno));
+  open(scheduler);
+}
+
+NX::Classes::IO::Devices::AsyncFileSinkDevice::AsyncFileSinkDevice(NX::Scheduler * scheduler, int fd, bool close):
+  myUring(), myFile(), myFd(fd), myClose(close), mySeekable(true), myOffset(0), myError()
+{
+  open(scheduler);
+}
+
+void NX::Classes::IO::Devices::AsyncFileSinkDevice::open(NX::Scheduler * scheduler)
+{
+  myUring = scheduler->uring();
+  // pipes and terminals have no offsets, those keep plain blocking writes
+  off_t position = lseek(myFd, 0, SEEK_CUR);
+  mySeekable = position >= 0;
+  myOffset = mySeekable ? static_cast<std::size_t>(position) : 0;
+  myFile = std::make_shared<AsyncFileHandle>(myUring, myFd, mySeekable, myClose);
+}
+
+std::size_t NX::Classes::IO::Devices::AsyncFileSinkDevice::deviceSeek(std::size_t pos, Position from)
+{
+  struct stat info;
+  std::size_t size = fstat(myFd, &info) ? 0 : static_cast<std::size_t>(info.st_size);
+  std::size_t target = seekTarget(myOffset, size, pos, from);
+  myOffset.store(target);
+  return target;
+}
+
+void NX::Classes::IO::Devices::AsyncFileSinkDevice::deviceClose()
+{
+  if (myFd < 0)
+    return;
+  myFd = -1;
+  // the descriptor goes once no transfer needs it any more
+  std::atomic_store(&myFile, std::shared_ptr<AsyncFileHandle>());
+}
+
+std::size_t NX::Classes::IO::Devices::AsyncFileSinkDevice::deviceWrite(const char * buffer, std::size_t length)
+{
+  if (!buffer || !length)
+    return 0;
+  const std::size_t offset = mySeekable ? myOffset.fetch_add(length) : 0;
+  std::size_t done = 0;
+  while (done < length) {
+    ssize_t result = mySeekable ? pwrite(myFd, buffer + done, length - done, offset + done)
+                                : ::write(myFd, buffer + done, length - done);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0) {
+      myError = result < 0 ? lastError() : boost::system::errc::make_error_code(boost::system::errc::io_error);
+      throw NX::Exception(myError);
+    }
+    done += static_cast<std::size_t>(result);
+  }
+  return done;
+}
+
+bool NX::Classes::IO::Devices::AsyncFileSinkDevice::deviceWriteAsync(const char * buffer, std::size_t length,
+                                                                     WriteCompletion completion)
+{
+  if (!mySeekable || !myUring->available())
+    return false;
+  auto file = std::atomic_load(&myFile);
+  if (!file) {
+    completion(boost::asio::error::bad_descriptor, 0);
+    return true;
+  }
+  const std::size_t offset = myOffset.fetch_add(length);
+  transfer(file, true, const_cast<char *>(buffer), length, offset, -1,
+    [=](const boost::system::error_code & error, std::size_t written) {
+      if (!error && written < length)
+        return completion(boost::system::errc::make_error_code(boost::system::errc::io_error), written);
+      completion(error, written);
+    });
+  return true;
+}
+
+JSObjectRef NX::Classes::IO::Devices::AsyncFileSinkDevice::Constructor(JSContextRef ctx, JSObjectRef constructor,
+                                                                      size_t argumentCount, const JSValueRef arguments[],
+                                                                      JSValueRef * exception)
+{
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  JSClassRef deviceClass = createClass(context);
+  try {
+    auto type = argumentCount ? JSValueGetType(ctx, arguments[0]) : kJSTypeUndefined;
+    if (type != kJSTypeString && type != kJSTypeNumber)
+      throw NX::Exception("argument must be a string path or file descriptor");
+    NX::Value pathOrFD(ctx, arguments[0]);
+    NX::Scheduler * scheduler = context->nexus()->scheduler();
+    if (type == kJSTypeString)
+      return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+        new NX::Classes::IO::Devices::AsyncFileSinkDevice(scheduler, pathOrFD.toString())));
+    return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+      new NX::Classes::IO::Devices::AsyncFileSinkDevice(scheduler, static_cast<int>(pathOrFD.toNumber()), false)));
+  } catch (const std::exception & e) {
+    JSWrapException(ctx, e, exception);
+    return JSObjectMake(ctx, nullptr, nullptr);
+  }
+}
+
+JSClassRef NX::Classes::IO::Devices::AsyncFileSinkDevice::createClass(NX::Context * context)
+{
+  JSClassDefinition def = NX::Classes::IO::Devices::AsyncFileSinkDevice::Class;
+  def.parentClass = NX::Classes::IO::SeekableSinkDevice::createClass(context);
+  return context->nexus()->defineOrGetClass(def);
+}
+
+JSObjectRef NX::Classes::IO::Devices::AsyncFileSinkDevice::getConstructor(NX::Context * context)
+{
+  return JSObjectMakeConstructor(context->toJSContext(), createClass(context),
+                                 NX::Classes::IO::Devices::AsyncFileSinkDevice::Constructor);
+}
+
+const JSClassDefinition NX::Classes::IO::Devices::AsyncFileSinkDevice::Class {
+  0, kJSClassAttributeNone, "AsyncFileSinkDevice", nullptr, NX::Classes::IO::Devices::AsyncFileSinkDevice::Properties,
+  NX::Classes::IO::Devices::AsyncFileSinkDevice::Methods, nullptr, NX::Classes::IO::Devices::AsyncFileSinkDevice::Finalize
+};
+
+const JSStaticValue NX::Classes::IO::Devices::AsyncFileSinkDevice::Properties[] {
+  { nullptr, nullptr, nullptr, 0 }
+};
+
+const JSStaticFunction NX::Classes::IO::Devices::AsyncFileSinkDevice::Methods[] {
+  { nullptr, nullptr, 0 }
+};
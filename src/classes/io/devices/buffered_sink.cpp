@@ -0,0 +1,488 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "util.h"
+#include "nexus.h"
+#include "scheduler.h"
+#include "buffer_pool.h"
+#include "globals/promise.h"
+#include "classes/io/device.h"
+#include "classes/io/devices/buffered_sink.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+  // writes below this are cheaper to copy than to keep their ArrayBuffer alive until the flush
+  const std::size_t CopyThreshold = 16 * 1024;
+}
+
+struct NX::Classes::IO::Devices::BufferedSinkDevice::State: public std::enable_shared_from_this<State> {
+  struct Segment {
+    const char * data;
+    std::size_t length;
+    char * pooled;
+    std::size_t capacity;
+    WriteCompletion completion;
+  };
+
+  State(NX::Scheduler * scheduler, JSContextRef ctx, JSObjectRef sinkObject, const Options & options):
+    scheduler(scheduler), sinkObject(ctx, sinkObject), sink(NX::Classes::IO::SinkDevice::FromObject(sinkObject)),
+    options(options), open(nullptr), openSize(0), openCapacity(0), queued(0),
+    flushArmed(false), syncArmed(false), dirty(false), closed(false), writes(0), flushes(0), syscalls(0), bytes(0)
+  {
+  }
+
+  ~State() {
+    boost::mutex::scoped_lock lock(mutex);
+    seal();
+    for (auto & segment : queue) {
+      if (segment.completion)
+        segment.completion(boost::asio::error::operation_aborted, 0);
+      NX::BufferPool::release(segment.pooled, segment.capacity);
+    }
+  }
+
+  // callers hold mutex
+  void seal() {
+    if (open && openSize)
+      queue.push_back(Segment { open, openSize, open, openCapacity, WriteCompletion() });
+    else if (open)
+      NX::BufferPool::release(open, openCapacity);
+    open = nullptr;
+    openSize = openCapacity = 0;
+  }
+
+  // callers hold mutex
+  void arm(bool & armed, unsigned milliseconds, void (State::*handler)()) {
+    if (armed || closed)
+      return;
+    armed = true;
+    std::weak_ptr<State> weak(shared_from_this());
+    scheduler->scheduleTask(boost::posix_time::milliseconds(milliseconds), [weak, handler]() {
+      if (auto state = weak.lock())
+        ((*state).*handler)();
+    });
+  }
+
+  void onFlushTimer() {
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      flushArmed = false;
+    }
+    flush();
+  }
+
+  void onSyncTimer() {
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      syncArmed = false;
+    }
+    sync();
+  }
+
+  void append(const char * data, std::size_t length, WriteCompletion completion, bool copy) {
+    bool full;
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      if (closed)
+        throw NX::Exception("device is closed");
+      if (error)
+        throw NX::Exception(error);
+      if (copy) {
+        if (!open || openCapacity - openSize < length) {
+          seal();
+          open = NX::BufferPool::acquire(std::max(length, options.flushSize), openCapacity);
+        }
+        std::memcpy(open + openSize, data, length);
+        openSize += length;
+      } else {
+        seal();
+        queue.push_back(Segment { data, length, nullptr, 0, std::move(completion) });
+      }
+      queued += length;
+      writes++;
+      full = queued >= options.flushSize;
+      if (!full)
+        arm(flushArmed, options.flushInterval, &State::onFlushTimer);
+    }
+    if (copy && completion)
+      completion(boost::system::error_code(), length);
+    if (full)
+      flush();
+  }
+
+  // asked for on every use, the sink may have been closed behind our back and its number reused
+  int descriptor() const {
+    return sink->deviceOpen() ? sink->deviceDescriptor() : -1;
+  }
+
+  boost::system::error_code writeDescriptor(int fd, std::vector<Segment> & segments) {
+    std::vector<iovec> iov;
+    iov.reserve(segments.size());
+    for (auto & segment : segments)
+      iov.push_back(iovec { const_cast<char *>(segment.data), segment.length });
+    std::size_t index = 0;
+    while (index < iov.size()) {
+      ssize_t ret = ::writev(fd, &iov[index], static_cast<int>(std::min<std::size_t>(iov.size() - index, IOV_MAX)));
+      syscalls++;
+      if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          // a socket someone put in non-blocking mode, wait for it the way a blocking write would
+          pollfd target { fd, POLLOUT, 0 };
+          ::poll(&target, 1, -1);
+        } else if (errno != EINTR)
+          return boost::system::error_code(errno, boost::system::system_category());
+        continue;
+      }
+      std::size_t written = static_cast<std::size_t>(ret);
+      while (index < iov.size() && written >= iov[index].iov_len)
+        written -= iov[index++].iov_len;
+      if (written) {
+        iov[index].iov_base = static_cast<char *>(iov[index].iov_base) + written;
+        iov[index].iov_len -= written;
+      }
+    }
+    return boost::system::error_code();
+  }
+
+  boost::system::error_code writeSink(std::vector<Segment> & segments) {
+    try {
+      const std::size_t max = std::max<std::size_t>(sink->maxWriteBufferSize(), 1);
+      for (auto & segment : segments) {
+        for (std::size_t written = 0; written < segment.length;) {
+          std::size_t ret = sink->deviceWrite(segment.data + written, std::min(segment.length - written, max));
+          syscalls++;
+          if (!ret)
+            return boost::system::errc::make_error_code(boost::system::errc::io_error);
+          written += ret;
+        }
+      }
+    } catch(const std::exception & e) {
+      if (auto ec = sink->deviceError())
+        return ec;
+      return boost::system::errc::make_error_code(boost::system::errc::io_error);
+    }
+    return boost::system::error_code();
+  }
+
+  void flush() {
+    std::vector<Segment> pending;
+    boost::system::error_code ec;
+    {
+      boost::mutex::scoped_lock flushLock(flushMutex);
+      {
+        boost::mutex::scoped_lock lock(mutex);
+        seal();
+        pending.swap(queue);
+        queued = 0;
+      }
+      if (pending.empty())
+        return;
+      const int fd = descriptor();
+      ec = fd >= 0 ? writeDescriptor(fd, pending) : writeSink(pending);
+      flushes++;
+      boost::mutex::scoped_lock lock(mutex);
+      if (ec)
+        error = ec;
+      else {
+        for (auto & segment : pending)
+          bytes += segment.length;
+        dirty = true;
+        if (options.durability == Periodic)
+          arm(syncArmed, options.syncInterval, &State::onSyncTimer);
+      }
+    }
+    // completions resolve promises, which may write again and flush on this thread
+    for (auto & segment : pending) {
+      if (segment.completion)
+        segment.completion(ec, ec ? 0 : segment.length);
+      NX::BufferPool::release(segment.pooled, segment.capacity);
+    }
+  }
+
+  void sync() {
+    flush();
+    boost::mutex::scoped_lock flushLock(flushMutex);
+    const int fd = descriptor();
+    if (fd < 0 || !dirty)
+      return;
+    int ret = ::fdatasync(fd);
+    syscalls++;
+    boost::mutex::scoped_lock lock(mutex);
+    if (ret)
+      error = boost::system::error_code(errno, boost::system::system_category());
+    else
+      dirty = false;
+  }
+
+  void close() {
+    {
+      // from here on writes are refused, what is queued still goes out
+      boost::mutex::scoped_lock lock(mutex);
+      if (closed)
+        return;
+      closed = true;
+    }
+    flush();
+    if (options.durability != None)
+      sync();
+    sink->deviceClose();
+  }
+
+  NX::Scheduler * scheduler;
+  NX::Object sinkObject;
+  NX::Classes::IO::SinkDevice * sink;
+  const Options options;
+
+  boost::mutex mutex;
+  // held across the actual write, so flushes leave in the order their data came in
+  boost::mutex flushMutex;
+  std::vector<Segment> queue;
+  char * open;
+  std::size_t openSize, openCapacity, queued;
+  bool flushArmed, syncArmed, dirty, closed;
+  boost::system::error_code error;
+  std::atomic_size_t writes, flushes, syscalls, bytes;
+};
+
+NX::Classes::IO::Devices::BufferedSinkDevice::BufferedSinkDevice(NX::Scheduler * scheduler, JSContextRef ctx,
+                                                                  JSObjectRef sink, const Options & options):
+  myState()
+{
+  if (!NX::Classes::IO::SinkDevice::FromObject(sink))
+    throw NX::Exception("argument must be a SinkDevice");
+  myState = std::make_shared<State>(scheduler, ctx, sink, options);
+  // fdatasync on anything but a file fails, and that would poison the device for good
+  struct stat info;
+  const int fd = myState->descriptor();
+  if (options.durability != None && (fd < 0 || fstat(fd, &info) || !S_ISREG(info.st_mode)))
+    throw NX::Exception("durability needs a sink backed by a regular file");
+}
+
+NX::Classes::IO::Devices::BufferedSinkDevice::~BufferedSinkDevice()
+{
+  try {
+    myState->flush();
+  } catch(...) {
+  }
+  boost::mutex::scoped_lock lock(myState->mutex);
+  myState->closed = true;
+}
+
+NX::Classes::IO::Devices::BufferedSinkDevice::Durability
+NX::Classes::IO::Devices::BufferedSinkDevice::durabilityFromString(const std::string & durability)
+{
+  if (boost::iequals(durability, "none"))
+    return None;
+  if (boost::iequals(durability, "close"))
+    return SyncOnClose;
+  if (boost::iequals(durability, "periodic"))
+    return Periodic;
+  throw NX::Exception("durability must be one of ['none','close','periodic']");
+}
+
+void NX::Classes::IO::Devices::BufferedSinkDevice::flush()
+{
+  myState->flush();
+}
+
+void NX::Classes::IO::Devices::BufferedSinkDevice::sync()
+{
+  myState->sync();
+}
+
+NX::Classes::IO::Devices::BufferedSinkDevice::Stats NX::Classes::IO::Devices::BufferedSinkDevice::stats() const
+{
+  return Stats { myState->writes, myState->flushes, myState->syscalls, myState->bytes };
+}
+
+bool NX::Classes::IO::Devices::BufferedSinkDevice::deviceReady() const
+{
+  return !myState->error && myState->sink->deviceReady();
+}
+
+bool NX::Classes::IO::Devices::BufferedSinkDevice::deviceOpen() const
+{
+  return myState->sink->deviceOpen();
+}
+
+void NX::Classes::IO::Devices::BufferedSinkDevice::deviceClose()
+{
+  myState->close();
+}
+
+const boost::system::error_code & NX::Classes::IO::Devices::BufferedSinkDevice::deviceError() const
+{
+  return myState->error ? myState->error : myState->sink->deviceError();
+}
+
+std::size_t NX::Classes::IO::Devices::BufferedSinkDevice::deviceWrite(const char * buffer, std::size_t length)
+{
+  if (!buffer) {
+    {
+      boost::mutex::scoped_lock lock(myState->mutex);
+      if (myState->closed)
+        throw NX::Exception("device is closed");
+    }
+    // the end of the stream, which the sink may need to see as well (a response sends its last chunk)
+    myState->flush();
+    if (myState->error)
+      throw NX::Exception(myState->error);
+    return myState->sink->deviceWrite(nullptr, 0);
+  }
+  if (length)
+    myState->append(buffer, length, WriteCompletion(), true);
+  return length;
+}
+
+bool NX::Classes::IO::Devices::BufferedSinkDevice::deviceWriteAsync(const char * buffer, std::size_t length,
+                                                                    WriteCompletion completion)
+{
+  myState->append(buffer, length, std::move(completion), length < CopyThreshold);
+  return true;
+}
+
+JSObjectRef NX::Classes::IO::Devices::BufferedSinkDevice::Constructor(JSContextRef ctx, JSObjectRef constructor,
+                                                                     size_t argumentCount,
+                                                                     const JSValueRef arguments[],
+                                                                     JSValueRef * exception)
+{
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  JSClassRef deviceClass = createClass(context);
+  try {
+    if (argumentCount < 1 || !JSValueIsObject(ctx, arguments[0]))
+      throw NX::Exception("argument must be a SinkDevice");
+    Options options;
+    if (argumentCount > 1 && JSValueIsObject(ctx, arguments[1])) {
+      NX::Object settings(ctx, arguments[1]);
+      auto number = [&](const char * name, double min) -> double {
+        auto value = settings[name];
+        if (JSValueIsUndefined(ctx, value->value()))
+          return -1;
+        if (JSValueGetType(ctx, value->value()) != kJSTypeNumber || value->toNumber() < min)
+          throw NX::Exception(std::string(name) + " must be a number no less than " + std::to_string(int(min)));
+        return value->toNumber();
+      };
+      double value;
+      if ((value = number("flushSize", 1)) >= 0)
+        options.flushSize = static_cast<std::size_t>(value);
+      if ((value = number("flushInterval", 1)) >= 0)
+        options.flushInterval = static_cast<unsigned>(value);
+      if ((value = number("syncInterval", 1)) >= 0)
+        options.syncInterval = static_cast<unsigned>(value);
+      auto durability = settings["durability"];
+      if (!JSValueIsUndefined(ctx, durability->value()))
+        options.durability = durabilityFromString(durability->toString());
+    }
+    JSObjectRef sink = JSValueToObject(ctx, arguments[0], exception);
+    return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+      new NX::Classes::IO::Devices::BufferedSinkDevice(context->nexus()->scheduler(), ctx, sink, options)));
+  } catch (const std::exception & e) {
+    JSWrapException(ctx, e, exception);
+    return JSObjectMake(ctx, nullptr, nullptr);
+  }
+}
+
+JSClassRef NX::Classes::IO::Devices::BufferedSinkDevice::createClass(NX::Context * context)
+{
+  JSClassDefinition def = NX::Classes::IO::Devices::BufferedSinkDevice::Class;
+  def.parentClass = NX::Classes::IO::SinkDevice::createClass(context);
+  return context->nexus()->defineOrGetClass(def);
+}
+
+JSObjectRef NX::Classes::IO::Devices::BufferedSinkDevice::getConstructor(NX::Context * context)
+{
+  return JSObjectMakeConstructor(context->toJSContext(), createClass(context),
+                                 NX::Classes::IO::Devices::BufferedSinkDevice::Constructor);
+}
+
+const JSClassDefinition NX::Classes::IO::Devices::BufferedSinkDevice::Class {
+  0, kJSClassAttributeNone, "BufferedSinkDevice", nullptr, NX::Classes::IO::Devices::BufferedSinkDevice::Properties,
+  NX::Classes::IO::Devices::BufferedSinkDevice::Methods, nullptr, NX::Classes::IO::Devices::BufferedSinkDevice::Finalize
+};
+
+const JSStaticValue NX::Classes::IO::Devices::BufferedSinkDevice::Properties[] {
+  { "stats", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
+      NX::Classes::IO::Devices::BufferedSinkDevice * dev = NX::Classes::IO::Devices::BufferedSinkDevice::FromObject(object);
+      if (!dev)
+        return JSValueMakeUndefined(ctx);
+      auto stats = dev->stats();
+      NX::Object result(ctx);
+      result.set("writes", JSValueMakeNumber(ctx, stats.writes));
+      result.set("flushes", JSValueMakeNumber(ctx, stats.flushes));
+      result.set("syscalls", JSValueMakeNumber(ctx, stats.syscalls));
+      result.set("bytes", JSValueMakeNumber(ctx, stats.bytes));
+      return result.value();
+    }, nullptr, kJSPropertyAttributeNone },
+  { nullptr, nullptr, nullptr, 0 }
+};
+
+namespace {
+  JSValueRef scheduleOnDevice(JSContextRef ctx, JSObjectRef thisObject,
+                              void (NX::Classes::IO::Devices::BufferedSinkDevice::*operation)())
+  {
+    NX::Classes::IO::Devices::BufferedSinkDevice * dev =
+      NX::Classes::IO::Devices::BufferedSinkDevice::FromObject(thisObject);
+    if (!dev)
+      return NX::Globals::Promise::reject(ctx, NX::Exception("invalid BufferedSinkDevice instance").toError(ctx));
+    NX::Context * context = NX::Context::FromJsContext(ctx);
+    NX::Object thisObj(ctx, thisObject);
+    NX::Scheduler * scheduler = context->nexus()->scheduler();
+    return NX::Globals::Promise::createPromise(ctx,
+      [=](JSContextRef ctx, NX::ResolveRejectHandler resolve, NX::ResolveRejectHandler reject) {
+        scheduler->scheduleTask([=]() {
+          try {
+            (dev->*operation)();
+            if (auto ec = dev->deviceError())
+              throw NX::Exception(ec);
+            resolve(context->toJSContext(), thisObj);
+          } catch(const std::exception & e) {
+            reject(context->toJSContext(), NX::Object(context->toJSContext(), e));
+          }
+        });
+      });
+  }
+}
+
+const JSStaticFunction NX::Classes::IO::Devices::BufferedSinkDevice::Methods[] {
+  { "flush", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      return scheduleOnDevice(ctx, thisObject, &NX::Classes::IO::Devices::BufferedSinkDevice::flush);
+    }, 0
+  },
+  { "sync", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      return scheduleOnDevice(ctx, thisObject, &NX::Classes::IO::Devices::BufferedSinkDevice::sync);
+    }, 0
+  },
+  { nullptr, nullptr, 0 }
+};
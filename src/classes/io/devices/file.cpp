@@ -21,9 +21,19 @@
 #include "nexus.h"
 #include "classes/io/device.h"
 #include "classes/io/devices/file.h"
+#include "buffer_pool.h"
+#include "scheduler.h"
 
 #include <boost/filesystem.hpp>
 
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 NX::Classes::IO::Devices::FilePullDevice::FilePullDevice (const std::string & path): myStream(path, std::ifstream::in | std::ifstream::binary) {
   if (!boost::filesystem::exists(path))
     throw NX::Exception("file '" + path + "' not found");
@@ -73,10 +83,57 @@ const JSStaticFunction NX::Classes::IO::Devices::FilePullDevice::Methods[] {
 
 
 const JSStaticValue NX::Classes::IO::Devices::FilePushDevice::Properties[] {
+  { "chunkSize", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
+      NX::Classes::IO::Devices::FilePushDevice * dev = NX::Classes::IO::Devices::FilePushDevice::FromObject(object);
+      return JSValueMakeNumber(ctx, dev ? dev->chunkSize() : 0);
+    }, [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef value,
+          JSValueRef* exception) -> bool {
+      try {
+        NX::Classes::IO::Devices::FilePushDevice * dev = NX::Classes::IO::Devices::FilePushDevice::FromObject(object);
+        if (!dev)
+          throw NX::Exception("invalid FilePushDevice instance");
+        if (JSValueGetType(ctx, value) != kJSTypeNumber || NX::Value(ctx, value).toNumber() < 0)
+          throw NX::Exception("chunk size must be a positive number, or 0 to adapt it");
+        dev->chunkSize(static_cast<std::size_t>(NX::Value(ctx, value).toNumber()));
+      } catch(const std::exception & e) {
+        JSWrapException(ctx, e, exception);
+      }
+      return true;
+    }, kJSPropertyAttributeNone },
+  { "follow", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
+      NX::Classes::IO::Devices::FilePushDevice * dev = NX::Classes::IO::Devices::FilePushDevice::FromObject(object);
+      return JSValueMakeBoolean(ctx, dev && dev->follow());
+    }, [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef value,
+          JSValueRef* exception) -> bool {
+      if (NX::Classes::IO::Devices::FilePushDevice * dev = NX::Classes::IO::Devices::FilePushDevice::FromObject(object))
+        dev->follow(JSValueToBoolean(ctx, value));
+      else
+        JSWrapException(ctx, NX::Exception("invalid FilePushDevice instance"), exception);
+      return true;
+    }, kJSPropertyAttributeNone },
   { nullptr, nullptr, nullptr, 0 }
 };
 
 const JSStaticFunction NX::Classes::IO::Devices::FilePushDevice::Methods[] {
+  { "spliceTo", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      try {
+        NX::Classes::IO::Devices::FilePushDevice * dev = NX::Classes::IO::Devices::FilePushDevice::FromObject(thisObject);
+        if (!dev)
+          throw NX::Exception("invalid FilePushDevice instance");
+        JSObjectRef sink = nullptr;
+        if (argumentCount > 0 && JSValueIsObject(ctx, arguments[0])) {
+          sink = JSValueToObject(ctx, arguments[0], exception);
+          if (!NX::Classes::IO::SinkDevice::FromObject(sink))
+            sink = nullptr;
+        }
+        dev->spliceTo(ctx, sink);
+        return JSValueMakeBoolean(ctx, sink != nullptr && !dev->follow());
+      } catch(const std::exception & e) {
+        return JSWrapException(ctx, e, exception);
+      }
+    }, 0
+  },
   { nullptr, nullptr, 0 }
 };
 
@@ -140,8 +197,181 @@ JSObjectRef NX::Classes::IO::Devices::FileSinkDevice::getConstructor (NX::Contex
 }
 
 NX::Classes::IO::Devices::FilePushDevice::FilePushDevice (NX::Scheduler * scheduler, const std::string & path) :
-  myScheduler(scheduler), myPath(path), myState(Paused), myTask(nullptr), myStream(path, std::ios_base::in | std::ios_base::binary), myPromise()
+  myScheduler(scheduler), myPath(path), myState(Paused), myTask(nullptr), myStream(path, std::ios_base::in | std::ios_base::binary), myPromise(),
+  mySpliceTarget(), mySink(nullptr), mySize(0), myChunkSize(0), myAdaptiveChunkSize(MinChunkSize), myFollow(false),
+  myFollowMutex(), myFollowHandler(), myFollowWatch(0), myFollowPosition(0), myFollowInode(0)
+{
+}
+
+NX::Classes::IO::Devices::FilePushDevice::~FilePushDevice()
+{
+  NX::FileWatcher::Handle watch;
+  {
+    std::lock_guard<std::mutex> lock(myFollowMutex);
+    myFollowHandler = FollowHandler();
+    watch = myFollowWatch;
+    myFollowWatch = 0;
+  }
+  if (watch)
+    myScheduler->fileWatcher()->unwatch(watch);
+  myStream.close();
+}
+
+constexpr std::size_t NX::Classes::IO::Devices::FilePushDevice::MinChunkSize;
+constexpr std::size_t NX::Classes::IO::Devices::FilePushDevice::MaxChunkSize;
+
+std::size_t NX::Classes::IO::Devices::FilePushDevice::nextChunkSize()
+{
+  std::size_t size = myChunkSize ? myChunkSize.load() : myAdaptiveChunkSize.load();
+  // a small file, or the tail of a large one, doesn't need a whole chunk
+  std::streamoff position = myStream.tellg();
+  if (mySize && position >= 0 && static_cast<std::size_t>(position) < mySize)
+    size = std::min(size, mySize - static_cast<std::size_t>(position));
+  return size;
+}
+
+void NX::Classes::IO::Devices::FilePushDevice::adaptChunkSize(std::chrono::steady_clock::duration consumed)
 {
+  // a consumer that keeps up is paying mostly per-chunk overhead, a slow one leaves big chunks sitting in memory
+  std::size_t size = myAdaptiveChunkSize;
+  if (consumed < std::chrono::milliseconds(2))
+    size = std::min(size * 2, MaxChunkSize);
+  else if (consumed > std::chrono::milliseconds(20))
+    size = std::max(size / 2, MinChunkSize);
+  myAdaptiveChunkSize.store(size);
+}
+
+void NX::Classes::IO::Devices::FilePushDevice::spliceTo(JSContextRef ctx, JSObjectRef sink)
+{
+  if (sink) {
+    mySpliceTarget = NX::Object(ctx, sink);
+    mySink = NX::Classes::IO::SinkDevice::FromObject(sink);
+  } else {
+    mySink = nullptr;
+    mySpliceTarget.clear();
+  }
+}
+
+bool NX::Classes::IO::Devices::FilePushDevice::splice(NX::Classes::IO::SinkDevice * sink, SpliceCompletion completion)
+{
+  // sendfile wants a descriptor of its own, the stream only tells it where to start
+  int fd = ::open(myPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  std::streamoff position = myStream.tellg();
+  if (fstat(fd, &info) || !S_ISREG(info.st_mode) || position < 0 || position > info.st_size) {
+    ::close(fd);
+    return false;
+  }
+  bool started = false;
+  try {
+    started = sink->deviceTransferFrom(fd, static_cast<std::size_t>(position),
+                                       static_cast<std::size_t>(info.st_size - position),
+      [=](const boost::system::error_code & error, std::size_t) {
+        ::close(fd);
+        if (!error) {
+          myStream.seekg(0, std::ios_base::end);
+          myStream.peek();
+        }
+        completion(error);
+      });
+  } catch(...) {
+    ::close(fd);
+    throw;
+  }
+  if (!started)
+    ::close(fd);
+  return started;
+}
+
+void NX::Classes::IO::Devices::FilePushDevice::awaitGrowth(FollowHandler handler)
+{
+  myStream.clear();
+  std::streamoff position = myStream.tellg();
+  struct stat info;
+  {
+    std::lock_guard<std::mutex> lock(myFollowMutex);
+    myFollowPosition = std::max<std::streamoff>(position, 0);
+    myFollowInode = ::stat(myPath.c_str(), &info) ? 0 : info.st_ino;
+    myFollowHandler = handler;
+  }
+  NX::FileWatcher::Handle watch;
+  try {
+    // IN_ATTRIB is how an unlink shows up while the file is still open here
+    watch = myScheduler->fileWatcher()->watch(myPath, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF,
+                                              [this](const NX::FileWatcher::Event &) { checkGrowth(); });
+  } catch(const std::exception &) {
+    // no inotify, or out of watches: look every now and then instead
+    if (myState != Resumed)
+      settleFollow(Cancelled);
+    else
+      pollGrowth(std::move(handler));
+    return;
+  }
+  bool settled;
+  {
+    std::lock_guard<std::mutex> lock(myFollowMutex);
+    settled = !myFollowHandler;
+    if (!settled)
+      myFollowWatch = watch;
+  }
+  if (settled)
+    myScheduler->fileWatcher()->unwatch(watch);
+  // a pause that came in before the handler was set had nothing to cancel
+  else if (myState != Resumed)
+    settleFollow(Cancelled);
+  else
+    // it may well have grown before the watch went up
+    checkGrowth();
+}
+
+bool NX::Classes::IO::Devices::FilePushDevice::checkGrowth()
+{
+  std::streamoff position;
+  ino_t inode;
+  {
+    std::lock_guard<std::mutex> lock(myFollowMutex);
+    if (!myFollowHandler)
+      return true;
+    position = myFollowPosition;
+    inode = myFollowInode;
+  }
+  struct stat info;
+  if (::stat(myPath.c_str(), &info) || info.st_ino != inode)
+    settleFollow(Gone);
+  else if (info.st_size != position)
+    settleFollow(Grew);
+  else
+    return false;
+  return true;
+}
+
+void NX::Classes::IO::Devices::FilePushDevice::pollGrowth(FollowHandler keep)
+{
+  // the handler keeps the JS object, and so this device, alive until the poll is over
+  myScheduler->scheduleTask(boost::posix_time::milliseconds(250), [this, keep]() {
+    if (!checkGrowth())
+      pollGrowth(keep);
+  });
+}
+
+void NX::Classes::IO::Devices::FilePushDevice::settleFollow(FollowResult result)
+{
+  FollowHandler handler;
+  NX::FileWatcher::Handle watch;
+  {
+    std::lock_guard<std::mutex> lock(myFollowMutex);
+    handler = std::move(myFollowHandler);
+    myFollowHandler = FollowHandler();
+    watch = myFollowWatch;
+    myFollowWatch = 0;
+  }
+  if (!handler)
+    return;
+  if (watch)
+    myScheduler->fileWatcher()->unwatch(watch);
+  myScheduler->scheduleTask([handler, result]() { handler(result); });
 }
 
 JSObjectRef NX::Classes::IO::Devices::FilePushDevice::resume (JSContextRef ctx, JSObjectRef thisObject)
@@ -152,6 +382,9 @@ JSObjectRef NX::Classes::IO::Devices::FilePushDevice::resume (JSContextRef ctx,
     if (!myStream.is_open()) {
       myStream.open(myPath, std::ios_base::in | std::ios_base::binary);
     }
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(myPath, ec);
+    mySize = ec ? 0 : static_cast<std::size_t>(size);
     myState = Resumed;
     NX::Object thisObj(context->toJSContext(), thisObject);
     myPromise = NX::Object(context->toJSContext(), NX::Globals::Promise::createPromise(context->toJSContext(),
@@ -159,58 +392,84 @@ JSObjectRef NX::Classes::IO::Devices::FilePushDevice::resume (JSContextRef ctx,
       {
         NX::Context * context = NX::Context::FromJsContext(ctx);
         auto readHandler = [=](auto readHandler) {
+          auto follow = [=]() {
+            awaitGrowth([=](FollowResult result) {
+              if (result == Grew) {
+                myStream.clear();
+                boost::system::error_code ec;
+                auto size = boost::filesystem::file_size(myPath, ec);
+                mySize = ec ? 0 : static_cast<std::size_t>(size);
+                // truncated, as logs are on rotation; start over
+                if (!ec && myStream.tellg() > static_cast<std::streamoff>(size))
+                  myStream.seekg(0, std::ios_base::beg);
+                myScheduler->scheduleTask(std::bind<void>(readHandler, readHandler));
+              } else {
+                // a cancelled wait was paused already, and may have been resumed again since
+                if (result == Gone) {
+                  myState = Paused;
+                  emitFast(context->toJSContext(), thisObj, Atom::End, 0, nullptr, nullptr);
+                }
+                resolve(context->toJSContext(), thisObj);
+              }
+            });
+          };
           if (myState == Resumed) {
             try {
-              auto buffer = (char *) WTF::fastMalloc(FILE_PUSH_DEVICE_BUFFER_SIZE);
-              auto sizeOut = static_cast<size_t>(myStream.readsome(buffer, FILE_PUSH_DEVICE_BUFFER_SIZE));
+              // the pool rounds up, but a chunk is what was asked for and no more
+              const std::size_t requested = nextChunkSize();
+              std::size_t capacity;
+              auto buffer = NX::BufferPool::acquire(requested, capacity);
+              auto sizeOut = static_cast<size_t>(myStream.readsome(buffer, requested));
               if (!sizeOut) {
-                myStream.read(buffer, FILE_PUSH_DEVICE_BUFFER_SIZE);
+                myStream.read(buffer, requested);
                 sizeOut = static_cast<size_t>(myStream.gcount());
               }
               if (sizeOut) {
-                if (sizeOut < FILE_PUSH_DEVICE_BUFFER_SIZE)
-                  buffer = static_cast<char *>(WTF::fastRealloc(buffer, sizeOut));
                 JSValueRef exp = nullptr;
                 JSObjectRef arrayBuffer = JSObjectMakeArrayBufferWithBytesNoCopy(
-                  context->toJSContext(), buffer, sizeOut,
-                  [](void *ptr, void *) {
-                    WTF::fastFree(ptr);
-                  }, this, &exp);
+                  context->toJSContext(), buffer, sizeOut, NX::BufferPool::deallocate,
+                  NX::BufferPool::context(capacity), &exp);
                 if (exp) {
                   myState = Paused;
-                  WTF::fastFree(buffer);
+                  NX::BufferPool::release(buffer, capacity);
                   reject(context->toJSContext(), exp);
                   return;
                 }
+                const auto emitted = std::chrono::steady_clock::now();
                 JSValueRef args[]{arrayBuffer};
-                NX::Object(context->toJSContext(), this->emit(context->toJSContext(), thisObj, "data", 1, args, &exp))
+                NX::Object(context->toJSContext(), this->emit(context->toJSContext(), thisObj, Atom::Data, 1, args, &exp))
                   .then([=](JSContextRef ctx, JSValueRef arg, JSValueRef *exception) {
+                    adaptChunkSize(std::chrono::steady_clock::now() - emitted);
                     if (!myStream.eof()) {
                       myScheduler->scheduleTask(std::move(std::bind<void>(readHandler, readHandler)));
+                    } else if (myFollow) {
+                      follow();
                     } else {
-                      emitFast(context->toJSContext(), thisObj, "end", 0, nullptr, nullptr);
+                      emitFast(context->toJSContext(), thisObj, Atom::End, 0, nullptr, nullptr);
                       resolve(ctx, thisObj);
                     }
                     return arg;
                   }, [=](JSContextRef ctx, JSValueRef arg, JSValueRef *exception) {
                     myState = Paused;
                     JSValueRef args[] { arg };
-                    emitFast(context->toJSContext(), thisObj, "error", 1, args, nullptr);
+                    emitFast(context->toJSContext(), thisObj, Atom::Error, 1, args, nullptr);
                     reject(ctx, arg);
                     return arg;
                   });
                 if (exp) {
                   myState = Paused;
                   JSValueRef args[] { exp };
-                  emitFast(context->toJSContext(), thisObj, "error", 1, args, nullptr);
+                  emitFast(context->toJSContext(), thisObj, Atom::Error, 1, args, nullptr);
                   reject(context->toJSContext(), exp);
                   return;
                 }
               } else {
-                WTF::fastFree(buffer);
-                if (myStream.eof()) {
+                NX::BufferPool::release(buffer, capacity);
+                if (myStream.eof() && myFollow) {
+                  follow();
+                } else if (myStream.eof()) {
                   myState = Paused;
-                  this->emitFast(context->toJSContext(), thisObj, "end", 0, nullptr, nullptr);
+                  this->emitFast(context->toJSContext(), thisObj, Atom::End, 0, nullptr, nullptr);
                   resolve(context->toJSContext(), thisObj);
                   return;
                 } else {
@@ -223,7 +482,33 @@ JSObjectRef NX::Classes::IO::Devices::FilePushDevice::resume (JSContextRef ctx,
           } else
             myScheduler->scheduleTask(std::bind<void>(readHandler, readHandler));
         };
-        myScheduler->scheduleTask(std::bind(readHandler, readHandler));
+        // sendfile stops at the end the file has now, following has to read
+        if (auto sink = myFollow ? nullptr : mySink) {
+          NX::Object target = mySpliceTarget;
+          myScheduler->scheduleTask([=]() {
+            try {
+              bool started = splice(sink, [=](const boost::system::error_code & error) {
+                myState = Paused;
+                if (error) {
+                  JSValueRef args[] { NX::Exception(error).toError(context->toJSContext()) };
+                  emitFast(context->toJSContext(), thisObj, Atom::Error, 1, args, nullptr);
+                  reject(context->toJSContext(), args[0]);
+                } else {
+                  emitFast(context->toJSContext(), thisObj, Atom::End, 0, nullptr, nullptr);
+                  resolve(context->toJSContext(), thisObj);
+                }
+                // the sink only has to outlive the transfer
+                (void)target;
+              });
+              if (!started)
+                myScheduler->scheduleTask(std::bind(readHandler, readHandler));
+            } catch(const std::exception &e) {
+              myState = Paused;
+              reject(context->toJSContext(), NX::Object(context->toJSContext(), e));
+            }
+          });
+        } else
+          myScheduler->scheduleTask(std::bind(readHandler, readHandler));
         return JSValueMakeUndefined(ctx);
     }));
   }
@@ -243,3 +528,343 @@ const JSStaticValue NX::Classes::IO::Devices::FileSinkDevice::Properties[] {
 const JSStaticFunction NX::Classes::IO::Devices::FileSinkDevice::Methods[] {
   { nullptr, nullptr, 0 }
 };
+
+NX::Classes::IO::Devices::BidirectionalFileDevice::BidirectionalFileDevice(const std::string & path):
+  myFd(-1), myClose(true), myReadOffset(0), myWriteOffset(0), myError()
+{
+  // no O_TRUNC, this is for updating files in place
+  myFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (myFd < 0)
+    throw NX::Exception("could not open file '" + path + "': " + std::strerror(errno));
+}
+
+NX::Classes::IO::Devices::BidirectionalFileDevice::BidirectionalFileDevice(int fd, bool close):
+  myFd(fd), myClose(close), myReadOffset(0), myWriteOffset(0), myError()
+{
+}
+
+void NX::Classes::IO::Devices::BidirectionalFileDevice::deviceClose()
+{
+  if (myFd >= 0 && myClose)
+    ::close(myFd);
+  myFd = -1;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::size() const
+{
+  struct stat info;
+  if (myFd < 0 || fstat(myFd, &info))
+    return 0;
+  return static_cast<std::size_t>(info.st_size);
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::transfer(bool write, char * data, std::size_t offset,
+                                                                       std::size_t length,
+                                                                       boost::system::error_code & error)
+{
+  std::size_t total = 0;
+  while (total < length) {
+    ssize_t result = write ?
+      ::pwrite(myFd, data + total, length - total, static_cast<off_t>(offset + total)) :
+      ::pread(myFd, data + total, length - total, static_cast<off_t>(offset + total));
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      error = boost::system::error_code(errno, boost::system::system_category());
+      break;
+    }
+    // a short read means the end of the file
+    if (!result)
+      break;
+    total += static_cast<std::size_t>(result);
+  }
+  return total;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::readAt(char * dest, std::size_t offset,
+                                                                     std::size_t length)
+{
+  boost::system::error_code error;
+  std::size_t read = transfer(false, dest, offset, length, error);
+  if (error)
+    throw NX::Exception(error);
+  return read;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::writeAt(const char * source, std::size_t offset,
+                                                                      std::size_t length)
+{
+  boost::system::error_code error;
+  std::size_t written = transfer(true, const_cast<char *>(source), offset, length, error);
+  if (error)
+    throw NX::Exception(error);
+  return written;
+}
+
+void NX::Classes::IO::Devices::BidirectionalFileDevice::allocate(std::size_t offset, std::size_t length)
+{
+  if (!length)
+    return;
+  if (!::fallocate(myFd, 0, static_cast<off_t>(offset), static_cast<off_t>(length)))
+    return;
+  int error = errno;
+  // filesystems without fallocate get glibc's emulation
+  if (error == EOPNOTSUPP)
+    error = ::posix_fallocate(myFd, static_cast<off_t>(offset), static_cast<off_t>(length));
+  if (error)
+    throw NX::Exception(boost::system::error_code(error, boost::system::system_category()));
+}
+
+void NX::Classes::IO::Devices::BidirectionalFileDevice::syncRange(std::size_t offset, std::size_t length)
+{
+  int result = length ?
+    ::sync_file_range(myFd, static_cast<off64_t>(offset), static_cast<off64_t>(length),
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) :
+    ::fdatasync(myFd);
+  if (result)
+    throw NX::Exception(boost::system::error_code(errno, boost::system::system_category()));
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::claim(std::size_t length, std::size_t & offset)
+{
+  const std::size_t end = size();
+  std::size_t claimed;
+  offset = myReadOffset;
+  do {
+    claimed = offset < end ? std::min(length, end - offset) : 0;
+  } while (!myReadOffset.compare_exchange_weak(offset, offset + claimed));
+  return claimed;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::deviceRead(char * dest, std::size_t length)
+{
+  std::size_t offset;
+  std::size_t claimed = claim(length, offset);
+  boost::system::error_code error;
+  std::size_t read = transfer(false, dest, offset, claimed, error);
+  if (error)
+    throw NX::Exception(error);
+  return read;
+}
+
+bool NX::Classes::IO::Devices::BidirectionalFileDevice::deviceReadAsync(std::size_t length, ReadCompletion completion)
+{
+  std::size_t offset, capacity;
+  std::size_t claimed = claim(length, offset);
+  char * buffer = NX::BufferPool::acquire(claimed, capacity);
+  boost::system::error_code error;
+  std::size_t read = transfer(false, buffer, offset, claimed, error);
+  if (error) {
+    NX::BufferPool::release(buffer, capacity);
+    completion(error, nullptr, 0, nullptr, nullptr);
+    return true;
+  }
+  completion(error, buffer, read, NX::BufferPool::deallocate, NX::BufferPool::context(capacity));
+  return true;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::deviceWrite(const char * buffer, std::size_t length)
+{
+  if (!buffer || !length)
+    return 0;
+  // every write gets its own range, so two of them in flight never land on top of each other
+  std::size_t offset = myWriteOffset.fetch_add(length);
+  boost::system::error_code error;
+  std::size_t written = transfer(true, const_cast<char *>(buffer), offset, length, error);
+  if (error)
+    throw NX::Exception(error);
+  return written;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::deviceReadSeek(std::size_t pos, Position from)
+{
+  std::size_t target = from == Current ? myReadOffset + pos : from == End ? size() + pos : pos;
+  myReadOffset.store(target);
+  return target;
+}
+
+std::size_t NX::Classes::IO::Devices::BidirectionalFileDevice::deviceWriteSeek(std::size_t pos, Position from)
+{
+  std::size_t target = from == Current ? myWriteOffset + pos : from == End ? size() + pos : pos;
+  myWriteOffset.store(target);
+  return target;
+}
+
+JSObjectRef NX::Classes::IO::Devices::BidirectionalFileDevice::Constructor(JSContextRef ctx, JSObjectRef constructor,
+                                                                          size_t argumentCount,
+                                                                          const JSValueRef arguments[],
+                                                                          JSValueRef * exception)
+{
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  JSClassRef deviceClass = createClass(context);
+  try {
+    auto type = argumentCount ? JSValueGetType(ctx, arguments[0]) : kJSTypeUndefined;
+    if (type != kJSTypeString && type != kJSTypeNumber)
+      throw NX::Exception("argument must be a string path or file descriptor");
+    NX::Value pathOrFD(ctx, arguments[0]);
+    if (type == kJSTypeString)
+      return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+        new NX::Classes::IO::Devices::BidirectionalFileDevice(pathOrFD.toString())));
+    return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+      new NX::Classes::IO::Devices::BidirectionalFileDevice(static_cast<int>(pathOrFD.toNumber()), false)));
+  } catch (const std::exception & e) {
+    JSWrapException(ctx, e, exception);
+    return JSObjectMake(ctx, nullptr, nullptr);
+  }
+}
+
+JSClassRef NX::Classes::IO::Devices::BidirectionalFileDevice::createClass(NX::Context * context)
+{
+  JSClassDefinition def = NX::Classes::IO::Devices::BidirectionalFileDevice::Class;
+  def.parentClass = NX::Classes::IO::BidirectionalDualSeekableDevice::createClass(context);
+  return context->nexus()->defineOrGetClass(def);
+}
+
+JSObjectRef NX::Classes::IO::Devices::BidirectionalFileDevice::getConstructor(NX::Context * context)
+{
+  return JSObjectMakeConstructor(context->toJSContext(), createClass(context),
+                                 NX::Classes::IO::Devices::BidirectionalFileDevice::Constructor);
+}
+
+const JSClassDefinition NX::Classes::IO::Devices::BidirectionalFileDevice::Class {
+  0, kJSClassAttributeNone, "BidirectionalFileDevice", nullptr,
+  NX::Classes::IO::Devices::BidirectionalFileDevice::Properties,
+  NX::Classes::IO::Devices::BidirectionalFileDevice::Methods, nullptr,
+  NX::Classes::IO::Devices::BidirectionalFileDevice::Finalize
+};
+
+const JSStaticValue NX::Classes::IO::Devices::BidirectionalFileDevice::Properties[] {
+  { "size", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
+      auto dev = NX::Classes::IO::Devices::BidirectionalFileDevice::FromObject(object);
+      return JSValueMakeNumber(ctx, dev ? dev->size() : 0);
+    }, nullptr, kJSPropertyAttributeNone },
+  { nullptr, nullptr, nullptr, 0 }
+};
+
+namespace {
+  typedef std::function<JSValueRef(JSContextRef, NX::Classes::IO::Devices::BidirectionalFileDevice *)> FileOperation;
+
+  // runs the operation on a worker and settles the promise with its result
+  JSValueRef scheduleOnFile(JSContextRef ctx, JSObjectRef thisObject, const JSValueRef arguments[],
+                            std::size_t argumentCount, std::size_t numbers, FileOperation operation)
+  {
+    auto dev = NX::Classes::IO::Devices::BidirectionalFileDevice::FromObject(thisObject);
+    if (!dev)
+      return NX::Globals::Promise::reject(ctx,
+                                          NX::Exception("invalid BidirectionalFileDevice instance").toError(ctx));
+    for (std::size_t i = 0; i < numbers && i < argumentCount; i++)
+      if (JSValueGetType(ctx, arguments[i]) != kJSTypeNumber)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("offset and length must be numbers").toError(ctx));
+    NX::Context * context = NX::Context::FromJsContext(ctx);
+    NX::Object thisObj(ctx, thisObject);
+    NX::Scheduler * scheduler = context->nexus()->scheduler();
+    return NX::Globals::Promise::createPromise(ctx,
+      [=](JSContextRef ctx, NX::ResolveRejectHandler resolve, NX::ResolveRejectHandler reject) {
+        scheduler->scheduleTask([=]() {
+          try {
+            if (!dev->deviceOpen())
+              throw NX::Exception("device is closed");
+            resolve(context->toJSContext(), operation(context->toJSContext(), dev));
+          } catch(const std::exception & e) {
+            reject(context->toJSContext(), NX::Object(context->toJSContext(), e));
+          }
+          // keeps the device alive until the task is done with it
+          (void)thisObj;
+        });
+      });
+  }
+
+  std::size_t numberArgument(JSContextRef ctx, const JSValueRef arguments[], std::size_t argumentCount,
+                             std::size_t index, std::size_t fallback)
+  {
+    if (index >= argumentCount || JSValueIsUndefined(ctx, arguments[index]))
+      return fallback;
+    return static_cast<std::size_t>(NX::Value(ctx, arguments[index]).toNumber());
+  }
+}
+
+const JSStaticFunction NX::Classes::IO::Devices::BidirectionalFileDevice::Methods[] {
+  { "readAt", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      if (argumentCount < 2)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("must supply offset and length").toError(ctx));
+      std::size_t offset = numberArgument(ctx, arguments, argumentCount, 0, 0);
+      std::size_t length = numberArgument(ctx, arguments, argumentCount, 1, 0);
+      return scheduleOnFile(ctx, thisObject, arguments, argumentCount, 2,
+        [=](JSContextRef ctx, NX::Classes::IO::Devices::BidirectionalFileDevice * dev) -> JSValueRef {
+          std::size_t capacity;
+          char * buffer = NX::BufferPool::acquire(length, capacity);
+          std::size_t read;
+          try {
+            read = dev->readAt(buffer, offset, length);
+          } catch(...) {
+            NX::BufferPool::release(buffer, capacity);
+            throw;
+          }
+          JSValueRef exp = nullptr;
+          JSObjectRef arrayBuffer = JSObjectMakeArrayBufferWithBytesNoCopy(ctx, buffer, read,
+                                                                           NX::BufferPool::deallocate,
+                                                                           NX::BufferPool::context(capacity), &exp);
+          if (exp) {
+            NX::BufferPool::release(buffer, capacity);
+            throw NX::Exception(ctx, exp);
+          }
+          return arrayBuffer;
+        });
+    }, 0
+  },
+  { "writeAt", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      if (argumentCount < 2 || JSValueGetType(ctx, arguments[1]) != kJSTypeObject)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("must supply offset and buffer").toError(ctx));
+      std::size_t offset = numberArgument(ctx, arguments, argumentCount, 0, 0);
+      JSValueRef except = nullptr;
+      JSObjectRef source = JSValueToObject(ctx, arguments[1], &except), arrayBuffer = source;
+      std::size_t byteOffset = 0, length = JSObjectGetArrayBufferByteLength(ctx, source, &except);
+      if (except) {
+        except = nullptr;
+        arrayBuffer = JSObjectGetTypedArrayBuffer(ctx, source, &except);
+        if (except)
+          return NX::Globals::Promise::reject(ctx,
+                                              NX::Exception("argument must be TypedArray or ArrayBuffer").toError(ctx));
+        byteOffset = JSObjectGetTypedArrayByteOffset(ctx, source, &except);
+        length = JSObjectGetTypedArrayByteLength(ctx, source, &except);
+      }
+      auto data = static_cast<const char *>(JSObjectGetArrayBufferBytesPtr(ctx, arrayBuffer, &except)) + byteOffset;
+      if (except)
+        return NX::Globals::Promise::reject(ctx, except);
+      // the task owns a reference to the buffer so it can't be collected out from under pwrite
+      NX::Object buffer(ctx, arrayBuffer);
+      return scheduleOnFile(ctx, thisObject, arguments, argumentCount, 1,
+        [=](JSContextRef ctx, NX::Classes::IO::Devices::BidirectionalFileDevice * dev) -> JSValueRef {
+          (void)buffer;
+          return JSValueMakeNumber(ctx, dev->writeAt(data, offset, length));
+        });
+    }, 0
+  },
+  { "allocate", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      if (argumentCount < 2)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("must supply offset and length").toError(ctx));
+      std::size_t offset = numberArgument(ctx, arguments, argumentCount, 0, 0);
+      std::size_t length = numberArgument(ctx, arguments, argumentCount, 1, 0);
+      return scheduleOnFile(ctx, thisObject, arguments, argumentCount, 2,
+        [=](JSContextRef ctx, NX::Classes::IO::Devices::BidirectionalFileDevice * dev) -> JSValueRef {
+          dev->allocate(offset, length);
+          return JSValueMakeUndefined(ctx);
+        });
+    }, 0
+  },
+  { "syncRange", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      std::size_t offset = numberArgument(ctx, arguments, argumentCount, 0, 0);
+      std::size_t length = numberArgument(ctx, arguments, argumentCount, 1, 0);
+      return scheduleOnFile(ctx, thisObject, arguments, argumentCount, 0,
+        [=](JSContextRef ctx, NX::Classes::IO::Devices::BidirectionalFileDevice * dev) -> JSValueRef {
+          dev->syncRange(offset, length);
+          return JSValueMakeUndefined(ctx);
+        });
+    }, 0
+  },
+  { nullptr, nullptr, 0 }
+};
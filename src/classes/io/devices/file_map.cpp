@@ -0,0 +1,298 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "util.h"
+#include "nexus.h"
+#include "classes/io/device.h"
+#include "classes/io/devices/file_map.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  struct Segment {
+    void * base;
+    std::size_t length;
+  };
+
+  // every ArrayBuffer over a file range owns its own mapping, empty ones own nothing
+  void releaseView(void *, void * context) {
+    if (auto * segment = static_cast<Segment *>(context)) {
+      munmap(segment->base, segment->length);
+      delete segment;
+    }
+  }
+
+  int adviceFlag(NX::Classes::IO::Devices::FileMapDevice::Advice advice) {
+    switch (advice) {
+      case NX::Classes::IO::Devices::FileMapDevice::Sequential: return MADV_SEQUENTIAL;
+      case NX::Classes::IO::Devices::FileMapDevice::Random: return MADV_RANDOM;
+      case NX::Classes::IO::Devices::FileMapDevice::WillNeed: return MADV_WILLNEED;
+      default: return MADV_NORMAL;
+    }
+  }
+}
+
+NX::Classes::IO::Devices::FileMapDevice::Mapping::~Mapping()
+{
+  if (data)
+    munmap(data, size);
+  ::close(fd);
+}
+
+NX::Classes::IO::Devices::FileMapDevice::FileMapDevice(const std::string & path, Advice advice):
+  myMapping(), mySize(0), myOffset(0), myAdvice(advice), myError()
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw NX::Exception("could not open file '" + path + "': " + std::strerror(errno));
+  struct stat info;
+  if (fstat(fd, &info)) {
+    ::close(fd);
+    throw NX::Exception("could not stat file '" + path + "': " + std::strerror(errno));
+  }
+  mySize = static_cast<std::size_t>(info.st_size);
+  void * data = nullptr;
+  // an empty file has nothing to map, reads just see the end right away
+  if (mySize) {
+    data = mmap(nullptr, mySize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      throw NX::Exception("could not map file '" + path + "': " + std::strerror(errno));
+    }
+  }
+  myMapping = std::make_shared<Mapping>(static_cast<char *>(data), mySize, fd);
+  advise(advice);
+}
+
+NX::Classes::IO::Devices::FileMapDevice::Advice
+NX::Classes::IO::Devices::FileMapDevice::adviceFromString(const std::string & advice)
+{
+  if (boost::iequals(advice, "sequential"))
+    return Sequential;
+  if (boost::iequals(advice, "random"))
+    return Random;
+  if (boost::iequals(advice, "willneed"))
+    return WillNeed;
+  if (boost::iequals(advice, "normal"))
+    return Normal;
+  throw NX::Exception("access advice must be one of ['normal','sequential','random','willneed']");
+}
+
+void NX::Classes::IO::Devices::FileMapDevice::advise(Advice advice, std::size_t offset, std::size_t length)
+{
+  auto mapping = std::atomic_load(&myMapping);
+  if (!mapping || !mapping->data || offset >= mapping->size)
+    return;
+  // madvise wants a page aligned start
+  const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const std::size_t start = offset & ~(page - 1);
+  if (!length || length > mapping->size - offset)
+    length = mapping->size - offset;
+  madvise(mapping->data + start, length + (offset - start), adviceFlag(advice));
+  // views made from here on follow it too
+  if (!offset && length == mapping->size)
+    myAdvice.store(advice);
+}
+
+char * NX::Classes::IO::Devices::FileMapDevice::isolate(const Mapping & mapping, std::size_t offset,
+                                                         std::size_t length, void *& context,
+                                                         boost::system::error_code & error)
+{
+  context = nullptr;
+  if (!length)
+    return nullptr;
+  // the file's pages are shared until a script writes to them, then that view alone gets a copy
+  const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const std::size_t start = offset & ~(page - 1);
+  const std::size_t size = length + (offset - start);
+  void * base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, mapping.fd, static_cast<off_t>(start));
+  if (base == MAP_FAILED) {
+    error.assign(errno, boost::system::system_category());
+    return nullptr;
+  }
+  madvise(base, size, adviceFlag(myAdvice));
+  context = new Segment { base, size };
+  return static_cast<char *>(base) + (offset - start);
+}
+
+std::size_t NX::Classes::IO::Devices::FileMapDevice::claim(std::size_t length, std::size_t & offset)
+{
+  std::size_t claimed;
+  offset = myOffset;
+  do {
+    claimed = offset < mySize ? std::min(length, mySize - offset) : 0;
+  } while (!myOffset.compare_exchange_weak(offset, offset + claimed));
+  return claimed;
+}
+
+std::size_t NX::Classes::IO::Devices::FileMapDevice::deviceRead(char * dest, std::size_t length)
+{
+  auto mapping = std::atomic_load(&myMapping);
+  if (!mapping)
+    return 0;
+  std::size_t offset;
+  std::size_t claimed = claim(length, offset);
+  if (claimed)
+    std::memcpy(dest, mapping->data + offset, claimed);
+  return claimed;
+}
+
+bool NX::Classes::IO::Devices::FileMapDevice::deviceReadAsync(std::size_t length, ReadCompletion completion)
+{
+  auto mapping = std::atomic_load(&myMapping);
+  if (!mapping)
+    return false;
+  std::size_t offset;
+  std::size_t claimed = claim(length, offset);
+  void * context;
+  boost::system::error_code error;
+  char * data = isolate(*mapping, offset, claimed, context, error);
+  completion(error, data, error ? 0 : claimed, releaseView, context);
+  return true;
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileMapDevice::view(JSContextRef ctx, std::size_t offset, std::size_t length,
+                                                          JSValueRef * exception)
+{
+  auto mapping = std::atomic_load(&myMapping);
+  if (!mapping)
+    throw NX::Exception("device is closed");
+  if (offset > mySize)
+    offset = mySize;
+  if (length > mySize - offset)
+    length = mySize - offset;
+  void * context;
+  boost::system::error_code error;
+  char * data = isolate(*mapping, offset, length, context, error);
+  if (error)
+    throw NX::Exception(error);
+  JSObjectRef buffer = JSObjectMakeArrayBufferWithBytesNoCopy(ctx, data, length, releaseView, context, exception);
+  if (exception && *exception)
+    releaseView(data, context);
+  return buffer;
+}
+
+std::size_t NX::Classes::IO::Devices::FileMapDevice::deviceSeek(std::size_t pos, Position from)
+{
+  std::size_t target = from == Current ? myOffset + pos : from == End ? mySize + pos : pos;
+  myOffset.store(target);
+  return target;
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileMapDevice::Constructor(JSContextRef ctx, JSObjectRef constructor,
+                                                                size_t argumentCount, const JSValueRef arguments[],
+                                                                JSValueRef * exception)
+{
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  JSClassRef deviceClass = createClass(context);
+  try {
+    if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+      throw NX::Exception("argument must be a string path");
+    Advice advice = Normal;
+    if (argumentCount > 1 && !JSValueIsUndefined(ctx, arguments[1]))
+      advice = adviceFromString(NX::Value(ctx, arguments[1]).toString());
+    NX::Value path(ctx, arguments[0]);
+    return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+      new NX::Classes::IO::Devices::FileMapDevice(path.toString(), advice)));
+  } catch (const std::exception & e) {
+    JSWrapException(ctx, e, exception);
+    return JSObjectMake(ctx, nullptr, nullptr);
+  }
+}
+
+JSClassRef NX::Classes::IO::Devices::FileMapDevice::createClass(NX::Context * context)
+{
+  JSClassDefinition def = NX::Classes::IO::Devices::FileMapDevice::Class;
+  def.parentClass = NX::Classes::IO::SeekableSourceDevice::createClass(context);
+  return context->nexus()->defineOrGetClass(def);
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileMapDevice::getConstructor(NX::Context * context)
+{
+  return JSObjectMakeConstructor(context->toJSContext(), createClass(context),
+                                 NX::Classes::IO::Devices::FileMapDevice::Constructor);
+}
+
+const JSClassDefinition NX::Classes::IO::Devices::FileMapDevice::Class {
+  0, kJSClassAttributeNone, "FileMapDevice", nullptr, NX::Classes::IO::Devices::FileMapDevice::Properties,
+  NX::Classes::IO::Devices::FileMapDevice::Methods, nullptr, NX::Classes::IO::Devices::FileMapDevice::Finalize
+};
+
+const JSStaticValue NX::Classes::IO::Devices::FileMapDevice::Properties[] {
+  { "size", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
+      NX::Classes::IO::Devices::FileMapDevice * dev = NX::Classes::IO::Devices::FileMapDevice::FromObject(object);
+      return JSValueMakeNumber(ctx, dev ? dev->sourceSize() : 0);
+    }, nullptr, kJSPropertyAttributeNone },
+  { nullptr, nullptr, nullptr, 0 }
+};
+
+const JSStaticFunction NX::Classes::IO::Devices::FileMapDevice::Methods[] {
+  { "view", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      try {
+        NX::Classes::IO::Devices::FileMapDevice * dev = NX::Classes::IO::Devices::FileMapDevice::FromObject(thisObject);
+        if (!dev)
+          throw NX::Exception("invalid FileMapDevice instance");
+        std::size_t offset = 0, length = dev->sourceSize();
+        if (argumentCount > 0) {
+          if (JSValueGetType(ctx, arguments[0]) != kJSTypeNumber)
+            throw NX::Exception("offset must be a number");
+          offset = static_cast<std::size_t>(NX::Value(ctx, arguments[0]).toNumber());
+        }
+        if (argumentCount > 1) {
+          if (JSValueGetType(ctx, arguments[1]) != kJSTypeNumber)
+            throw NX::Exception("length must be a number");
+          length = static_cast<std::size_t>(NX::Value(ctx, arguments[1]).toNumber());
+        }
+        return dev->view(ctx, offset, length, exception);
+      } catch(const std::exception & e) {
+        return JSWrapException(ctx, e, exception);
+      }
+    }, 0
+  },
+  { "advise", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      try {
+        NX::Classes::IO::Devices::FileMapDevice * dev = NX::Classes::IO::Devices::FileMapDevice::FromObject(thisObject);
+        if (!dev)
+          throw NX::Exception("invalid FileMapDevice instance");
+        if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+          throw NX::Exception("advice must be a string");
+        std::size_t offset = 0, length = 0;
+        if (argumentCount > 1)
+          offset = static_cast<std::size_t>(NX::Value(ctx, arguments[1]).toNumber());
+        if (argumentCount > 2)
+          length = static_cast<std::size_t>(NX::Value(ctx, arguments[2]).toNumber());
+        dev->advise(adviceFromString(NX::Value(ctx, arguments[0]).toString()), offset, length);
+        return JSValueMakeUndefined(ctx);
+      } catch(const std::exception & e) {
+        return JSWrapException(ctx, e, exception);
+      }
+    }, 0
+  },
+  { nullptr, nullptr, 0 }
+};
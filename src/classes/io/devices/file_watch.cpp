@@ -0,0 +1,319 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "util.h"
+#include "nexus.h"
+#include "scheduler.h"
+#include "classes/io/device.h"
+#include "classes/io/devices/file_watch.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <sys/inotify.h>
+
+namespace {
+  struct EventName {
+    const char * name;
+    std::uint32_t mask;
+  };
+
+  const EventName EventNames[] {
+    { "access", IN_ACCESS },
+    { "attrib", IN_ATTRIB },
+    { "closeWrite", IN_CLOSE_WRITE },
+    { "closeNoWrite", IN_CLOSE_NOWRITE },
+    { "create", IN_CREATE },
+    { "delete", IN_DELETE },
+    { "deleteSelf", IN_DELETE_SELF },
+    { "modify", IN_MODIFY },
+    { "moveSelf", IN_MOVE_SELF },
+    { "moveFrom", IN_MOVED_FROM },
+    { "moveTo", IN_MOVED_TO },
+    { "open", IN_OPEN },
+    { "unmount", IN_UNMOUNT },
+    { "overflow", IN_Q_OVERFLOW },
+    { "ignored", IN_IGNORED },
+  };
+
+  // access and open fire on every read, nobody asking for changes wants those
+  const std::uint32_t DefaultMask = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY |
+                                    IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO;
+
+  const char * eventName(std::uint32_t mask) {
+    for (auto & name : EventNames)
+      if (mask & name.mask)
+        return name.name;
+    return "unknown";
+  }
+}
+
+NX::Classes::IO::Devices::FileWatchDevice::FileWatchDevice(NX::Scheduler * scheduler, const std::string & path,
+                                                           std::uint32_t mask):
+  myScheduler(scheduler), myWatcher(scheduler->fileWatcher()), myPath(path), myMask(mask ? mask : DefaultMask),
+  myState(Paused), myOpen(true), myMutex(), myWatch(0), myEvents(), myFlushing(false), myGone(false), myThis(),
+  myPromise(), myResolve(), myReject(), myError()
+{
+  if (!myWatcher->available())
+    throw NX::Exception("file watching is not available");
+  boost::system::error_code error;
+  if (!boost::filesystem::exists(path, error))
+    throw NX::Exception("can not watch '" + path + "': no such file or directory");
+}
+
+NX::Classes::IO::Devices::FileWatchDevice::~FileWatchDevice()
+{
+  myOpen = false;
+  stop();
+}
+
+std::uint32_t NX::Classes::IO::Devices::FileWatchDevice::maskFromNames(const std::vector<std::string> & names)
+{
+  std::uint32_t mask = 0;
+  for (auto & name : names) {
+    auto found = std::find_if(std::begin(EventNames), std::end(EventNames),
+                              [&](const EventName & event) { return boost::iequals(name, event.name); });
+    if (found == std::end(EventNames))
+      throw NX::Exception("unknown file event '" + name + "'");
+    mask |= found->mask;
+  }
+  return mask;
+}
+
+void NX::Classes::IO::Devices::FileWatchDevice::stop()
+{
+  NX::FileWatcher::Handle watch;
+  {
+    std::lock_guard<std::mutex> lock(myMutex);
+    watch = myWatch;
+    myWatch = 0;
+  }
+  // outside the lock: the watcher holds its own while it calls onEvent, which takes ours
+  if (watch)
+    myWatcher->unwatch(watch);
+}
+
+void NX::Classes::IO::Devices::FileWatchDevice::deviceClose()
+{
+  myOpen = false;
+  myState = Paused;
+  stop();
+  std::unique_lock<std::mutex> lock(myMutex);
+  if (myResolve)
+    schedule(lock);
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileWatchDevice::pause(JSContextRef ctx, JSObjectRef thisObject)
+{
+  if (myState != Resumed)
+    return myPromise ? myPromise.value() : NX::Globals::Promise::resolve(ctx, thisObject);
+  myState = Paused;
+  stop();
+  // the last flush settles the promise once whatever came in before the pause has gone out
+  std::unique_lock<std::mutex> lock(myMutex);
+  schedule(lock);
+  return myPromise;
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileWatchDevice::resume(JSContextRef ctx, JSObjectRef thisObject)
+{
+  if (!myOpen)
+    return NX::Globals::Promise::reject(ctx, NX::Exception("device is closed").toError(ctx));
+  if (myState == Resumed)
+    return myPromise;
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  bool running;
+  {
+    // under the lock, so a flush settling the last run either sees this or is over before it
+    std::lock_guard<std::mutex> lock(myMutex);
+    running = !!myResolve;
+    if (running)
+      myState = Resumed;
+  }
+  // a pause whose promise hasn't settled yet just picks up where it left off
+  if (!running) {
+    NX::ResolveRejectHandler resolve, reject;
+    JSObjectRef promise = NX::Globals::Promise::createPromise(context->toJSContext(),
+      [&](JSContextRef, NX::ResolveRejectHandler onResolve, NX::ResolveRejectHandler onReject) {
+        resolve = onResolve;
+        reject = onReject;
+      });
+    std::lock_guard<std::mutex> lock(myMutex);
+    myThis.clear();
+    myThis = NX::Object(context->toJSContext(), thisObject);
+    myPromise.clear();
+    myPromise = NX::Object(context->toJSContext(), promise);
+    myResolve = resolve;
+    myReject = reject;
+    myGone = false;
+    myState = Resumed;
+  }
+  try {
+    auto watch = myWatcher->watch(myPath, myMask, [this](const NX::FileWatcher::Event & event) { onEvent(event); });
+    std::lock_guard<std::mutex> lock(myMutex);
+    myWatch = watch;
+  } catch(const std::exception & e) {
+    // nothing was watched, so the run ends right here
+    myState = Paused;
+    NX::ResolveRejectHandler reject;
+    {
+      std::lock_guard<std::mutex> lock(myMutex);
+      reject = std::move(myReject);
+      myResolve = NX::ResolveRejectHandler();
+      myReject = NX::ResolveRejectHandler();
+      myThis.clear();
+    }
+    if (reject)
+      reject(context->toJSContext(), NX::Object(context->toJSContext(), e));
+  }
+  return myPromise;
+}
+
+void NX::Classes::IO::Devices::FileWatchDevice::onEvent(const NX::FileWatcher::Event & event)
+{
+  std::unique_lock<std::mutex> lock(myMutex);
+  myEvents.push_back(event);
+  // the kernel dropped the watch (the file is gone, or its filesystem), and the watcher forgets it on its own
+  if (event.mask & IN_IGNORED) {
+    myGone = true;
+    myWatch = 0;
+  }
+  schedule(lock);
+}
+
+void NX::Classes::IO::Devices::FileWatchDevice::schedule(std::unique_lock<std::mutex> & lock)
+{
+  if (myFlushing)
+    return;
+  myFlushing = true;
+  lock.unlock();
+  myScheduler->scheduleTask([this]() { flush(); });
+}
+
+void NX::Classes::IO::Devices::FileWatchDevice::flush()
+{
+  static const Atom Change("change");
+  for (;;) {
+    std::deque<NX::FileWatcher::Event> events;
+    NX::Object self;
+    NX::ResolveRejectHandler resolve;
+    bool gone = false;
+    {
+      std::lock_guard<std::mutex> lock(myMutex);
+      events.swap(myEvents);
+      if (events.empty()) {
+        myFlushing = false;
+        if (!myResolve || !(myGone || myState == Paused || !myOpen))
+          return;
+        // this run is over; from here on nothing but this task touches what it held
+        gone = myGone;
+        resolve = std::move(myResolve);
+        myResolve = NX::ResolveRejectHandler();
+        myReject = NX::ResolveRejectHandler();
+        self = myThis;
+        myThis.clear();
+      } else
+        self = myThis;
+    }
+    JSContextRef ctx = self.context();
+    if (!events.empty()) {
+      for (auto & event : events) {
+        if (event.mask & IN_IGNORED)
+          continue;
+        NX::Object change(ctx);
+        change.set("type", NX::Value(ctx, std::string(eventName(event.mask))).value());
+        change.set("path", NX::Value(ctx, event.name.empty() ? myPath :
+                                          (boost::filesystem::path(myPath) / event.name).string()).value());
+        if (!event.name.empty())
+          change.set("name", NX::Value(ctx, event.name).value());
+        if (event.cookie)
+          change.set("cookie", JSValueMakeNumber(ctx, event.cookie));
+        change.set("directory", JSValueMakeBoolean(ctx, (event.mask & IN_ISDIR) != 0));
+        JSValueRef args[] { change.value() };
+        emitFast(ctx, self.value(), Change, 1, args, nullptr);
+      }
+      continue;
+    }
+    if (gone) {
+      myState = Paused;
+      emitFast(ctx, self.value(), Atom::End, 0, nullptr, nullptr);
+    }
+    resolve(ctx, self.value());
+    return;
+  }
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileWatchDevice::Constructor(JSContextRef ctx, JSObjectRef constructor,
+                                                                  size_t argumentCount, const JSValueRef arguments[],
+                                                                  JSValueRef * exception)
+{
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  JSClassRef deviceClass = createClass(context);
+  try {
+    if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+      throw NX::Exception("path must be a string");
+    std::vector<std::string> events;
+    if (argumentCount > 1 && JSValueIsObject(ctx, arguments[1])) {
+      NX::Object options(ctx, arguments[1]);
+      auto list = options["events"];
+      if (!JSValueIsUndefined(ctx, list->value())) {
+        NX::Object array(ctx, list->value());
+        const std::size_t length = static_cast<std::size_t>(array["length"]->toNumber());
+        for (std::size_t i = 0; i < length; i++)
+          events.push_back(array[static_cast<unsigned int>(i)]->toString());
+      }
+    }
+    return JSObjectMake(ctx, deviceClass, dynamic_cast<NX::Classes::Base*>(
+      new NX::Classes::IO::Devices::FileWatchDevice(context->nexus()->scheduler(),
+                                                    NX::Value(ctx, arguments[0]).toString(), maskFromNames(events))));
+  } catch (const std::exception & e) {
+    JSWrapException(ctx, e, exception);
+    return JSObjectMake(ctx, nullptr, nullptr);
+  }
+}
+
+JSClassRef NX::Classes::IO::Devices::FileWatchDevice::createClass(NX::Context * context)
+{
+  JSClassDefinition def = NX::Classes::IO::Devices::FileWatchDevice::Class;
+  def.parentClass = NX::Classes::IO::PushSourceDevice::createClass(context);
+  return context->nexus()->defineOrGetClass(def);
+}
+
+JSObjectRef NX::Classes::IO::Devices::FileWatchDevice::getConstructor(NX::Context * context)
+{
+  return JSObjectMakeConstructor(context->toJSContext(), createClass(context),
+                                 NX::Classes::IO::Devices::FileWatchDevice::Constructor);
+}
+
+const JSClassDefinition NX::Classes::IO::Devices::FileWatchDevice::Class {
+  0, kJSClassAttributeNone, "FileWatchDevice", nullptr, NX::Classes::IO::Devices::FileWatchDevice::Properties,
+  NX::Classes::IO::Devices::FileWatchDevice::Methods, nullptr, NX::Classes::IO::Devices::FileWatchDevice::Finalize
+};
+
+const JSStaticValue NX::Classes::IO::Devices::FileWatchDevice::Properties[] {
+  { "path", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
+      auto dev = NX::Classes::IO::Devices::FileWatchDevice::FromObject(object);
+      return dev ? NX::Value(ctx, dev->path()).value() : JSValueMakeUndefined(ctx);
+    }, nullptr, kJSPropertyAttributeNone },
+  { nullptr, nullptr, nullptr, 0 }
+};
+
+const JSStaticFunction NX::Classes::IO::Devices::FileWatchDevice::Methods[] {
+  { nullptr, nullptr, 0 }
+};
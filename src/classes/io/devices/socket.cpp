@@ -19,6 +19,49 @@
 
 #include "globals/promise.h"
 #include "classes/io/devices/socket.h"
+#include "buffer_pool.h"
+
+#include <sys/sendfile.h>
+#include <cerrno>
+
+namespace {
+  // the most one sendfile() call moves; the transfer goes back through the reactor between calls
+  const std::size_t MaxSendFileChunk = 4 * 1024 * 1024;
+
+  void sendFileFrom(const std::shared_ptr<boost::asio::ip::tcp::socket> & socket, int fd, std::size_t offset,
+                    std::size_t length, std::size_t sent,
+                    const NX::Classes::IO::SinkDevice::WriteCompletion & completion)
+  {
+    while (sent < length) {
+      off_t position = static_cast<off_t>(offset + sent);
+      ssize_t ret = ::sendfile(socket->native_handle(), fd, &position, std::min(length - sent, MaxSendFileChunk));
+      if (ret > 0) {
+        sent += static_cast<std::size_t>(ret);
+        if (sent < length) {
+          // let whatever else is queued on this reactor run before the next chunk
+          socket->get_io_service().post([=] { sendFileFrom(socket, fd, offset, length, sent, completion); });
+          return;
+        }
+      } else if (ret == 0) {
+        // the file got shorter than it was when the transfer started
+        break;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        socket->async_wait(boost::asio::ip::tcp::socket::wait_write,
+                           [=](const boost::system::error_code & error) {
+                             if (error)
+                               completion(error, sent);
+                             else
+                               sendFileFrom(socket, fd, offset, length, sent, completion);
+                           });
+        return;
+      } else if (errno != EINTR) {
+        completion(boost::system::error_code(errno, boost::system::system_category()), sent);
+        return;
+      }
+    }
+    completion(boost::system::error_code(), sent);
+  }
+}
 
 JSObjectRef NX::Classes::IO::Devices::Socket::Constructor (JSContextRef ctx, JSObjectRef constructor,
                                                            size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception)
@@ -62,8 +105,9 @@ JSObjectRef NX::Classes::IO::Devices::UDPSocket::getConstructor (NX::Context * c
 JSObjectRef NX::Classes::IO::Devices::TCPSocket::Constructor (JSContextRef ctx, JSObjectRef constructor,
                                                               size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception)
 {
-  JSWrapException(ctx, NX::Exception("TCPSocket is not constructable"), exception);
-  return JSObjectMake(ctx, nullptr, nullptr);
+  NX::Context * context = NX::Context::FromJsContext(ctx);
+  std::shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(*context->nexus()->scheduler()->service()));
+  return JSObjectMake(ctx, createClass(context), dynamic_cast<Base*>(new TCPSocket(context->nexus()->scheduler(), socket)));
 }
 
 JSClassRef NX::Classes::IO::Devices::TCPSocket::createClass (NX::Context * context)
@@ -239,7 +283,7 @@ JSObjectRef NX::Classes::IO::Devices::UDPSocket::connect (JSContextRef ctx, JSOb
             NX::Value(context->toJSContext(), next->host_name()).value(),
             NX::Value(context->toJSContext(), next->service_name()).value()
           };
-          this->emitFast(context->toJSContext(), thisObject, "attempt", 2, args, nullptr);
+          this->emitFast(context->toJSContext(), thisObject, Atom::Attempt, 2, args, nullptr);
           return next;
         }, [=](const auto & error, const auto & it) {
           if (error) {
@@ -251,7 +295,7 @@ JSObjectRef NX::Classes::IO::Devices::UDPSocket::connect (JSContextRef ctx, JSOb
               NX::Value(context->toJSContext(), it->service_name()).value()
             };
             myEndpoint = *it;
-            this->emitFast(context->toJSContext(), thisObject, "connected", 2, args, nullptr);
+            this->emitFast(context->toJSContext(), thisObject, Atom::Connected, 2, args, nullptr);
             resolve(context->toJSContext(), thisObject);
           }
         });
@@ -294,7 +338,7 @@ JSObjectRef NX::Classes::IO::Devices::UDPSocket::resume (JSContextRef ctx, JSObj
     auto recvHandler = [=](auto next, char * buffer, std::size_t len, const std::shared_ptr<Endpoint> & endpoint,
                            const boost::system::error_code& ec, std::size_t bytes_transferred) -> void {
       if (ec) {
-        if (buffer) WTF::fastFree(buffer);
+        NX::BufferPool::release(buffer, len);
         reject(context->toJSContext(), NX::Object(context->toJSContext(), ec));
         JSValueUnprotect(context->toJSContext(), thisObject);
         myScheduler->release();
@@ -304,15 +348,14 @@ JSObjectRef NX::Classes::IO::Devices::UDPSocket::resume (JSContextRef ctx, JSObj
       {
         if (buffer) {
           if (bytes_transferred) {
-            JSObjectRef arrayBuffer = JSObjectMakeArrayBufferWithBytesNoCopy(context->toJSContext(), buffer, bytes_transferred, [](void * ptr, void * ctx) {
-              WTF::fastFree(ptr);
-            }, nullptr, nullptr);
+            JSObjectRef arrayBuffer = JSObjectMakeArrayBufferWithBytesNoCopy(context->toJSContext(), buffer, bytes_transferred,
+              NX::BufferPool::deallocate, NX::BufferPool::context(len), nullptr);
             NX::Object endpointData(context->toJSContext());
             endpointData.set("address", NX::Value(context->toJSContext(), endpoint->address().to_string()).value());
             endpointData.set("port", NX::Value(context->toJSContext(), endpoint->port()).value());
             JSValueRef args[] { arrayBuffer, endpointData };
             JSValueRef exp = nullptr;
-            this->emitFast(context->toJSContext(), thisObject, "data", 2, args, &exp);
+            this->emitFast(context->toJSContext(), thisObject, Atom::Data, 2, args, &exp);
             if (exp) {
               reject(context->toJSContext(), exp);
               JSValueUnprotect(context->toJSContext(), thisObject);
@@ -320,17 +363,17 @@ JSObjectRef NX::Classes::IO::Devices::UDPSocket::resume (JSContextRef ctx, JSObj
               return;
             }
           } else {
-            WTF::fastFree(buffer);
+            NX::BufferPool::release(buffer, len);
             buffer = nullptr;
           }
         }
         if (mySocket->is_open() && myState == Resumed) {
           std::size_t bufSize = mySocket->available();
-          if (!bufSize) bufSize = 1024;
-          char * buf = (char *)WTF::fastMalloc(bufSize);
+          std::size_t capacity;
+          char * buf = NX::BufferPool::acquire(bufSize, capacity);
           std::shared_ptr<Endpoint> newEndpoint(new Endpoint());
-          mySocket->async_receive_from(boost::asio::buffer(buf, bufSize), *newEndpoint,
-            boost::bind<void>(next, next, buf, bufSize, newEndpoint, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+          mySocket->async_receive_from(boost::asio::buffer(buf, capacity), *newEndpoint,
+            boost::bind<void>(next, next, buf, capacity, newEndpoint, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
         } else {
           resolve(context->toJSContext(), JSValueMakeUndefined(context->toJSContext()));
           JSValueUnprotect(context->toJSContext(), thisObject);
@@ -359,12 +402,12 @@ JSObjectRef NX::Classes::IO::Devices::TCPSocket::resume(JSContextRef ctx, JSObje
       NX::Scheduler::Holder holderCopy(holder);
       if (ec) {
         myState = Paused;
-        if (buffer) WTF::fastFree(buffer);
+        NX::BufferPool::release(buffer, len);
         if (ec != boost::system::errc::operation_canceled) {
           JSValueRef args[] { NX::Object(context->toJSContext(), ec) };
-          emitFastAndSchedule(context->toJSContext(), thisObj, "error", 1, args, nullptr);
+          emitFastAndSchedule(context->toJSContext(), thisObj, Atom::Error, 1, args, nullptr);
           if (!mySocket->is_open()) {
-            emitFastAndSchedule(context->toJSContext(), thisObj, "close", 0, nullptr, nullptr);
+            emitFastAndSchedule(context->toJSContext(), thisObj, Atom::Close, 0, nullptr, nullptr);
           }
           reject(context->toJSContext(), args[0]);
         } else
@@ -377,39 +420,38 @@ JSObjectRef NX::Classes::IO::Devices::TCPSocket::resume(JSContextRef ctx, JSObje
           if (bytes_transferred) {
             JSObjectRef arrayBuffer = JSObjectMakeArrayBufferWithBytesNoCopy(context->toJSContext(),
                                                                              buffer, bytes_transferred,
-                                                                             [](void * ptr, void * ctx) {
-              WTF::fastFree(ptr);
-            }, nullptr, nullptr);
+                                                                             NX::BufferPool::deallocate,
+                                                                             NX::BufferPool::context(len), nullptr);
             JSValueRef args[] { arrayBuffer };
             JSValueRef exp = nullptr;
-            this->emitFastAndSchedule(context->toJSContext(), thisObj, "data", 1, args, &exp);
+            this->emitFastAndSchedule(context->toJSContext(), thisObj, Atom::Data, 1, args, &exp);
             if (exp) {
               JSValueRef args[] { exp };
-              emitFastAndSchedule(context->toJSContext(), thisObj, "error", 1, args, nullptr);
+              emitFastAndSchedule(context->toJSContext(), thisObj, Atom::Error, 1, args, nullptr);
               if (!mySocket->is_open())
-                emitFastAndSchedule(context->toJSContext(), thisObj, "close", 0, nullptr, nullptr);
+                emitFastAndSchedule(context->toJSContext(), thisObj, Atom::Close, 0, nullptr, nullptr);
               myState = Paused;
               reject(context->toJSContext(), exp);
               return;
             }
           } else {
-            WTF::fastFree(buffer);
+            NX::BufferPool::release(buffer, len);
             buffer = nullptr;
           }
         }
         if (mySocket->is_open() && myState == Resumed) {
           std::size_t bufSize = mySocket->available();
-          if (!bufSize) bufSize = 1024;
-          char * buf = (char *)WTF::fastMalloc(bufSize);
-          mySocket->async_receive(boost::asio::buffer(buf, bufSize),
-                                  boost::bind<void>(next, next, buf, bufSize, boost::asio::placeholders::error,
+          std::size_t capacity;
+          char * buf = NX::BufferPool::acquire(bufSize, capacity);
+          mySocket->async_receive(boost::asio::buffer(buf, capacity),
+                                  boost::bind<void>(next, next, buf, capacity, boost::asio::placeholders::error,
                                       boost::asio::placeholders::bytes_transferred));
         } else if (mySocket->is_open()){
           myScheduler->scheduleTask(boost::bind<void>(next, next, buffer, len, ec, bytes_transferred));
           return;
         } else {
           resolve(context->toJSContext(), thisObj);
-          emitFast(context->toJSContext(), thisObj, "close", 0, nullptr, nullptr);
+          emitFast(context->toJSContext(), thisObj, Atom::Close, 0, nullptr, nullptr);
           mySocket->close();
           return;
         }
@@ -444,7 +486,7 @@ JSObjectRef NX::Classes::IO::Devices::TCPSocket::connect (JSContextRef ctx, JSOb
                                        NX::Value(context->toJSContext(), next->host_name()).value(),
                                        NX::Value(context->toJSContext(), next->service_name()).value()
                                      };
-                                     this->emitFast(context->toJSContext(), thisObject, "attempt", 2, args, nullptr);
+                                     this->emitFast(context->toJSContext(), thisObject, Atom::Attempt, 2, args, nullptr);
                                      return next;
                                    }, [=](const auto & error, const auto & it) {
                                      if (error) {
@@ -456,7 +498,7 @@ JSObjectRef NX::Classes::IO::Devices::TCPSocket::connect (JSContextRef ctx, JSOb
                                          NX::Value(context->toJSContext(), it->service_name()).value()
                                        };
                                        myEndpoint = *it;
-                                       this->emitFast(context->toJSContext(), thisObject, "connected", 2, args, nullptr);
+                                       this->emitFast(context->toJSContext(), thisObject, Atom::Connected, 2, args, nullptr);
                                        resolve(context->toJSContext(),thisObject);
                                      }
                                    });
@@ -477,6 +519,19 @@ std::size_t NX::Classes::IO::Devices::TCPSocket::deviceWrite(const char *buffer,
   return written;
 }
 
+void NX::Classes::IO::Devices::TCPSocket::sendFile(const std::shared_ptr<boost::asio::ip::tcp::socket> & socket, int fd,
+                                                   std::size_t offset, std::size_t length, WriteCompletion completion)
+{
+  boost::system::error_code ec;
+  // asio keeps its own synchronous calls working on a non-blocking socket, so this only changes what sendfile does
+  if (!socket->native_non_blocking())
+    socket->native_non_blocking(true, ec);
+  if (ec)
+    completion(ec, 0);
+  else
+    sendFileFrom(socket, fd, offset, length, 0, completion);
+}
+
 JSObjectRef NX::Classes::IO::Devices::TCPSocket::pause(JSContextRef ctx, JSObjectRef thisObject) {
   if (myPromise) {
     myState.store(Paused);
@@ -69,7 +69,7 @@ JSValueRef NX::Classes::Net::HTTP::Request::attach(JSContextRef ctx, JSObjectRef
 //  }
   NX::Globals::Promise::Executor executor = [=](JSContextRef ctx, ResolveRejectHandler resolve,
                                                 ResolveRejectHandler reject) {
-    myConnection->addListener(context->toJSContext(), connectionObj, "data",
+    myConnection->addListener(context->toJSContext(), connectionObj, Atom::Data,
                               [=](JSContextRef ctx, std::size_t argumentCount, const JSValueRef arguments[],
                                   JSValueRef *exception) -> JSValueRef {
                                 NX::Object buffer(ctx, arguments[0]);
@@ -123,11 +123,11 @@ JSValueRef NX::Classes::Net::HTTP::Request::attach(JSContextRef ctx, JSObjectRef
                                     }
                                   }
                                   if (myParser->is_done()) {
-                                    emitFast(context->toJSContext(), thisObj, "end", 0, nullptr, nullptr);
+                                    emitFast(context->toJSContext(), thisObj, Atom::End, 0, nullptr, nullptr);
                                   } else {
                                     JSValueRef dataArgs[]{buffer};
                                     JSValueRef pException = nullptr;
-                                    emitFast(ctx, thisObj, "data", 1, dataArgs, &pException);
+                                    emitFast(ctx, thisObj, Atom::Data, 1, dataArgs, &pException);
                                     if (pException) {
                                       reject(context->toJSContext(), pException);
                                     }
@@ -137,10 +137,10 @@ JSValueRef NX::Classes::Net::HTTP::Request::attach(JSContextRef ctx, JSObjectRef
                                 }
                                 return JSValueMakeUndefined(ctx);
                               });
-    myConnection->addOnceListener(context->toJSContext(), connectionObj, "error",
+    myConnection->addOnceListener(context->toJSContext(), connectionObj, Atom::Error,
                               [=](JSContextRef ctx, std::size_t argumentCount, const JSValueRef arguments[],
                                   JSValueRef *exception) -> JSValueRef {
-                                emitFast(ctx, thisObj, "error", argumentCount, arguments, exception);
+                                emitFast(ctx, thisObj, Atom::Error, argumentCount, arguments, exception);
                                 reject(ctx, arguments[0]);
                                 return JSValueMakeUndefined(ctx);
                               });
@@ -150,7 +150,7 @@ JSValueRef NX::Classes::Net::HTTP::Request::attach(JSContextRef ctx, JSObjectRef
                        },
                        [=](JSContextRef ctx, JSValueRef error, JSValueRef *exception) {
                          JSValueRef errArguments[]{error};
-                         emitFast(ctx, thisObj, "error", 1, errArguments, exception);
+                         emitFast(ctx, thisObj, Atom::Error, 1, errArguments, exception);
                          return JSValueMakeUndefined(ctx);
                        });
   };
@@ -19,6 +19,7 @@
 
 #include "classes/net/http/request.h"
 #include "classes/net/http/response.h"
+#include "classes/io/devices/socket.h"
 
 JSObjectRef NX::Classes::Net::HTTP::Response::attach(JSContextRef ctx, JSObjectRef thisObject, JSObjectRef connection)
 {
@@ -27,7 +28,7 @@ JSObjectRef NX::Classes::Net::HTTP::Response::attach(JSContextRef ctx, JSObjectR
 
 NX::Classes::Net::HTTP::Response::Response(NX::Classes::Net::HTTP::Connection *connection, bool continuation) :
     HTCommon::Response(connection), myConnection(connection), myRes(), myWriter(), myHeadersSentFlag(false),
-    myStatus(200), myContinuationFlag(continuation)
+    myCompletedFlag(false), myStatus(200), myContinuationFlag(continuation)
 {
   myRes = std::make_unique<NX::Classes::Net::HTTP::Response::BeastResponse>(
     (boost::beast::http::status)myStatus, 11);
@@ -37,6 +38,12 @@ NX::Classes::Net::HTTP::Response::Response(NX::Classes::Net::HTTP::Connection *c
 
 std::size_t NX::Classes::Net::HTTP::Response::deviceWrite(const char *buffer, std::size_t length) {
   boost::system::error_code & ec = error();
+  if (myCompletedFlag) {
+    // the body already went out whole with a Content-Length, there is no last chunk to send
+    if (buffer)
+      throw NX::Exception("response already completed");
+    return 0;
+  }
   if (!myHeadersSentFlag) {
     myHeadersSentFlag.store(true);
     myRes->chunked(true);
@@ -63,6 +70,58 @@ std::size_t NX::Classes::Net::HTTP::Response::deviceWrite(const char *buffer, st
   return length;
 }
 
+bool NX::Classes::Net::HTTP::Response::deviceTransferFrom(int fd, std::size_t offset, std::size_t length,
+                                                          WriteCompletion completion)
+{
+  boost::system::error_code & ec = error();
+  auto socket = myConnection->socket();
+  if (myCompletedFlag)
+    throw NX::Exception("response already completed");
+  if (!myHeadersSentFlag) {
+    // nothing was written yet, so the file is the whole body and needs no chunk framing
+    myHeadersSentFlag.store(true);
+    myCompletedFlag.store(true);
+    myRes->content_length(length);
+    Serializer serializer(*myRes);
+    serializer.split(true);
+    boost::beast::http::write_header(*myWriter, serializer, ec);
+    if (ec)
+      throw NX::Exception(ec);
+    NX::Classes::IO::Devices::TCPSocket::sendFile(socket, fd, offset, length,
+      [=](boost::system::error_code error, std::size_t written) {
+        // the peer was promised length bytes, a short body leaves the connection unusable
+        if (!error && written < length)
+          error = boost::system::errc::make_error_code(boost::system::errc::io_error);
+        if (error)
+          myConnection->keepAlive(false);
+        myConnection->notifyCompleted();
+        completion(error, written);
+      });
+    return true;
+  }
+  if (!length) {
+    completion(boost::system::error_code(), 0);
+    return true;
+  }
+  boost::asio::write(*socket, boost::beast::http::chunk_header(length), ec);
+  if (ec) {
+    myConnection->keepAlive(false);
+    throw NX::Exception(ec);
+  }
+  NX::Classes::IO::Devices::TCPSocket::sendFile(socket, fd, offset, length,
+    [=](boost::system::error_code error, std::size_t written) {
+      if (!error && written < length)
+        error = boost::system::errc::make_error_code(boost::system::errc::io_error);
+      if (!error)
+        boost::asio::write(*socket, boost::beast::http::chunk_crlf(), error);
+      // the chunk the header announced never arrived whole, so the framing can't be trusted after it
+      if (error)
+        myConnection->keepAlive(false);
+      completion(error, written);
+    });
+  return true;
+}
+
 void NX::Classes::Net::HTTP::Response::send(JSContextRef context, JSValueRef body) {
   boost::system::error_code & ec = error();
   if (!myHeadersSentFlag) {
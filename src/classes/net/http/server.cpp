@@ -51,7 +51,7 @@ void NX::Classes::Net::HTTP::Server::handleAccept(NX::Context * context, const N
       )
       return;
     JSValueRef args[] { NX::Object(context->toJSContext(), error )};
-    emitFastAndSchedule(context->toJSContext(), thisObject, "error", 1, args, nullptr);
+    emitFastAndSchedule(context->toJSContext(), thisObject, Atom::Error, 1, args, nullptr);
   }
   if (socket->is_open()) {
     NX::Object remoteEndpoint(context->toJSContext());
@@ -71,13 +71,13 @@ void NX::Classes::Net::HTTP::Server::handleAccept(NX::Context * context, const N
       NX::Object promise(context->toJSContext(), conn->start(context, connection, continuation));
       promise.then([=](JSContextRef ctx, JSValueRef value, JSValueRef *exception) {
         JSValueRef exp = nullptr;
-        emitFast(context->toJSContext(), thisObject, "connection", args.size(), args, &exp);
+        emitFast(context->toJSContext(), thisObject, Atom::Connection, args.size(), args, &exp);
         if (exp)
           *exception = NX::Exception(ctx, exp).toError(ctx);
         return thisObject;
       }, [=](JSContextRef ctx, JSValueRef value, JSValueRef *exception) {
         JSValueRef errorArgs[] { value };
-        emitFast(context->toJSContext(), thisObject, "error", 1, errorArgs, exception);
+        emitFast(context->toJSContext(), thisObject, Atom::Error, 1, errorArgs, exception);
         return JSValueMakeUndefined(ctx);
       });
     } else {
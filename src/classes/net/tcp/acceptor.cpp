@@ -20,6 +20,27 @@
 #include "classes/net/tcp/acceptor.h"
 #include "classes/io/devices/socket.h"
 
+#ifdef SO_REUSEPORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+#ifdef SO_INCOMING_CPU
+typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_INCOMING_CPU> incoming_cpu;
+#endif
+
+namespace {
+  // within a SO_REUSEPORT group the kernel prefers the listener whose cpu received the packet,
+  // so connections stay on the core (and node) that owns the NIC queue they arrived on
+  void steerToWorker(NX::Scheduler * scheduler, boost::asio::ip::tcp::acceptor & acceptor) {
+#ifdef SO_INCOMING_CPU
+    int cpu = scheduler->serviceCpu(acceptor.get_io_service());
+    if (cpu >= 0) {
+      boost::system::error_code ignored;
+      acceptor.set_option(incoming_cpu(cpu), ignored);
+    }
+#endif
+  }
+}
+
 const JSClassDefinition NX::Classes::Net::TCP::Acceptor::Class {
   0, kJSClassAttributeNone, "Acceptor", nullptr, NX::Classes::Net::TCP::Acceptor::Properties,
   NX::Classes::Net::TCP::Acceptor::Methods, nullptr, NX::Classes::Net::TCP::Acceptor::Finalize
@@ -70,6 +91,17 @@ const JSStaticFunction NX::Classes::Net::TCP::Acceptor::Methods[] {
       }
     }, 0
   },
+  { "close", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
+    {
+      NX::Classes::Net::TCP::Acceptor * acceptor = NX::Classes::Net::TCP::Acceptor::FromObject(thisObject);
+      if (!acceptor) {
+        return *exception = NX::Exception("close() not implemented on Acceptor instance").toError(ctx);
+      }
+      acceptor->close();
+      return JSValueMakeUndefined(ctx);
+    }, 0
+  },
   { nullptr, nullptr, 0 }
 };
 
@@ -82,6 +114,11 @@ JSValueRef NX::Classes::Net::TCP::Acceptor::bind(JSContextRef ctx, JSObjectRef t
     if (!myAcceptor->is_open())
       myAcceptor->open(endpoint.protocol());
     myAcceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(reuse));
+#ifdef SO_REUSEPORT
+    // the per-worker shards opened by listen() have to share this port
+    if (myScheduler->servicePerWorker())
+      myAcceptor->set_option(reuse_port(true));
+#endif
     myAcceptor->bind(endpoint);
   } catch(const std::exception & e) {
     return JSWrapException(ctx, e, exception);
@@ -96,18 +133,75 @@ JSValueRef NX::Classes::Net::TCP::Acceptor::listen(JSContextRef ctx, const NX::O
     myThisObject = thisObject;
   try {
     myAcceptor->listen(maxConnections);
-    beginAccept(context, thisObject);
+#ifdef SO_REUSEPORT
+    if (myScheduler->servicePerWorker() && myShards.empty()) {
+      // one listener per worker reactor, the kernel spreads incoming connections between them
+      steerToWorker(myScheduler, *myAcceptor);
+      auto endpoint = myAcceptor->local_endpoint();
+      boost::asio::ip::tcp::acceptor::reuse_address reuse;
+      myAcceptor->get_option(reuse);
+      for (auto & service : myScheduler->services()) {
+        if (service.get() == &myAcceptor->get_io_service())
+          continue;
+        auto shard = std::make_shared<boost::asio::ip::tcp::acceptor>(*service);
+        shard->open(endpoint.protocol());
+        shard->set_option(reuse);
+        shard->set_option(reuse_port(true));
+        steerToWorker(myScheduler, *shard);
+        shard->bind(endpoint);
+        shard->listen(maxConnections);
+        myShards.push_back(shard);
+      }
+    }
+#endif
+    beginAccept(context, thisObject, myAcceptor);
+    for (auto & shard : myShards)
+      beginAccept(context, thisObject, shard);
   } catch(const std::exception & e) {
     JSWrapException(ctx, e, exception);
   }
   return thisObject;
 }
 
+void NX::Classes::Net::TCP::Acceptor::close()
+{
+  if (myClosed.exchange(true))
+    return;
+  // each listener is closed on its own reactor, which cancels the accept pending there
+  std::vector<std::shared_ptr<boost::asio::ip::tcp::acceptor>> listeners(myShards);
+  listeners.push_back(myAcceptor);
+  for (auto & listener : listeners)
+    listener->get_io_service().post([listener] {
+      boost::system::error_code ec;
+      listener->close(ec);
+    });
+  myHolder.reset();
+}
+
 void NX::Classes::Net::TCP::Acceptor::beginAccept(NX::Context * context, const NX::Object & thisObject)
 {
-  auto socket = std::make_shared<boost::asio::ip::tcp::socket>(*myScheduler->service());
-  myAcceptor->async_accept(*socket, std::bind(&Acceptor::handleAccept, this, context,
-                                              NX::Object(context->toJSContext(), thisObject), socket, false, std::placeholders::_1));
+  // completions run on the reactor that owns the listener, so re-arm the one belonging to this thread
+  beginAccept(context, thisObject, acceptorFor(*myScheduler->service()));
+}
+
+void NX::Classes::Net::TCP::Acceptor::beginAccept(NX::Context * context, const NX::Object & thisObject,
+                                                  const std::shared_ptr<boost::asio::ip::tcp::acceptor> & acceptor)
+{
+  if (myClosed)
+    return;
+  // keep the connection on the same reactor as the listener that accepted it
+  auto socket = std::make_shared<boost::asio::ip::tcp::socket>(acceptor->get_io_service());
+  acceptor->async_accept(*socket, std::bind(&Acceptor::handleAccept, this, context,
+                                            NX::Object(context->toJSContext(), thisObject), socket, false, std::placeholders::_1));
+}
+
+std::shared_ptr<boost::asio::ip::tcp::acceptor> NX::Classes::Net::TCP::Acceptor::acceptorFor(boost::asio::io_service & service)
+{
+  for (auto & shard : myShards) {
+    if (&shard->get_io_service() == &service)
+      return shard;
+  }
+  return myAcceptor;
 }
 
 void NX::Classes::Net::TCP::Acceptor::handleAccept(NX::Context* context, const NX::Object & thisObject,
@@ -119,9 +213,11 @@ void NX::Classes::Net::TCP::Acceptor::handleAccept(NX::Context* context, const N
   if (!continuation) {
     beginAccept(context, thisObject);
   }
+  if (error == boost::system::errc::operation_canceled && myClosed)
+    return;
   if (error) {
     JSValueRef args[] { NX::Object(context->toJSContext(), error )};
-    emitFastAndSchedule(context->toJSContext(), thisObject, "error", 1, args, nullptr);
+    emitFastAndSchedule(context->toJSContext(), thisObject, Atom::Error, 1, args, nullptr);
   }
   NX::Object thisObj(myThisObject);
   if (socket->is_open()) {
@@ -139,7 +235,7 @@ void NX::Classes::Net::TCP::Acceptor::handleAccept(NX::Context* context, const N
       thisObj
     };
     JSValueRef exception = nullptr;
-    emitFastAndSchedule(context->toJSContext(), thisObj, "connection", 3, arguments, &exception);
+    emitFastAndSchedule(context->toJSContext(), thisObj, Atom::Connection, 3, arguments, &exception);
     if (exception) {
       NX::Nexus::ReportException(context->toJSContext(), exception);
     }
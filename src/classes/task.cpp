@@ -65,22 +65,22 @@ JSObjectRef NX::Classes::Task::wrapTask (JSContextRef ctx, NX::AbstractTask * ta
   auto completionHandler = [=]{
     if (dynamic_cast<NX::CoroutineTask*>(task)) {
       context->nexus()->scheduler()->scheduleTask([=] {
-        wrapper->emitFast(context->toJSContext(), ret, "completed", 0, nullptr, nullptr);
+        wrapper->emitFast(context->toJSContext(), ret, NX::Classes::Emitter::Atom::Completed, 0, nullptr, nullptr);
         handler();
       });
     } else {
-      wrapper->emitFast(context->toJSContext(), ret, "completed", 0, nullptr, nullptr);
+      wrapper->emitFast(context->toJSContext(), ret, NX::Classes::Emitter::Atom::Completed, 0, nullptr, nullptr);
       handler();
     }
   };
   auto cancellationHandler = [=]{
     if (dynamic_cast<NX::CoroutineTask*>(task)) {
       context->nexus()->scheduler()->scheduleTask([=] {
-        wrapper->emitFast(context->toJSContext(), ret, "aborted", 0, nullptr, nullptr);
+        wrapper->emitFast(context->toJSContext(), ret, NX::Classes::Emitter::Atom::Aborted, 0, nullptr, nullptr);
         handler();
       });
     } else {
-      wrapper->emitFast(context->toJSContext(), ret, "aborted", 0, nullptr, nullptr);
+      wrapper->emitFast(context->toJSContext(), ret, NX::Classes::Emitter::Atom::Aborted, 0, nullptr, nullptr);
       handler();
     }
   };
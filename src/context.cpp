@@ -24,8 +24,10 @@
 #include "global_object.h"
 //#include "globals/global.h"
 #include "scoped_string.h"
+#include "scheduler.h"
 
 #include <JavaScriptCore/API/APICast.h>
+#include <JavaScriptCore/API/JSContextRefPrivate.h>
 #include <JavaScriptCore/parser/SourceCode.h>
 #include <JavaScriptCore/parser/UnlinkedSourceCode.h>
 #include <JavaScriptCore/runtime/Completion.h>
@@ -81,14 +83,48 @@ NX::Context::~Context() {
   }
 }
 
+namespace {
+  // called by the VM's watchdog once a script has held the CPU for the budget since entering the VM
+  bool taskBudgetExceeded(JSContextRef ctx, void * data) {
+    NX::Scheduler * scheduler = static_cast<NX::Nexus*>(data)->scheduler();
+    const std::int64_t runTime = scheduler->currentTaskRunTime();
+    // the watchdog only restarts on the outermost VM entry; this task may have been entered since
+    if (runTime < std::chrono::duration_cast<std::chrono::nanoseconds>(scheduler->taskBudget()).count())
+      return false;
+    NX::Scheduler::OverBudgetTask task { NX::Value(ctx, JSContextCreateBacktrace(ctx, 32)).toString(), runTime,
+                                         NX::Scheduler::OverBudgetTask::REPORTED };
+    if (scheduler->canYield()) {
+      task.action = NX::Scheduler::OverBudgetTask::YIELDED;
+      scheduler->reportOverBudget(std::move(task));
+      try {
+        // let other threads into the VM while this coroutine waits for its next turn
+        JSC::JSLock::DropAllLocks dropper(toJS(ctx)->vm());
+        scheduler->yield();
+      } catch(const std::exception &) {
+        // the task was aborted while it was off the CPU
+        return true;
+      }
+      return false;
+    }
+    if (scheduler->abortOverBudget())
+      task.action = NX::Scheduler::OverBudgetTask::ABORTED;
+    scheduler->reportOverBudget(std::move(task));
+    return scheduler->abortOverBudget();
+  }
+}
+
 NX::Context::Context(NX::Context *parent, NX::Nexus *nx):
   myParent(parent), myNexus(nx), myVM(std::move(parent ? parent->myVM.copyRef() : JSC::VM::createContextGroup(LargeHeap))),
-  myGlobal(nullptr), myGlobals()
+  myGlobal(nullptr), myGlobals(), myMicrotasksMutex(), myMicrotasks(), myMicrotaskDrainScheduled(false)
 {
   if (parent && !myNexus)
     myNexus = parent->myNexus;
   myNexus->scheduler()->scheduleThreadInitTask([=] { registerThread(); });
   myGlobal = createGlobalObject();
+  // child contexts share the VM, and with it the watchdog
+  auto budget = myNexus->scheduler()->taskBudget();
+  if (!parent && budget.count())
+    JSContextGroupSetExecutionTimeLimit(toRef(myVM.ptr()), budget.count() / 1e6, &taskBudgetExceeded, myNexus);
 }
 
 JSC::JSGlobalObject * NX::Context::createGlobalObject() {
@@ -163,6 +199,50 @@ std::size_t NX::Context::garbageCollect() {
   return vm.heap.sizeAfterLastFullCollection();
 }
 
+void NX::Context::queueMicrotask(WTF::Ref<JSC::Microtask> && task) {
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> lock(myMicrotasksMutex);
+    myMicrotasks.push_back(&task.leakRef());
+    schedule = !myMicrotaskDrainScheduled;
+    myMicrotaskDrainScheduled = true;
+  }
+  if (schedule)
+    myNexus->scheduler()->scheduleTask([this] { drainMicrotasks(); });
+}
+
+void NX::Context::drainMicrotasks() {
+  const std::size_t budget = myNexus->microtaskBudget();
+  auto exec = myGlobal->globalExec();
+  // one lock acquisition for the whole batch, reactions queued while it runs join the same drain
+  JSC::JSLockHolder lock(exec);
+  std::deque<JSC::Microtask*> batch;
+  std::size_t ran = 0;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> guard(myMicrotasksMutex);
+      if (!batch.empty()) {
+        // over budget, what's left goes back in front of anything queued meanwhile
+        myMicrotasks.insert(myMicrotasks.begin(), batch.begin(), batch.end());
+        break;
+      }
+      if (myMicrotasks.empty()) {
+        myMicrotaskDrainScheduled = false;
+        return;
+      }
+      batch.swap(myMicrotasks);
+    }
+    while (!batch.empty() && (!budget || ran < budget)) {
+      JSC::Microtask * task = batch.front();
+      batch.pop_front();
+      task->run(exec);
+      task->deref();
+      ran++;
+    }
+  }
+  myNexus->scheduler()->scheduleTask([this] { drainMicrotasks(); });
+}
+
 void NX::Context::registerThread() {
   if (myVM.ptr())
     myVM->heap.machineThreads().addCurrentThread();
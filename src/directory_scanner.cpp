@@ -0,0 +1,357 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "directory_scanner.h"
+#include "scheduler.h"
+
+#include <boost/asio/error.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+  // the kernel's record, glibc only wraps it from 2.30 on
+  struct Dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+  };
+
+  const std::size_t DirentBufferSize = 64 * 1024;
+
+  boost::filesystem::file_type typeFromMode(mode_t mode) {
+    if (S_ISREG(mode)) return boost::filesystem::regular_file;
+    if (S_ISDIR(mode)) return boost::filesystem::directory_file;
+    if (S_ISLNK(mode)) return boost::filesystem::symlink_file;
+    if (S_ISBLK(mode)) return boost::filesystem::block_file;
+    if (S_ISCHR(mode)) return boost::filesystem::character_file;
+    if (S_ISFIFO(mode)) return boost::filesystem::fifo_file;
+    if (S_ISSOCK(mode)) return boost::filesystem::socket_file;
+    return boost::filesystem::type_unknown;
+  }
+
+  boost::filesystem::file_type typeFromDirent(unsigned char type) {
+    switch (type) {
+      case DT_REG: return boost::filesystem::regular_file;
+      case DT_DIR: return boost::filesystem::directory_file;
+      case DT_LNK: return boost::filesystem::symlink_file;
+      case DT_BLK: return boost::filesystem::block_file;
+      case DT_CHR: return boost::filesystem::character_file;
+      case DT_FIFO: return boost::filesystem::fifo_file;
+      case DT_SOCK: return boost::filesystem::socket_file;
+      default: return boost::filesystem::status_unknown;
+    }
+  }
+
+#ifdef STATX_BASIC_STATS
+  std::atomic_bool statxMissing(false);
+#endif
+
+  // fills in everything but the path; false (with the type set to file_not_found) if there's nothing there
+  // only a missing path is file_not_found, permissions, loops and the like are errors like boost reports them
+  bool failed(int error, NX::DirectoryScanner::Entry & entry) {
+    if (error == ENOENT || error == ENOTDIR) {
+      entry.type = boost::filesystem::file_not_found;
+    } else {
+      entry.type = boost::filesystem::status_error;
+      entry.error = boost::system::error_code(error, boost::system::system_category());
+    }
+    return false;
+  }
+
+  bool statAt(int directory, const char * name, bool follow, NX::DirectoryScanner::Entry & entry) {
+    entry.statted = true;
+#ifdef STATX_BASIC_STATS
+    if (!statxMissing) {
+      // only what we report, which spares network filesystems a round trip for the rest
+      struct statx info;
+      if (!::statx(directory, name, (follow ? 0 : AT_SYMLINK_NOFOLLOW) | AT_NO_AUTOMOUNT,
+                   STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME, &info)) {
+        entry.type = typeFromMode(info.stx_mode);
+        entry.permissions = static_cast<boost::filesystem::perms>(info.stx_mode & 07777);
+        entry.size = info.stx_size;
+        entry.lastModified = static_cast<std::time_t>(info.stx_mtime.tv_sec);
+        return true;
+      }
+      if (errno == ENOSYS)
+        statxMissing.store(true);
+      else
+        return failed(errno, entry);
+    }
+#endif
+    struct stat info;
+    if (::fstatat(directory, name, &info, follow ? 0 : AT_SYMLINK_NOFOLLOW))
+      return failed(errno, entry);
+    entry.type = typeFromMode(info.st_mode);
+    entry.permissions = static_cast<boost::filesystem::perms>(info.st_mode & 07777);
+    entry.size = static_cast<std::uint64_t>(info.st_size);
+    entry.lastModified = info.st_mtime;
+    return true;
+  }
+
+  std::vector<std::string> segments(const std::string & path) {
+    std::vector<std::string> result;
+    std::size_t start = 0;
+    while (start <= path.size()) {
+      std::size_t end = path.find('/', start);
+      if (end == std::string::npos)
+        end = path.size();
+      if (end > start)
+        result.emplace_back(path, start, end - start);
+      start = end + 1;
+    }
+    return result;
+  }
+
+  bool segmentMatches(const std::string & pattern, const std::string & name) {
+    return !::fnmatch(pattern.c_str(), name.c_str(), FNM_PERIOD);
+  }
+
+  // like the shells, '**' doesn't wander into hidden directories, an explicit '.name' segment still can
+  bool matchFrom(const std::vector<std::string> & pattern, std::size_t pi,
+                 const std::vector<std::string> & path, std::size_t pj) {
+    if (pi == pattern.size())
+      return pj == path.size();
+    if (pattern[pi] == "**")
+      return matchFrom(pattern, pi + 1, path, pj) ||
+             (pj < path.size() && path[pj][0] != '.' && matchFrom(pattern, pi, path, pj + 1));
+    return pj < path.size() && segmentMatches(pattern[pi], path[pj]) && matchFrom(pattern, pi + 1, path, pj + 1);
+  }
+
+  bool prefixFrom(const std::vector<std::string> & pattern, std::size_t pi,
+                  const std::vector<std::string> & path, std::size_t pj) {
+    if (pj == path.size())
+      return pi < pattern.size();
+    if (pi == pattern.size())
+      return false;
+    if (pattern[pi] == "**")
+      return prefixFrom(pattern, pi + 1, path, pj) || (path[pj][0] != '.' && prefixFrom(pattern, pi, path, pj + 1));
+    return segmentMatches(pattern[pi], path[pj]) && prefixFrom(pattern, pi + 1, path, pj + 1);
+  }
+}
+
+std::pair<std::string, std::string> NX::DirectoryScanner::splitGlob(const std::string & glob)
+{
+  // with no wildcards at all, the last segment is the pattern and it just has to exist
+  std::size_t cut = glob.rfind('/', glob.find_first_of("*?["));
+  if (cut == std::string::npos)
+    return std::make_pair(std::string("."), glob);
+  if (cut == 0)
+    return std::make_pair(std::string("/"), glob.substr(1));
+  return std::make_pair(glob.substr(0, cut), glob.substr(cut + 1));
+}
+
+bool NX::DirectoryScanner::match(const std::string & pattern, const std::string & path)
+{
+  return matchFrom(segments(pattern), 0, segments(path), 0);
+}
+
+bool NX::DirectoryScanner::mayMatchBelow(const std::string & pattern, const std::string & directory)
+{
+  return prefixFrom(segments(pattern), 0, segments(directory), 0);
+}
+
+NX::DirectoryScanner::DirectoryScanner(NX::Scheduler * scheduler, const std::string & root, const Options & options,
+                                       BatchHandler onBatch, CompletionHandler onComplete):
+  myScheduler(scheduler), myRoot(root.empty() ? "." : root), myOptions(options), myOnBatch(std::move(onBatch)),
+  myOnComplete(std::move(onComplete)), myPending(0), myDelivered(0), myCancelled(false), myMutex(), myQueue(),
+  myDraining(false), myFinished(false), myCompleted(false), myError()
+{
+}
+
+std::shared_ptr<NX::DirectoryScanner> NX::DirectoryScanner::scan(NX::Scheduler * scheduler, const std::string & root,
+                                                                 const Options & options, BatchHandler onBatch,
+                                                                 CompletionHandler onComplete)
+{
+  auto scanner = std::make_shared<DirectoryScanner>(scheduler, root, options, std::move(onBatch),
+                                                    std::move(onComplete));
+  scanner->myPending = 1;
+  scheduler->scheduleBlocking([scanner]() { scanner->scanDirectory(std::string()); });
+  return scanner;
+}
+
+void NX::DirectoryScanner::scanDirectory(const std::string & relative)
+{
+  const bool root = relative.empty();
+  int fd = myCancelled ? -1 : ::open((root ? myRoot : myRoot + "/" + relative).c_str(),
+                                     O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    // a subdirectory we can't read is skipped, like find does, only the root failing fails the scan
+    if (root && !myCancelled) {
+      std::lock_guard<std::mutex> lock(myMutex);
+      myError = boost::system::error_code(errno, boost::system::system_category());
+    }
+    return leave();
+  }
+  std::unique_ptr<char[]> buffer(new char[DirentBufferSize]);
+  Batch batch;
+  while (!myCancelled) {
+    long read = ::syscall(SYS_getdents64, fd, buffer.get(), DirentBufferSize);
+    if (read < 0 && errno == EINTR)
+      continue;
+    if (read < 0 && root) {
+      std::lock_guard<std::mutex> lock(myMutex);
+      myError = boost::system::error_code(errno, boost::system::system_category());
+    }
+    if (read <= 0)
+      break;
+    for (long position = 0; position < read && !myCancelled;) {
+      auto * record = reinterpret_cast<Dirent64 *>(buffer.get() + position);
+      position += record->d_reclen;
+      const char * name = record->d_name;
+      if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+        continue;
+      Entry entry { root ? std::string(name) : relative + "/" + name, typeFromDirent(record->d_type), false, 0, 0,
+                    boost::filesystem::perms_not_known, boost::system::error_code() };
+      // some filesystems leave the type out of the listing
+      if (myOptions.stat || entry.type == boost::filesystem::status_unknown) {
+        if (!statAt(fd, name, false, entry))
+          continue; // gone since it was listed, or not ours to look at
+      }
+      const bool descend = myOptions.recursive && entry.type == boost::filesystem::directory_file &&
+                           (myOptions.pattern.empty() || mayMatchBelow(myOptions.pattern, entry.path));
+      if (descend) {
+        auto self = shared_from_this();
+        std::string child = entry.path;
+        myPending++;
+        myScheduler->scheduleBlocking([self, child]() { self->scanDirectory(child); });
+      }
+      if (myOptions.pattern.empty() || match(myOptions.pattern, entry.path)) {
+        batch.push_back(std::move(entry));
+        if (batch.size() >= myOptions.batchSize) {
+          deliver(std::move(batch), false);
+          batch = Batch();
+        }
+      }
+    }
+  }
+  ::close(fd);
+  if (!batch.empty())
+    deliver(std::move(batch), false);
+  leave();
+}
+
+void NX::DirectoryScanner::leave()
+{
+  if (--myPending == 0)
+    deliver(Batch(), true);
+}
+
+void NX::DirectoryScanner::deliver(Batch && batch, bool last)
+{
+  {
+    std::lock_guard<std::mutex> lock(myMutex);
+    // small directories' batches are topped up while they wait, rather than each costing a handler call
+    if (!myQueue.empty() && myQueue.back().size() + batch.size() <= myOptions.batchSize)
+      std::move(batch.begin(), batch.end(), std::back_inserter(myQueue.back()));
+    else if (!batch.empty())
+      myQueue.push_back(std::move(batch));
+    if (last)
+      myFinished = true;
+    if (myDraining)
+      return;
+    myDraining = true;
+  }
+  auto self = shared_from_this();
+  myScheduler->scheduleTask([self]() { self->drain(); });
+}
+
+void NX::DirectoryScanner::drain()
+{
+  for (;;) {
+    Batch batch;
+    boost::system::error_code error;
+    bool idle = false, complete = false;
+    {
+      std::lock_guard<std::mutex> lock(myMutex);
+      if (myCancelled)
+        myQueue.clear();
+      if (myQueue.empty()) {
+        idle = true;
+        myDraining = false;
+        if (myFinished && !myCompleted) {
+          complete = myCompleted = true;
+          error = myCancelled ? boost::asio::error::operation_aborted : myError;
+        }
+      } else {
+        batch = std::move(myQueue.front());
+        myQueue.pop_front();
+      }
+    }
+    if (complete) {
+      // the handlers hold script objects, let them go as soon as they're done
+      CompletionHandler onComplete = std::move(myOnComplete);
+      myOnBatch = BatchHandler();
+      onComplete(error, myDelivered);
+    }
+    if (idle)
+      return;
+    myDelivered += batch.size();
+    if (!myOnBatch(std::move(batch)))
+      cancel();
+  }
+}
+
+void NX::DirectoryScanner::statMany(NX::Scheduler * scheduler, std::vector<std::string> paths, StatHandler onComplete)
+{
+  struct State {
+    std::vector<std::string> paths;
+    Batch results;
+    std::atomic_size_t remaining;
+    StatHandler onComplete;
+  };
+  auto state = std::make_shared<State>();
+  state->paths = std::move(paths);
+  state->results.resize(state->paths.size());
+  state->onComplete = std::move(onComplete);
+  const std::size_t chunks = (state->paths.size() + StatChunkSize - 1) / StatChunkSize;
+  state->remaining = chunks;
+  if (!chunks) {
+    scheduler->scheduleTask([state]() { state->onComplete(Batch()); });
+    return;
+  }
+  for (std::size_t chunk = 0; chunk < chunks; chunk++) {
+    scheduler->scheduleBlocking([scheduler, state, chunk]() {
+      const std::size_t end = std::min(state->paths.size(), (chunk + 1) * StatChunkSize);
+      for (std::size_t i = chunk * StatChunkSize; i < end; i++) {
+        Entry & entry = state->results[i];
+        entry = Entry { state->paths[i], boost::filesystem::file_not_found, false, 0, 0,
+                        boost::filesystem::perms_not_known, boost::system::error_code() };
+        statAt(AT_FDCWD, state->paths[i].c_str(), true, entry);
+      }
+      // one task for the lot once the last chunk is in
+      if (--state->remaining == 0)
+        scheduler->scheduleTask([state]() {
+          // the handler may hold script objects, so it has to be let go of here and not on a lane thread
+          StatHandler onComplete = std::move(state->onComplete);
+          onComplete(std::move(state->results));
+        });
+    });
+  }
+}
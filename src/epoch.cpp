@@ -0,0 +1,129 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "epoch.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace {
+  struct Retired {
+    void * object;
+    void (*deleter)(void *);
+    std::uint64_t epoch;
+  };
+
+  // 0 marks an idle record, so counting starts at 1
+  std::atomic<std::uint64_t> globalEpoch(1);
+  std::atomic<std::size_t> retiredCount(0);
+  boost::mutex retiredMutex;
+  std::deque<Retired> retired;
+
+  // guard releases per thread between collections while something is pending
+  const std::size_t CollectInterval = 64;
+}
+
+std::atomic<NX::Epoch::Record*> NX::Epoch::myRecords(nullptr);
+thread_local NX::Epoch::Record * NX::Epoch::myLastRecord = nullptr;
+
+NX::Epoch::Record * NX::Epoch::acquire()
+{
+  bool expected = false;
+  if (myLastRecord && myLastRecord->used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+    return myLastRecord;
+  for (Record * record = myRecords.load(std::memory_order_acquire); record; record = record->next) {
+    expected = false;
+    if (record->used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+      return myLastRecord = record;
+  }
+  Record * record = new Record();
+  record->epoch.store(0, std::memory_order_relaxed);
+  record->used.store(true, std::memory_order_relaxed);
+  record->next = myRecords.load(std::memory_order_relaxed);
+  while (!myRecords.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+  return myLastRecord = record;
+}
+
+NX::Epoch::Guard::Guard(): myRecord(acquire())
+{
+  // the announced epoch has to be current once it is visible, or an advance could slip past it
+  std::uint64_t epoch, current = globalEpoch.load(std::memory_order_seq_cst);
+  do {
+    epoch = current;
+    myRecord->epoch.store(epoch, std::memory_order_seq_cst);
+  } while ((current = globalEpoch.load(std::memory_order_seq_cst)) != epoch);
+}
+
+NX::Epoch::Guard::~Guard()
+{
+  myRecord->epoch.store(0, std::memory_order_release);
+  myRecord->used.store(false, std::memory_order_release);
+  // retire() collects on its own; this only mops up what the readers held back, and not on every release
+  static thread_local std::size_t releases = 0;
+  if (retiredCount.load(std::memory_order_relaxed) && ++releases % CollectInterval == 0)
+    collect();
+}
+
+bool NX::Epoch::tryAdvance()
+{
+  std::uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+  for (Record * record = myRecords.load(std::memory_order_acquire); record; record = record->next) {
+    const std::uint64_t seen = record->epoch.load(std::memory_order_seq_cst);
+    if (seen && seen != epoch)
+      return false;
+  }
+  return globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+}
+
+void NX::Epoch::retire(void * object, void (*deleter)(void *))
+{
+  {
+    boost::mutex::scoped_lock lock(retiredMutex);
+    retired.push_back(Retired { object, deleter, globalEpoch.load(std::memory_order_seq_cst) });
+    retiredCount.store(retired.size(), std::memory_order_relaxed);
+  }
+  collect();
+}
+
+void NX::Epoch::collect()
+{
+  tryAdvance();
+  std::vector<Retired> expired;
+  {
+    boost::mutex::scoped_lock lock(retiredMutex, boost::try_to_lock);
+    if (!lock.owns_lock())
+      return;
+    // a reader may still be inside the epoch an object was retired in or the one right after
+    const std::uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+    while (!retired.empty() && retired.front().epoch + 2 <= epoch) {
+      expired.push_back(retired.front());
+      retired.pop_front();
+    }
+    retiredCount.store(retired.size(), std::memory_order_relaxed);
+  }
+  for (auto & item : expired)
+    item.deleter(item.object);
+}
+
+std::size_t NX::Epoch::pending()
+{
+  return retiredCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,140 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_watcher.h"
+#include "scheduler.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+NX::FileWatcher::FileWatcher(NX::Scheduler * scheduler, boost::asio::io_service & service):
+  myScheduler(scheduler), myFd(-1), myEvents(service), myBuffer(64 * (sizeof(inotify_event) + NAME_MAX + 1)),
+  myMutex(), myWatches(), myDescriptors(), myNextHandle(1)
+{
+  myFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (myFd < 0)
+    return;
+  myEvents.assign(myFd);
+  arm();
+}
+
+NX::FileWatcher::~FileWatcher()
+{
+  if (myFd < 0)
+    return;
+  boost::system::error_code ignored;
+  myEvents.close(ignored);
+}
+
+NX::FileWatcher::Handle NX::FileWatcher::watch(const std::string & path, std::uint32_t mask, Listener listener)
+{
+  if (myFd < 0)
+    throw NX::Exception("inotify is not available");
+  std::lock_guard<std::recursive_mutex> lock(myMutex);
+  // the kernel keeps one watch per inode and fd, so masks are merged rather than replaced
+  int descriptor = inotify_add_watch(myFd, path.c_str(), mask | IN_MASK_ADD);
+  if (descriptor < 0)
+    throw NX::Exception("could not watch '" + path + "': " + std::strerror(errno));
+  Handle handle = myNextHandle++;
+  myWatches.emplace(handle, Watch { descriptor, mask, std::move(listener) });
+  myDescriptors.emplace(descriptor, handle);
+  myScheduler->hold();
+  return handle;
+}
+
+void NX::FileWatcher::unwatch(Handle handle)
+{
+  std::lock_guard<std::recursive_mutex> lock(myMutex);
+  auto watch = myWatches.find(handle);
+  if (watch != myWatches.end())
+    remove(watch, false);
+}
+
+void NX::FileWatcher::remove(std::map<Handle, Watch>::iterator watch, bool kernel)
+{
+  const int descriptor = watch->second.descriptor;
+  auto range = myDescriptors.equal_range(descriptor);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == watch->first) {
+      myDescriptors.erase(it);
+      break;
+    }
+  }
+  myWatches.erase(watch);
+  // the last one out takes the kernel watch down with it, unless the kernel already did
+  if (!kernel && !myDescriptors.count(descriptor))
+    inotify_rm_watch(myFd, descriptor);
+  myScheduler->release();
+}
+
+void NX::FileWatcher::arm()
+{
+  auto self = this;
+  myEvents.async_read_some(boost::asio::buffer(myBuffer),
+    [self](const boost::system::error_code & error, std::size_t length) {
+      if (error)
+        return;
+      self->dispatch(length);
+      self->arm();
+    });
+}
+
+void NX::FileWatcher::dispatch(std::size_t length)
+{
+  std::lock_guard<std::recursive_mutex> lock(myMutex);
+  for (std::size_t position = 0; position + sizeof(inotify_event) <= length;) {
+    auto * record = reinterpret_cast<const inotify_event *>(myBuffer.data() + position);
+    position += sizeof(inotify_event) + record->len;
+    Event event { record->mask, record->cookie, record->len ? std::string(record->name) : std::string() };
+    // an overflow isn't tied to any watch, everyone has to hear about it
+    std::vector<Handle> handles;
+    if (record->wd < 0) {
+      for (auto & watch : myWatches)
+        handles.push_back(watch.first);
+    } else {
+      auto range = myDescriptors.equal_range(record->wd);
+      for (auto it = range.first; it != range.second; ++it)
+        handles.push_back(it->second);
+    }
+    for (Handle handle : handles) {
+      auto watch = myWatches.find(handle);
+      // an earlier listener may have removed it
+      if (watch == myWatches.end())
+        continue;
+      if (event.mask & (watch->second.mask | IN_IGNORED | IN_Q_OVERFLOW | IN_UNMOUNT)) {
+        // a copy, the listener may well unwatch itself
+        Listener listener = watch->second.listener;
+        try {
+          listener(event);
+        } catch(...) {
+          // a throwing listener must not take the reactor (and the other watches) down with it
+        }
+      }
+      if (event.mask & IN_IGNORED) {
+        watch = myWatches.find(handle);
+        if (watch != myWatches.end())
+          remove(watch, true);
+      }
+    }
+  }
+}
@@ -89,15 +89,7 @@ const GlobalObjectMethodTable NX::GlobalObject::s_NXGlobalObjectMethodTable = {
 
 void NX::GlobalObject::queueTaskToEventLoop(JSC::JSGlobalObject &global, Ref<JSC::Microtask> &&task) {
   auto & globalObject = reinterpret_cast<JSCallbackObject<NX::GlobalObject>&>(global);
-  auto &t = task.leakRef();
-  globalObject.nexus()->scheduler()->scheduleTask(
-    [&]() {
-      auto exec = global.globalExec();
-      JSC::JSLockHolder lock(globalObject.globalExec());
-      t.run(exec);
-      t.deref();
-    }
-  );
+  reinterpret_cast<NX::Context*>(globalObject.getPrivate())->queueMicrotask(std::move(task));
 }
 
 NX::GlobalObject::GlobalObject(JSC::VM &vm, JSC::Structure *structure) :
@@ -493,7 +485,9 @@ void NX::GlobalObject::promiseRejectionTracker(JSGlobalObject *jsGlobalObject, E
 //  }
 //  auto &globalObject = *JSC::jsCast<JSCallbackObject<NX::GlobalObject> *>(jsGlobalObject);
   auto result = promise->result(vm);
-  NX::Nexus::ReportException(toRef(exec), toRef(exec, result));
+  // a handler attached after the fact takes the rejection back off the books
+  NX::Nexus::ReportRejection(toRef(exec), promise, toRef(exec, result),
+                             operation == JSPromiseRejectionOperation::Handle);
 }
 
 JSValue
@@ -21,10 +21,116 @@
 #include "context.h"
 #include "object.h"
 #include "globals/filesystem.h"
+#include "directory_scanner.h"
+#include "scheduler.h"
 
 #include <boost/filesystem.hpp>
 #include <globals/promise.h>
 
+namespace {
+  typedef NX::DirectoryScanner::Entry Entry;
+
+  // the same shape stat() has always resolved to, plus the size
+  JSObjectRef statObject(JSContextRef ctx, const Entry & entry) {
+    NX::Object stats(ctx);
+    stats.set("type", JSValueMakeNumber(ctx, entry.type));
+    if (entry.statted && !entry.error && entry.type != boost::filesystem::file_not_found) {
+      stats.set("permissions", JSValueMakeNumber(ctx, entry.permissions));
+      stats.set("lastModified", NX::Object(ctx, entry.lastModified).value());
+      stats.set("size", JSValueMakeNumber(ctx, static_cast<double>(entry.size)));
+    }
+    if (entry.error)
+      stats.set("error", NX::Value(ctx, entry.error.message()).value());
+    return stats.value();
+  }
+
+  std::string joinPath(const std::string & root, const std::string & relative) {
+    if (root == ".")
+      return relative;
+    boost::filesystem::path path(root);
+    path /= relative;
+    return path.string();
+  }
+
+  // the array is on the stack while it fills up, which keeps what's already in it alive
+  JSObjectRef entriesArray(JSContextRef ctx, const std::vector<Entry> & entries, const std::string & root, bool names) {
+    JSObjectRef array = JSObjectMakeArray(ctx, 0, nullptr, nullptr);
+    for (std::size_t i = 0; i < entries.size(); i++) {
+      JSObjectRef entry = statObject(ctx, entries[i]);
+      NX::Object(ctx, entry).set(names ? "name" : "path",
+                                 NX::Value(ctx, names ? entries[i].path : joinPath(root, entries[i].path)).value());
+      JSObjectSetPropertyAtIndex(ctx, array, static_cast<unsigned>(i), entry, nullptr);
+    }
+    return array;
+  }
+
+  /**
+   * Resolves to every entry, or with a callback, hands it the entries a batch at a time and resolves to the count.
+   */
+  JSValueRef scan(JSContextRef ctx, const std::string & root, const NX::DirectoryScanner::Options & options,
+                  JSObjectRef onBatch, bool names)
+  {
+    NX::Context * context = NX::Context::FromJsContext(ctx);
+    NX::Scheduler * scheduler = context->nexus()->scheduler();
+    NX::Object callback = onBatch ? NX::Object(ctx, onBatch) : NX::Object();
+    return NX::Globals::Promise::createPromise(ctx,
+      [=](JSContextRef ctx, NX::ResolveRejectHandler resolve, NX::ResolveRejectHandler reject) {
+        auto collected = std::make_shared<std::vector<Entry>>();
+        auto failure = std::make_shared<NX::Object>();
+        NX::DirectoryScanner::scan(scheduler, root, options,
+          [=](NX::DirectoryScanner::Batch && batch) -> bool {
+            if (!callback.value()) {
+              std::move(batch.begin(), batch.end(), std::back_inserter(*collected));
+              return true;
+            }
+            JSContextRef ctx = context->toJSContext();
+            JSValueRef exception = nullptr;
+            JSValueRef args[] { entriesArray(ctx, batch, root, names) };
+            callback.call(nullptr, 1, args, &exception);
+            if (exception) {
+              *failure = NX::Object(ctx, exception);
+              return false;
+            }
+            return true;
+          },
+          [=](const boost::system::error_code & error, std::size_t total) {
+            JSContextRef ctx = context->toJSContext();
+            if (failure->value())
+              reject(ctx, failure->value());
+            else if (error)
+              reject(ctx, NX::Object(ctx, error));
+            else if (callback.value())
+              resolve(ctx, JSValueMakeNumber(ctx, total));
+            else
+              resolve(ctx, entriesArray(ctx, *collected, root, names));
+          });
+      });
+  }
+
+  // walk() and glob() take (path, [onBatch], [options])
+  JSObjectRef batchCallback(JSContextRef ctx, std::size_t argumentCount, const JSValueRef arguments[]) {
+    if (argumentCount > 1 && JSValueIsObject(ctx, arguments[1]) &&
+        JSObjectIsFunction(ctx, JSValueToObject(ctx, arguments[1], nullptr)))
+      return JSValueToObject(ctx, arguments[1], nullptr);
+    return nullptr;
+  }
+
+  NX::DirectoryScanner::Options scanOptions(JSContextRef ctx, std::size_t argumentCount, const JSValueRef arguments[]) {
+    NX::DirectoryScanner::Options options;
+    std::size_t index = batchCallback(ctx, argumentCount, arguments) ? 2 : 1;
+    if (index >= argumentCount || !JSValueIsObject(ctx, arguments[index]))
+      return options;
+    NX::Object object(ctx, arguments[index]);
+    if (!JSValueIsUndefined(ctx, object["stat"]->value()))
+      options.stat = object["stat"]->toBoolean();
+    if (!JSValueIsUndefined(ctx, object["recursive"]->value()))
+      options.recursive = object["recursive"]->toBoolean();
+    if (!JSValueIsUndefined(ctx, object["batchSize"]->value()))
+      options.batchSize = std::max<std::size_t>(1, static_cast<std::size_t>(object["batchSize"]->toNumber()));
+    return options;
+  }
+}
+
 JSValueRef NX::Globals::FileSystem::Get (JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef * exception)
 {
   NX::Context * context = Context::FromJsContext(ctx);
@@ -98,6 +204,7 @@ const JSStaticValue NX::Globals::FileSystem::Properties[] {
       modes.set("Socket",             JSValueMakeNumber(ctx, boost::filesystem::file_type::socket_file));
       modes.set("Symlink",            JSValueMakeNumber(ctx, boost::filesystem::file_type::symlink_file));
       modes.set("Unknown",            JSValueMakeNumber(ctx, boost::filesystem::file_type::type_unknown));
+      modes.set("StatusError",        JSValueMakeNumber(ctx, boost::filesystem::file_type::status_error));
       return context->setGlobal("Nexus.FileSystem.FileType", modes.value());
     }, nullptr, kJSPropertyAttributeNone
   },
@@ -108,22 +215,77 @@ const JSStaticFunction NX::Globals::FileSystem::Methods[] {
   { "stat", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
     size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
       NX::Context * context = Context::FromJsContext(ctx);
+      if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("path must be a string").toError(ctx));
+      std::vector<std::string> paths { NX::Value(ctx, arguments[0]).toString() };
+      NX::Scheduler * scheduler = context->nexus()->scheduler();
+      return NX::Globals::Promise::createPromise(ctx,
+        [=](JSContextRef ctx, NX::ResolveRejectHandler resolve, NX::ResolveRejectHandler reject) {
+          NX::DirectoryScanner::statMany(scheduler, paths, [=](NX::DirectoryScanner::Batch && results) {
+            // only a missing path resolves, anything else stopping the stat rejects like it always has
+            if (results.front().error)
+              reject(context->toJSContext(), NX::Object(context->toJSContext(), results.front().error));
+            else
+              resolve(context->toJSContext(), statObject(context->toJSContext(), results.front()));
+          });
+        });
+    }, 0
+  },
+  { "statMany", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      NX::Context * context = Context::FromJsContext(ctx);
+      std::vector<std::string> paths;
       try {
-        std::string filePath = NX::Value(ctx, arguments[0]).toString();
-        boost::filesystem::file_status stats = boost::filesystem::status(filePath);
-        boost::filesystem::perms perms = stats.permissions();
-        boost::filesystem::file_type type = stats.type();
-        NX::Object statsObj(ctx);
-        statsObj.set("type", NX::Value(ctx, type).value());
-        if (stats.type() != boost::filesystem::file_type::file_not_found) {
-          time_t lastMod = boost::filesystem::last_write_time(filePath);
-          statsObj.set("permissions", NX::Value(ctx, perms).value());
-          statsObj.set("lastModified", NX::Object(ctx, lastMod).value());
-        }
-        return NX::Globals::Promise::resolve(ctx, statsObj);
+        if (argumentCount < 1 || !JSValueIsObject(ctx, arguments[0]))
+          throw NX::Exception("paths must be an array");
+        NX::Object array(ctx, arguments[0]);
+        const std::size_t length = static_cast<std::size_t>(array["length"]->toNumber());
+        paths.reserve(length);
+        for (std::size_t i = 0; i < length; i++)
+          paths.push_back(array[static_cast<unsigned int>(i)]->toString());
       } catch(const std::exception & e) {
-        return NX::Globals::Promise::reject(ctx, NX::Object(context->toJSContext(), e));
+        return NX::Globals::Promise::reject(ctx, NX::Object(ctx, e));
       }
+      NX::Scheduler * scheduler = context->nexus()->scheduler();
+      return NX::Globals::Promise::createPromise(ctx,
+        [=](JSContextRef ctx, NX::ResolveRejectHandler resolve, NX::ResolveRejectHandler reject) {
+          NX::DirectoryScanner::statMany(scheduler, paths, [=](NX::DirectoryScanner::Batch && results) {
+            JSContextRef ctx = context->toJSContext();
+            JSObjectRef array = JSObjectMakeArray(ctx, 0, nullptr, nullptr);
+            for (std::size_t i = 0; i < results.size(); i++)
+              JSObjectSetPropertyAtIndex(ctx, array, static_cast<unsigned>(i), statObject(ctx, results[i]), nullptr);
+            resolve(ctx, array);
+          });
+        });
+    }, 0
+  },
+  { "readdir", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("path must be a string").toError(ctx));
+      NX::DirectoryScanner::Options options;
+      options.recursive = false;
+      if (argumentCount > 1 && JSValueIsObject(ctx, arguments[1]))
+        options.stat = NX::Object(ctx, arguments[1])["stat"]->toBoolean();
+      return scan(ctx, NX::Value(ctx, arguments[0]).toString(), options, nullptr, true);
+    }, 0
+  },
+  { "walk", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("path must be a string").toError(ctx));
+      return scan(ctx, NX::Value(ctx, arguments[0]).toString(), scanOptions(ctx, argumentCount, arguments),
+                  batchCallback(ctx, argumentCount, arguments), false);
+    }, 0
+  },
+  { "glob", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeString)
+        return NX::Globals::Promise::reject(ctx, NX::Exception("pattern must be a string").toError(ctx));
+      auto split = NX::DirectoryScanner::splitGlob(NX::Value(ctx, arguments[0]).toString());
+      NX::DirectoryScanner::Options options = scanOptions(ctx, argumentCount, arguments);
+      options.pattern = split.second;
+      return scan(ctx, split.first, options, batchCallback(ctx, argumentCount, arguments), false);
     }, 0
   },
   { "join", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
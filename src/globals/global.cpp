@@ -21,6 +21,7 @@
 #include "value.h"
 #include "task.h"
 #include "scoped_string.h"
+#include "util.h"
 
 #include "globals/global.h"
 #include "globals/console.h"
@@ -37,6 +38,9 @@
 
 #include <boost/thread/pthread/mutex.hpp>
 
+#include <atomic>
+#include <memory>
+
 constexpr JSClassDefinition NX::Global::InitGlobalClass()
 {
   JSClassDefinition globalDef = kJSClassDefinitionEmpty;
@@ -46,69 +50,130 @@ constexpr JSClassDefinition NX::Global::InitGlobalClass()
   return globalDef;
 }
 
-boost::unordered_map<int, NX::AbstractTask *> globalTimeouts;
+namespace {
+  /**
+   * Pending setTimeout/setInterval timers by id. A repeating timer keeps its id and gets re-armed with a fresh
+   * task after every run; clearing erases the id, which is what stops a run that's already underway.
+   */
+  struct Timer {
+    Timer(JSContextRef ctx, JSObjectRef fun, std::size_t argumentCount, const JSValueRef arguments[]):
+      fun(ctx, fun), args(ctx, argumentCount, arguments), interval(), repeat(false), id(0) {}
+    NX::Object fun;
+    NX::ProtectedArguments args;
+    NX::Scheduler::duration interval;
+    bool repeat;
+    std::uint32_t id;
+  };
+
+  boost::mutex timersMutex;
+  boost::unordered_map<std::uint32_t, NX::AbstractTask *> timers;
+  std::atomic<std::uint32_t> nextTimerId(1);
+
+  void fireTimer(NX::Context * context, const std::shared_ptr<Timer> & timer);
+
+  NX::AbstractTask * armTimer(NX::Context * context, const std::shared_ptr<Timer> & timer) {
+    return context->nexus()->scheduler()->scheduleTask(timer->interval, [=]() { fireTimer(context, timer); });
+  }
+
+  void fireTimer(NX::Context * context, const std::shared_ptr<Timer> & timer) {
+    {
+      boost::mutex::scoped_lock lock(timersMutex);
+      auto it = timers.find(timer->id);
+      if (it == timers.end())
+        return;
+      if (!timer->repeat)
+        timers.erase(it);
+    }
+    JSValueRef exp = nullptr;
+    timer->fun.call(nullptr, timer->args, &exp);
+    if (exp) {
+      NX::Nexus::ReportException(context->toJSContext(), exp);
+    }
+    if (timer->repeat) {
+      boost::mutex::scoped_lock lock(timersMutex);
+      auto it = timers.find(timer->id);
+      if (it != timers.end())
+        it->second = armTimer(context, timer);
+    }
+  }
+
+  JSValueRef startTimer(JSContextRef ctx, size_t argumentCount, const JSValueRef arguments[], bool repeat,
+                        const char * name, JSValueRef * exception)
+  {
+    NX::Context * context = NX::Context::FromJsContext(ctx);
+    try {
+      if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeObject ||
+          !JSObjectIsFunction(ctx, JSValueToObject(ctx, arguments[0], nullptr)))
+        throw NX::Exception(std::string("invalid arguments passed to ") + name);
+      double delay = argumentCount > 1 ? NX::Value(ctx, arguments[1]).toNumber() : 0;
+      // NaN and negative delays mean "as soon as possible"; intervals get at least a tick so they can't spin
+      if (!(delay > 0))
+        delay = repeat ? 1 : 0;
+      auto timer = std::make_shared<Timer>(context->toJSContext(), JSValueToObject(ctx, arguments[0], nullptr),
+                                           argumentCount > 2 ? argumentCount - 2 : 0, argumentCount > 2 ? arguments + 2 : arguments);
+      timer->interval = boost::posix_time::microseconds(static_cast<std::int64_t>(delay * 1000));
+      timer->repeat = repeat;
+      boost::mutex::scoped_lock lock(timersMutex);
+      do {
+        timer->id = nextTimerId++;
+      } while (!timer->id || timers.count(timer->id));
+      timers[timer->id] = armTimer(context, timer);
+      return JSValueMakeNumber(ctx, timer->id);
+    } catch(const std::exception & e) {
+      return JSWrapException(ctx, e, exception);
+    }
+  }
+
+  JSValueRef stopTimer(JSContextRef ctx, size_t argumentCount, const JSValueRef arguments[], JSValueRef * exception)
+  {
+    NX::Context * context = NX::Context::FromJsContext(ctx);
+    try {
+      if (argumentCount < 1 || JSValueGetType(ctx, arguments[0]) != kJSTypeNumber)
+        return JSValueMakeUndefined(ctx);
+      auto id = static_cast<std::uint32_t>(NX::Value(ctx, arguments[0]).toNumber());
+      boost::mutex::scoped_lock lock(timersMutex);
+      auto it = timers.find(id);
+      if (it == timers.end())
+        return JSValueMakeUndefined(ctx);
+      // if the task already left the wheel it's running or about to, and will find its id gone
+      context->nexus()->scheduler()->cancelTimer(it->second);
+      timers.erase(it);
+    } catch(const std::exception & e) {
+      return JSWrapException(ctx, e, exception);
+    }
+    return JSValueMakeUndefined(ctx);
+  }
+}
 
 const JSStaticFunction NX::Global::GlobalFunctions[] {
-//  { "setTimeout",
-//    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
-//       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
-//    {
-//      NX::Context * context = Context::FromJsContext(ctx);
-//      NX::Nexus * nx = context->nexus();
-//      JSC::JSLockHolder lock(toJS(ctx));
-//      try {
-//        if (argumentCount < 2) {
-//          NX::Object exp(ctx, NX::Exception("invalid arguments passed to setTimeout"));
-//          *exception = exp.value();
-//          return JSValueMakeUndefined(ctx);
-//        }
-//        NX::Value timeout(ctx, arguments[1]);
-//        NX::ProtectedArguments saved (context->toJSContext(), 2, arguments);
-//        NX::ProtectedArguments args(context->toJSContext(), argumentCount - 2, arguments + 2);
-//        JSValueProtect(context->toJSContext(), arguments[0]);
-//        NX::AbstractTask * task = nx->scheduler()->scheduleTask(boost::posix_time::milliseconds((unsigned)timeout.toNumber()), [=]() {
-//          JSValueRef exp = nullptr;
-//          JSObjectCallAsFunction(context->toJSContext(), JSValueToObject(context->toJSContext(), saved.vector()[0], &exp),
-//                                 nullptr, args.count(), args, &exp);
-//          if (exp) {
-//            NX::Nexus::ReportException(context->toJSContext(), exp);
-//          }
-//        });
-//        int id = 1;
-//        while(globalTimeouts.find(id) != globalTimeouts.end()) id++;
-//        globalTimeouts[id] = task;
-//        return JSValueMakeNumber(ctx, id);
-//      } catch(const std::exception & e) {
-//        return JSWrapException(ctx, e, exception);
-//      }
-//      return JSValueMakeUndefined(ctx);
-//    }, 0
-//  },
-//  { "clearTimeout",
-//    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
-//       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
-//      try {
-//        JSC::JSLockHolder lock(toJS(ctx));
-//        if (argumentCount != 1) {
-//          return JSValueMakeUndefined(ctx);
-//        }
-//        NX::Value timeoutId(ctx, arguments[0]);
-//        int taskId = (int)timeoutId.toNumber();
-//        {
-////          boost::mutex::scoped_lock lock(timeoutsMutex);
-//          if (NX::AbstractTask * task = globalTimeouts[taskId]) {
-//            task->abort();
-//          } else {
-//            /* TODO error */
-//          }
-//          globalTimeouts.erase(taskId);
-//        }
-//      } catch(const std::exception & e) {
-//        return JSWrapException(ctx, e, exception);
-//      }
-//      return JSValueMakeUndefined(ctx);
-//    }, 0
-//  },
+  { "setTimeout",
+    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
+       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
+    {
+      return startTimer(ctx, argumentCount, arguments, false, "setTimeout", exception);
+    }, 0
+  },
+  { "setInterval",
+    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
+       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
+    {
+      return startTimer(ctx, argumentCount, arguments, true, "setInterval", exception);
+    }, 0
+  },
+  { "clearTimeout",
+    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
+       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
+    {
+      return stopTimer(ctx, argumentCount, arguments, exception);
+    }, 0
+  },
+  { "clearInterval",
+    [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
+       const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
+    {
+      return stopTimer(ctx, argumentCount, arguments, exception);
+    }, 0
+  },
 //   { "__valueProtect",
 //     [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount,
 //        const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
@@ -25,6 +25,10 @@
 #include "classes/io/stream.h"
 #include "classes/io/devices/socket.h"
 #include "classes/io/devices/file.h"
+#include "classes/io/devices/async_file.h"
+#include "classes/io/devices/file_map.h"
+#include "classes/io/devices/buffered_sink.h"
+#include "classes/io/devices/file_watch.h"
 #include "classes/io/filters/encoding.h"
 #include "classes/io/filters/utf8stringfilter.h"
 
@@ -83,6 +87,66 @@ const JSStaticValue NX::Globals::IO::Properties[]{
       return constructor;
     },
                                           nullptr, kJSPropertyAttributeNone},
+    {"BidirectionalFileDevice",  [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.BidirectionalFileDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::BidirectionalFileDevice::getConstructor(context);
+      context->setGlobal("Nexus.IO.BidirectionalFileDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
+    {"AsyncFilePullDevice",      [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.AsyncFilePullDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::AsyncFilePullDevice::getConstructor(context);
+      context->setGlobal("Nexus.IO.AsyncFilePullDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
+    {"AsyncFileSinkDevice",      [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.AsyncFileSinkDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::AsyncFileSinkDevice::getConstructor(context);
+      context->setGlobal("Nexus.IO.AsyncFileSinkDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
+    {"FileMapDevice",            [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.FileMapDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::FileMapDevice::getConstructor(context);
+      context->setGlobal("Nexus.IO.FileMapDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
+    {"BufferedSinkDevice",       [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.BufferedSinkDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::BufferedSinkDevice::getConstructor(context);
+      context->setGlobal("Nexus.IO.BufferedSinkDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
+    {"FileWatchDevice",          [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.FileWatchDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::FileWatchDevice::getConstructor(context);
+      context->setGlobal("Nexus.IO.FileWatchDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
     {"SocketDevice",             [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
                                     JSValueRef *exception) -> JSValueRef {
       NX::Context *context = Context::FromJsContext(ctx);
@@ -103,6 +167,16 @@ const JSStaticValue NX::Globals::IO::Properties[]{
       return constructor;
     },
                                           nullptr, kJSPropertyAttributeNone},
+    {"TCPSocketDevice",          [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                    JSValueRef *exception) -> JSValueRef {
+      NX::Context *context = Context::FromJsContext(ctx);
+      if (auto val = context->getGlobal("Nexus.IO.TCPSocketDevice"))
+        return val;
+      JSObjectRef constructor = NX::Classes::IO::Devices::TCPSocket::getConstructor(context);
+      context->setGlobal("Nexus.IO.TCPSocketDevice", constructor);
+      return constructor;
+    },
+                                          nullptr, kJSPropertyAttributeNone},
     {"ReadableStream",           [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
                                     JSValueRef *exception) -> JSValueRef {
       NX::Context *context = Context::FromJsContext(ctx);
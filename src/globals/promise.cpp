@@ -20,6 +20,11 @@
 #include "nexus.h"
 #include "globals/promise.h"
 
+#include <JavaScriptCore/API/APICast.h>
+#include <JavaScriptCore/heap/StrongInlines.h>
+#include <JavaScriptCore/runtime/JSPromiseConstructor.h>
+#include <JavaScriptCore/runtime/JSPromiseDeferred.h>
+
 #include "promise.js.inc"
 
 JSValueRef NX::Globals::Promise::Get (JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef * exception)
@@ -35,12 +40,89 @@ JSValueRef NX::Globals::Promise::Get (JSContextRef ctx, JSObjectRef object, JSSt
   return JSValueMakeUndefined(ctx);
 }
 
+namespace {
+  JSObjectRef promiseConstructor(JSContextRef ctx) {
+    // the intrinsic, not whatever the script may have put in the global's "Promise" slot
+    return toRef(toJS(ctx)->lexicalGlobalObject()->promiseConstructor());
+  }
+
+  /**
+   * The settling side of a native promise, shared by its resolve and reject handlers. The first call wins.
+   */
+  class Settlement: public boost::noncopyable
+  {
+  public:
+    Settlement(NX::Context * context, JSC::JSPromiseDeferred * deferred):
+      myContext(context), myVM(&deferred->vm()), myDeferred(*myVM, deferred), mySettled(false) {}
+
+    ~Settlement() {
+      // handles may only be released with the VM locked, and the last copy of a handler can go anywhere
+      if (myDeferred) {
+        JSC::JSLockHolder lock(myVM);
+        myDeferred.clear();
+      }
+    }
+
+    JSValueRef promise() const { return toRef(toJS(myContext->toJSContext()), myDeferred->promise()); }
+
+    void settle(JSValueRef value, bool rejected) {
+      if (mySettled.exchange(true))
+        return;
+      NX::Scheduler * scheduler = myContext->nexus()->scheduler();
+      if (scheduler->canYield()) {
+        // keep script execution off coroutine stacks
+        JSValueProtect(myContext->toJSContext(), value);
+        scheduler->scheduleTask([this, value, rejected] {
+          run(value, rejected);
+          JSValueUnprotect(myContext->toJSContext(), value);
+        })->await();
+      } else {
+        run(value, rejected);
+      }
+    }
+
+  private:
+    void run(JSValueRef value, bool rejected) {
+      JSC::ExecState * exec = toJS(myContext->toJSContext());
+      JSC::JSLockHolder lock(exec);
+      auto scope = DECLARE_CATCH_SCOPE(*myVM);
+      if (rejected)
+        myDeferred->reject(exec, toJS(exec, value));
+      else
+        myDeferred->resolve(exec, toJS(exec, value));
+      if (JSC::Exception * exception = scope.exception()) {
+        scope.clearException();
+        if (!rejected)
+          myDeferred->reject(exec, exception);
+        else
+          NX::Nexus::ReportException(myContext->toJSContext(), toRef(exec, exception->value()));
+      }
+      myDeferred.clear();
+    }
+
+    NX::Context * myContext;
+    JSC::VM * myVM;
+    JSC::Strong<JSC::JSPromiseDeferred> myDeferred;
+    std::atomic_bool mySettled;
+  };
+
+  std::shared_ptr<Settlement> createSettlement(NX::Context * context) {
+    JSC::ExecState * exec = toJS(context->toJSContext());
+    JSC::JSLockHolder lock(exec);
+    auto scope = DECLARE_CATCH_SCOPE(exec->vm());
+    JSC::JSPromiseDeferred * deferred = JSC::JSPromiseDeferred::create(exec, exec->lexicalGlobalObject());
+    if (JSC::Exception * exception = scope.exception()) {
+      scope.clearException();
+      throw NX::Exception(context->toJSContext(), toRef(exec, exception->value()));
+    }
+    return std::make_shared<Settlement>(context, deferred);
+  }
+}
+
 JSValueRef NX::Globals::Promise::createPromise (JSContextRef ctx, JSObjectRef executor, JSValueRef * exception)
 {
-  NX::Context * context = Context::FromJsContext(ctx);
-  JSObjectRef Promise = JSValueToObject(ctx, context->getOrInitGlobal(ctx, "Promise"), exception);
   JSValueRef args[]{executor};
-  return JSObjectCallAsConstructor(ctx, Promise, 1, args, exception);
+  return JSObjectCallAsConstructor(ctx, promiseConstructor(ctx), 1, args, exception);
 }
 
 JSObjectRef NX::Globals::Promise::createPromise (JSContextRef ctx, const NX::Globals::Promise::Executor & executor)
@@ -53,102 +135,17 @@ JSObjectRef NX::Globals::Promise::createPromise (JSContextRef ctx, const NX::Glo
     })->await();
     return ret;
   }
-  NX::Object Promise(ctx, context->getOrInitGlobal(ctx, "Promise"));
-  JSValueRef exp = nullptr;
-  JSObjectRef thisObject = JSObjectMake(ctx, context->nexus()->genericClass(), new NX::Globals::Promise::Executor(executor));
-  JSObjectRef jsExecutor = JSBindFunction(ctx, JSObjectMakeFunctionWithCallback(ctx, ScopedString("CreatePromiseExecutor"),
-                                                                                [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
-                                                                                   size_t argumentCount, const JSValueRef originalArguments[],
-                                                                                   JSValueRef * exception) -> JSValueRef
-  {
-    NX::Context * context = NX::Context::FromJsContext(ctx);
-    std::vector<JSValueRef> arguments = std::vector<JSValueRef>(originalArguments, originalArguments + argumentCount);
-    NX::Globals::Promise::Executor executor = *reinterpret_cast<NX::Globals::Promise::Executor*>(JSObjectGetPrivate(thisObject));
-    delete reinterpret_cast<NX::Globals::Promise::Executor*>(JSObjectGetPrivate(thisObject));
-    if (!executor) {
-      NX::Value message(ctx, "promise executor is null");
-      JSValueRef args[] { message.value(), nullptr };
-      *exception = JSObjectMakeError(ctx, 1, args, nullptr);
-      return JSValueMakeUndefined(ctx);
-    }
-    JSObjectRef resolve = JSValueToObject(ctx, arguments[0], nullptr);
-    JSObjectRef reject = JSValueToObject(ctx, arguments[1], nullptr);
-    try {
-      JSValueProtect(context->toJSContext(), thisObject);
-      JSValueProtect(context->toJSContext(), resolve);
-      JSValueProtect(context->toJSContext(), reject);
-      executor(ctx, [=](JSContextRef ctx, JSValueRef resolveValue) {
-        if (context->nexus()->scheduler()->canYield()) {
-          JSValueProtect(context->toJSContext(), resolveValue);
-          context->nexus()->scheduler()->scheduleTask([=] {
-            JSValueRef args[]{resolveValue};
-            JSValueRef exp = nullptr;
-            JSObjectCallAsFunction(ctx, resolve, nullptr, 1, args, &exp);
-            if (exp) {
-              JSValueRef rejectArgs[]{exp};
-              JSValueRef rejExp = nullptr;
-              JSObjectCallAsFunction(ctx, reject, nullptr, 1, rejectArgs, &rejExp);
-              if (rejExp)
-                NX::Nexus::ReportException(ctx, rejExp);
-            }
-            JSValueUnprotect(context->toJSContext(), resolve);
-            JSValueUnprotect(context->toJSContext(), reject);
-            JSValueUnprotect(context->toJSContext(), resolveValue);
-            JSValueUnprotect(context->toJSContext(), thisObject);
-          })->await();
-        } else {
-          JSValueRef args[]{resolveValue};
-          JSValueRef exp = nullptr;
-          JSObjectCallAsFunction(ctx, resolve, nullptr, 1, args, &exp);
-          if (exp) {
-            JSValueRef rejectArgs[]{exp};
-            JSValueRef rejExp = nullptr;
-            JSObjectCallAsFunction(ctx, reject, nullptr, 1, rejectArgs, &rejExp);
-            if (rejExp)
-              NX::Nexus::ReportException(ctx, rejExp);
-          }
-          JSValueUnprotect(context->toJSContext(), resolve);
-          JSValueUnprotect(context->toJSContext(), reject);
-          JSValueUnprotect(context->toJSContext(), thisObject);
-        }
-      }, [=](JSContextRef ctx, JSValueRef rejectValue) {
-        if (context->nexus()->scheduler()->canYield()) {
-          JSValueProtect(context->toJSContext(), rejectValue);
-          context->nexus()->scheduler()->scheduleTask([=] {
-            JSValueRef args[] { rejectValue };
-            JSValueRef exp = nullptr;
-            JSObjectCallAsFunction(ctx, reject, nullptr, 1, args, &exp);
-            if (exp)
-              NX::Nexus::ReportException(context->toJSContext(), exp);
-            JSValueUnprotect(context->toJSContext(), resolve);
-            JSValueUnprotect(context->toJSContext(), reject);
-            JSValueUnprotect(context->toJSContext(), rejectValue);
-            JSValueUnprotect(context->toJSContext(), thisObject);
-          })->await();
-        } else {
-          JSValueRef args[]{rejectValue};
-          JSValueRef exp = nullptr;
-          JSObjectCallAsFunction(ctx, reject, nullptr, 1, args, &exp);
-          if (exp)
-            NX::Nexus::ReportException(context->toJSContext(), exp);
-          JSValueUnprotect(context->toJSContext(), resolve);
-          JSValueUnprotect(context->toJSContext(), reject);
-          JSValueUnprotect(context->toJSContext(), thisObject);
-        }
-      });
-    } catch (const std::exception & e) {
-      JSValueRef args[] { NX::Object(context->toJSContext(), e) };
-      JSObjectCallAsFunction(context->toJSContext(), reject, nullptr, 1, args, exception);
-      JSValueUnprotect(context->toJSContext(), resolve);
-      JSValueUnprotect(context->toJSContext(), reject);
-      JSValueUnprotect(context->toJSContext(), thisObject);
-    }
-    return JSValueMakeUndefined(ctx);
-  }), thisObject, 0, nullptr, nullptr);
-  JSValueRef args[] { jsExecutor };
-  JSObjectRef promise = JSObjectCallAsConstructor(context->toJSContext(), Promise, 1, args, &exp);
-  if (exp) {
-    throw NX::Exception(context->toJSContext(), exp);
+  if (!executor)
+    throw NX::Exception("promise executor is null");
+  // a JSPromise with C++ resolve/reject handles, no executor wrapper or bound functions in between
+  auto settlement = createSettlement(context);
+  JSObjectRef promise = JSValueToObject(ctx, settlement->promise(), nullptr);
+  try {
+    executor(context->toJSContext(),
+             [settlement](JSContextRef, JSValueRef value) { settlement->settle(value, false); },
+             [settlement](JSContextRef, JSValueRef value) { settlement->settle(value, true); });
+  } catch (const std::exception & e) {
+    settlement->settle(NX::Object(context->toJSContext(), e), true);
   }
   return promise;
 }
@@ -166,10 +163,14 @@ JSObjectRef NX::Globals::Promise::all (JSContextRef ctx, const std::vector< JSVa
   if (promises.empty()) {
     return NX::Globals::Promise::resolve(ctx, JSObjectMakeArray(ctx, 0, nullptr, nullptr));
   }
+  JSObjectRef Promise = promiseConstructor(ctx);
   JSValueRef exp = nullptr;
-  JSObjectRef Promise = JSValueToObject(ctx, context->getOrInitGlobal(ctx, "Promise"), &exp);
-  JSObjectRef arr = NX::Object(ctx, promises);
-  return NX::Object(ctx, NX::Object(ctx, Promise)["all"]->toObject()->call(Promise, {arr}, nullptr));
+  JSValueRef all = JSObjectGetProperty(ctx, Promise, NX::ScopedString("all"), &exp);
+  JSValueRef args[] { NX::Object(ctx, promises).value() };
+  JSValueRef result = exp ? nullptr : JSObjectCallAsFunction(ctx, JSValueToObject(ctx, all, &exp), Promise, 1, args, &exp);
+  if (exp)
+    throw NX::Exception(ctx, exp);
+  return JSValueToObject(ctx, result, nullptr);
 }
 
 JSObjectRef NX::Globals::Promise::resolve (JSContextRef ctx, const JSValueRef value)
@@ -182,9 +183,10 @@ JSObjectRef NX::Globals::Promise::resolve (JSContextRef ctx, const JSValueRef va
     })->await();
     return ret;
   }
-  JSValueRef exp = nullptr;
-  JSObjectRef Promise = JSValueToObject(ctx, context->getOrInitGlobal(ctx, "Promise"), &exp);
-  return NX::Object(ctx, NX::Object(ctx, Promise)["resolve"]->toObject()->call(Promise, std::vector<JSValueRef> { value }, nullptr));
+  auto settlement = createSettlement(context);
+  JSObjectRef promise = JSValueToObject(ctx, settlement->promise(), nullptr);
+  settlement->settle(value, false);
+  return promise;
 }
 
 JSObjectRef NX::Globals::Promise::reject (JSContextRef ctx, const JSValueRef value)
@@ -197,8 +199,8 @@ JSObjectRef NX::Globals::Promise::reject (JSContextRef ctx, const JSValueRef val
     })->await();
     return ret;
   }
-  JSValueRef exp = nullptr;
-  JSObjectRef Promise = JSValueToObject(ctx, context->getOrInitGlobal(ctx, "Promise"), &exp);
-  return NX::Object(ctx, NX::Object(ctx, Promise)["reject"]->toObject()->call(Promise, std::vector<JSValueRef> { value }, nullptr));
+  auto settlement = createSettlement(context);
+  JSObjectRef promise = JSValueToObject(ctx, settlement->promise(), nullptr);
+  settlement->settle(value, true);
+  return promise;
 }
-
@@ -2,6 +2,9 @@
 #include "globals/scheduler.h"
 #include "scheduler.h"
 #include "value.h"
+#include "object.h"
+#include "stack_pool.h"
+#include "util.h"
 #include "task.h"
 #include "classes/task.h"
 
@@ -22,6 +25,22 @@ JSValueRef NX::Globals::Scheduler::Get (JSContextRef ctx, JSObjectRef object, JS
                                                      context->nexus()->scheduler()));
 }
 
+namespace {
+  // durations go out in (fractional) milliseconds, like everything else timing-related on the JS side
+  double toMilliseconds(std::uint64_t nanos) { return nanos / 1e6; }
+
+  JSObjectRef summaryToObject(JSContextRef ctx, const NX::LatencyHistogram::Summary & summary) {
+    NX::Object object(ctx);
+    object.set("count", NX::Value(ctx, summary.count).value());
+    object.set("mean", NX::Value(ctx, toMilliseconds(summary.mean)).value());
+    object.set("max", NX::Value(ctx, toMilliseconds(summary.max)).value());
+    object.set("p50", NX::Value(ctx, toMilliseconds(summary.p50)).value());
+    object.set("p99", NX::Value(ctx, toMilliseconds(summary.p99)).value());
+    object.set("p999", NX::Value(ctx, toMilliseconds(summary.p999)).value());
+    return object.value();
+  }
+}
+
 const JSStaticValue NX::Globals::Scheduler::Properties[] {
   { "threadId", [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) -> JSValueRef {
       std::ostringstream ss;
@@ -47,14 +66,75 @@ const JSStaticValue NX::Globals::Scheduler::Properties[] {
 };
 
 const JSStaticFunction NX::Globals::Scheduler::Methods[] {
+  { "stats", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
+      auto * scheduler = reinterpret_cast<NX::Scheduler*>(JSObjectGetPrivate(thisObject));
+      try {
+        NX::Scheduler::Stats stats = scheduler->stats();
+        NX::Object result(ctx);
+        result.set("threads", NX::Value(ctx, stats.threads).value());
+        result.set("poolThreads", NX::Value(ctx, stats.poolThreads).value());
+        result.set("queued", NX::Value(ctx, stats.queued).value());
+        result.set("active", NX::Value(ctx, stats.active).value());
+        result.set("timers", NX::Value(ctx, stats.timers).value());
+        result.set("waitTime", summaryToObject(ctx, stats.waitTime));
+        result.set("runTime", summaryToObject(ctx, stats.runTime));
+        std::vector<JSValueRef> workers;
+        for (auto & worker : stats.workers) {
+          NX::Object object(ctx);
+          std::vector<JSValueRef> cpus;
+          for (int cpu : worker.cpus)
+            cpus.push_back(NX::Value(ctx, cpu).value());
+          object.set("index", NX::Value(ctx, worker.index).value());
+          object.set("active", JSValueMakeBoolean(ctx, worker.active));
+          object.set("node", NX::Value(ctx, worker.node).value());
+          object.set("cpus", NX::Object(ctx, cpus).value());
+          object.set("tasks", NX::Value(ctx, worker.tasks).value());
+          object.set("steals", NX::Value(ctx, worker.steals).value());
+          object.set("injected", NX::Value(ctx, worker.injected).value());
+          object.set("parks", NX::Value(ctx, worker.parks).value());
+          object.set("idleTime", NX::Value(ctx, toMilliseconds(worker.idleTime)).value());
+          object.set("queueDepth", NX::Value(ctx, worker.queueDepth).value());
+          workers.push_back(object.value());
+        }
+        result.set("workers", NX::Object(ctx, workers).value());
+        result.set("taskBudget", NX::Value(ctx, scheduler->taskBudget().count() / 1e3).value());
+        result.set("abortOverBudget", JSValueMakeBoolean(ctx, scheduler->abortOverBudget()));
+        result.set("overBudget", NX::Value(ctx, stats.overBudget).value());
+        static const char * actions[] { "reported", "yielded", "aborted" };
+        std::vector<JSValueRef> offenders;
+        for (auto & task : stats.recentOverBudget) {
+          NX::Object object(ctx);
+          object.set("stack", NX::Value(ctx, task.stack).value());
+          object.set("runTime", NX::Value(ctx, toMilliseconds(task.runTime)).value());
+          object.set("action", NX::Value(ctx, std::string(actions[task.action])).value());
+          offenders.push_back(object.value());
+        }
+        result.set("recentOverBudget", NX::Object(ctx, offenders).value());
+        auto stacks = NX::StackPool::stats();
+        NX::Object coroutineStacks(ctx);
+        coroutineStacks.set("hits", NX::Value(ctx, stacks.hits).value());
+        coroutineStacks.set("misses", NX::Value(ctx, stacks.misses).value());
+        coroutineStacks.set("stackSize", NX::Value(ctx, stacks.stackSize).value());
+        coroutineStacks.set("poolSize", NX::Value(ctx, stacks.poolSize).value());
+        result.set("coroutineStacks", coroutineStacks.value());
+        return result.value();
+      } catch(const std::exception & e) {
+        return JSWrapException(ctx, e, exception);
+      }
+    }, 0
+  },
   { "schedule", [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
     size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef {
       auto context = Context::FromJsContext(ctx);
       auto * scheduler = reinterpret_cast<NX::Scheduler*>(JSObjectGetPrivate(thisObject));
-      if (argumentCount != 1) {
+      if (argumentCount < 1) {
         *exception = NX::Object(ctx, NX::Exception("Scheduler.schedule called without an argument"));
         return JSValueMakeUndefined(ctx);
       }
+      // { coroutine: true } runs a function on a stack of its own, so it can be made to yield partway through
+      const bool coroutine = argumentCount > 1 && JSValueIsObject(ctx, arguments[1]) &&
+                             NX::Object(ctx, arguments[1])["coroutine"]->toBoolean();
       if (JSValueGetType(ctx, arguments[0]) != kJSTypeObject) {
         *exception = NX::Object(ctx, NX::Exception("invalid argument passed to Scheduler.schedule"));
         return JSValueMakeUndefined(ctx);
@@ -64,16 +144,19 @@ const JSStaticFunction NX::Globals::Scheduler::Methods[] {
         return JSValueMakeUndefined(ctx);
       if (fun) {
         if (JSObjectIsFunction(ctx, fun)) {
-          NX::AbstractTask * taskPtr = new NX::Task([=]() {
+          NX::Scheduler::TaskHandler handler = [=]() {
             JSValueRef exp = nullptr;
             fun.call(nullptr, std::vector<JSValueRef>(), &exp);
             if (exp) {
               NX::Nexus::ReportException(context->toJSContext(), exp);
             }
             JSValueUnprotect(context->toJSContext(), fun);
-          }, scheduler);
+          };
            JSValueRef ret = JSValueMakeUndefined(ctx); // NX::Classes::Task::wrapTask(ctx, taskPtr);
-           scheduler->scheduleAbstractTask(taskPtr);
+           if (coroutine)
+             scheduler->scheduleCoroutine(std::move(handler));
+           else
+             scheduler->scheduleAbstractTask(new NX::Task(std::move(handler), scheduler));
            return ret;
         } else {
           NX::Classes::Task * taskObj = NX::Classes::Task::FromObject(fun);
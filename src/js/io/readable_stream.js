@@ -34,7 +34,7 @@
       delete this[eventsKey][event];
     }
   }
-  const deviceKey = Symbol(), filtersKey = Symbol();
+  const deviceKey = Symbol(), filtersKey = Symbol(), spliceKey = Symbol();
   class ReadableStream extends EventEmitter2 {
     constructor(device) {
       super();
@@ -85,6 +85,13 @@
         return new Promise((resolve, reject) => {
           this.once('end', () => resolve(this));
           this.once('error', reject);
+          // decided here and not in pipe(), filters and listeners added in between must still see the data
+          const splice = this[spliceKey];
+          if (splice) {
+            const untouched = !this.filters.length && !splice.target.filters.length &&
+              (this[eventsKey].data || []).every(e => e.functor === splice.onData);
+            this.device.spliceTo(untouched ? splice.target.device : null);
+          }
           this.device.resume().catch(e => this.emit('error', e));
         });
     }
@@ -118,7 +125,18 @@
         const onEnd = async () => {
           await Promise.all(targets.map(target => target.write(null)));
         };
+        // a file going untouched into a single sink is handed over in the kernel, resume() checks it still is; if the
+        // sink can't take it the device emits 'data' as usual and the handlers below do the work
+        const target = targets.length === 1 ? targets[0] : null;
+        const splice = !!target && !!target.device && typeof this.device.spliceTo === 'function' ?
+          { target, onData } : null;
+        if (splice)
+          this[spliceKey] = splice;
         disconnectAll = async () => {
+          if (splice && this[spliceKey] === splice) {
+            this[spliceKey] = null;
+            this.device.spliceTo(null);
+          }
           this.off('data', onData);
           this.off('end', onEnd);
         };
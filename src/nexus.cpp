@@ -23,6 +23,7 @@
 #include "object.h"
 #include "value.h"
 #include "task.h"
+#include "stack_pool.h"
 #include "globals/global.h"
 
 #include <iostream>
@@ -38,12 +39,53 @@
 #include <JavaScriptCore/runtime/InitializeThreading.h>
 #include <JavaScriptCore/parser/ParserError.h>
 #include <JavaScriptCore/parser/SourceCode.h>
+#include <JavaScriptCore/runtime/ExceptionHelpers.h>
+#include <JavaScriptCore/runtime/JSLock.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
 
 namespace po = boost::program_options;
 
+namespace {
+  // what the exit status goes by: errors nothing caught, and rejections no handler has turned up for yet
+  std::atomic_size_t uncaughtErrors(0);
+  std::mutex rejectionsMutex;
+  std::unordered_set<const void *> unhandledRejections;
+
+  // a task cut short by --abort-over-budget was stopped on purpose, that alone doesn't fail the run
+  bool isTermination(JSContextRef ctx, JSValueRef exception) {
+    JSC::ExecState * exec = toJS(ctx);
+    JSC::JSLockHolder lock(exec);
+    JSC::JSValue value = toJS(exec, exception);
+    return value.isCell() && JSC::jsDynamicCast<JSC::TerminatedExecutionError*>(exec->vm(), value.asCell());
+  }
+
+  void printException(JSContextRef ctx, JSValueRef exception) {
+    std::ostringstream stream;
+    stream << std::endl;
+    try {
+      if (JSValueGetType(ctx, exception) != kJSTypeObject)
+      {
+        stream << "Unhandled exception: " << NX::Value(ctx, exception).toString() << std::endl;
+      } else {
+        NX::Object exp(ctx, exception);
+        stream << "Unhandled exception: " << exp["message"]->toString() << std::endl;
+        stream << "stack trace:\n" << exp["stack"]->toString() << std::endl;
+      }
+      stream << std::endl;
+    } catch(const NX::Exception & e) {
+      std::cerr << "An exception occurred: " << e.what() << std::endl;
+    }
+    std::cerr << stream.str();
+  }
+}
+
 NX::Nexus::Nexus(int argc, const char ** argv):
   argc(argc), argv(argv), myArguments(), myContextGroup(nullptr), myMainContext(nullptr),
-  myScriptSource(), myScriptPath(), myScheduler(nullptr), myOptions(), myClasses()
+  myScriptSource(), myScriptPath(), myScheduler(nullptr), myOptions(), myMicrotaskBudget(0),
+  myClasses()
 {
   for (int i = 0; i < argc; i++) {
     myArguments.emplace_back(std::string(argv[i]));
@@ -68,6 +110,25 @@ bool NX::Nexus::parseArguments()
     ("silent,s", "don't print errors")
     ("concurrency", po::value<unsigned int>(&nThreads)->default_value(boost::thread::hardware_concurrency()),
       "maximum threads in the task scheduler's pool (defaults to the available number of cores)")
+    ("max-threads", po::value<unsigned int>(), "same as --concurrency, takes precedence if both are given")
+    ("min-threads", po::value<unsigned int>()->default_value(0), "threads the pool never shrinks below once started")
+    ("thread-idle-timeout", po::value<unsigned int>()->default_value(10000),
+      "milliseconds a pool thread may sit idle before it retires")
+    ("thread-grow-delay", po::value<unsigned int>()->default_value(1000),
+      "microseconds a backlog has to persist before the pool grows")
+    ("coroutine-stack-size", po::value<std::size_t>()->default_value(0),
+      "coroutine stack size in KiB (0 uses the platform default)")
+    ("coroutine-stack-pool", po::value<std::size_t>()->default_value(64),
+      "coroutine stacks kept for reuse per scheduler thread")
+    ("io-per-worker", "give every scheduler thread its own I/O reactor and shard TCP listeners across them with SO_REUSEPORT")
+    ("cpu-affinity", "pin every scheduler thread to a core of its own")
+    ("numa", "spread scheduler threads over NUMA nodes and keep their queues and work stealing node-local")
+    ("task-budget", po::value<unsigned int>()->default_value(0),
+      "milliseconds of CPU a task may run before coroutines are made to yield and the handler is reported (0 disables)")
+    ("abort-over-budget", "terminate plain (non-coroutine) tasks that run past --task-budget")
+    ("microtask-budget", po::value<std::size_t>(&myMicrotaskBudget)->default_value(1024),
+      "promise reactions run per batch before yielding back to the scheduler (0 runs until the queue is empty)")
+    ("low-latency", "keep idle scheduler threads spinning instead of parking them (trades CPU for wake-up latency)")
     ("input-file", po::value<std::string>(), "input file");
   po::positional_options_description p;
   p.add("input-file", -1);
@@ -92,25 +153,30 @@ bool NX::Nexus::parseArguments()
 }
 
 void NX::Nexus::ReportException(JSContextRef ctx, JSValueRef exception) {
-  std::ostringstream stream;
-  stream << std::endl;
-  try {
-    if (JSValueGetType(ctx, exception) != kJSTypeObject)
-    {
-      stream << "Unhandled exception: " << NX::Value(ctx, exception).toString() << std::endl;
-    } else {
-      NX::Object exp(ctx, exception);
-      stream << "Unhandled exception: " << exp["message"]->toString() << std::endl;
-      stream << "stack trace:\n" << exp["stack"]->toString() << std::endl;
+  if (!isTermination(ctx, exception))
+    uncaughtErrors++;
+  printException(ctx, exception);
+}
+
+void NX::Nexus::ReportRejection(JSContextRef ctx, const void * promise, JSValueRef reason, bool handled) {
+  {
+    std::lock_guard<std::mutex> lock(rejectionsMutex);
+    if (handled) {
+      unhandledRejections.erase(promise);
+      return;
     }
-    stream << std::endl;
-  } catch(const NX::Exception & e) {
-    std::cerr << "An exception occurred: " << e.what() << std::endl;
+    unhandledRejections.insert(promise);
   }
-  std::cerr << stream.str();
+  printException(ctx, reason);
+}
+
+int NX::Nexus::ExitStatus() {
+  std::lock_guard<std::mutex> lock(rejectionsMutex);
+  return uncaughtErrors || !unhandledRejections.empty() ? 1 : 0;
 }
 
 void NX::Nexus::ReportException(const std::exception &e) {
+  uncaughtErrors++;
   std::ostringstream stream;
   stream << std::endl;
   stream << e.what() << std::endl;
@@ -119,8 +185,18 @@ void NX::Nexus::ReportException(const std::exception &e) {
 
 void NX::Nexus::initScheduler()
 {
-  auto concurrency = myOptions["concurrency"].as<unsigned int>();
-  myScheduler.reset(new Scheduler(this, concurrency));
+  auto concurrency = myOptions.count("max-threads") ? myOptions["max-threads"].as<unsigned int>()
+                                                     : myOptions["concurrency"].as<unsigned int>();
+  NX::StackPool::configure(myOptions["coroutine-stack-size"].as<std::size_t>() * 1024,
+                           myOptions["coroutine-stack-pool"].as<std::size_t>());
+  myScheduler.reset(new Scheduler(this, concurrency, myOptions.count("io-per-worker") > 0));
+  myScheduler->setLowLatency(myOptions.count("low-latency") > 0);
+  myScheduler->setPlacement(myOptions.count("cpu-affinity") > 0, myOptions.count("numa") > 0);
+  myScheduler->setTaskBudget(std::chrono::milliseconds(myOptions["task-budget"].as<unsigned int>()));
+  myScheduler->setAbortOverBudget(myOptions.count("abort-over-budget") > 0);
+  myScheduler->setMinThreads(myOptions["min-threads"].as<unsigned int>());
+  myScheduler->setIdleTimeout(std::chrono::milliseconds(myOptions["thread-idle-timeout"].as<unsigned int>()));
+  myScheduler->setGrowDelay(std::chrono::microseconds(myOptions["thread-grow-delay"].as<unsigned int>()));
 }
 
 void NX::Nexus::run() {
@@ -139,7 +215,7 @@ void NX::Nexus::run() {
     myScheduler->start();
     myScheduler->joinPool();
     myScheduler->join();
-    exit(0);
+    exit(ExitStatus());
   } catch(std::exception & e) {
     std::cerr << e.what() << std::endl;
     exit(1);
@@ -147,6 +223,7 @@ void NX::Nexus::run() {
 }
 
 void NX::Nexus::ReportSyntaxError(const JSC::SourceCode & code, const JSC::ParserError &error) {
+  uncaughtErrors++;
   std::ostringstream stream;
   try {
     auto provider  = code.provider();
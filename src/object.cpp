@@ -216,17 +216,21 @@ JSValueRef NX::Object::await() {
   auto context = NX::Context::FromJsContext(myContext);
   auto scheduler = context->nexus()->scheduler();
   JSValueRef result = nullptr, exception = nullptr;
-  this->then([&](JSContextRef ctx, JSValueRef res, JSValueRef*) {
+  auto wakeup = scheduler->wakeup();
+  // once the outcome is stored this frame may return at any moment, so the wake-up only uses copies
+  this->then([&result, context, scheduler, wakeup](JSContextRef ctx, JSValueRef res, JSValueRef*) {
+    JSValueProtect(context->toJSContext(), res);
     result = res;
-    JSValueProtect(context->toJSContext(), result);
+    scheduler->wake(wakeup);
     return JSValueMakeUndefined(ctx);
-  }, [&](JSContextRef ctx, JSValueRef exp, JSValueRef*) {
-    exception = exp;
+  }, [&exception, context, scheduler, wakeup](JSContextRef ctx, JSValueRef exp, JSValueRef*) {
     JSValueProtect(context->toJSContext(), exp);
+    exception = exp;
+    scheduler->wake(wakeup);
     return JSValueMakeUndefined(ctx);
   });
   while(!result && !exception)
-    scheduler->yield();
+    scheduler->suspend();
   if (exception) {
     JSValueUnprotect(context->toJSContext(), exception);
   }
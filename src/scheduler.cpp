@@ -20,8 +20,17 @@
 #include "nexus.h"
 #include "scheduler.h"
 #include "task.h"
+#include "topology.h"
+#include "uring.h"
+#include "file_watcher.h"
 
+#include <climits>
 #include <functional>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include <JavaScriptCore/runtime/InitializeThreading.h>
 #include <JavaScriptCore/heap/GCDeferralContext.h>
 #include <JavaScriptCore/heap/GCDeferralContextInlines.h>
@@ -29,19 +38,40 @@
 #include <JavaScriptCore/heap/HeapInlines.h>
 #include <JavaScriptCore/heap/MachineStackMarker.h>
 
-NX::Scheduler::Scheduler (NX::Nexus * nexus, unsigned int maxThreads):
-  myNexus(nexus), myMaxThreads(maxThreads), myThreadCount(0), myService(), myWork(),
-  myThreadGroup(), myCurrentTask(nullptr), myTaskQueue(256), myTaskCount(0), myActiveTaskCount(0), myHoldCount(0),
-  myPauseTasks(false)
+namespace {
+  // per-worker counters have a single writer, a plain load and store is all they need
+  void bump(std::atomic<std::uint64_t> & counter, std::uint64_t by = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+  }
+}
+
+NX::Scheduler::Scheduler (NX::Nexus * nexus, unsigned int maxThreads, bool servicePerWorker):
+  myNexus(nexus), myMaxThreads(maxThreads), myThreadCount(0), myPoolThreads(0), myMinThreads(0), myGrowDelay(1000),
+  myIdleTimeout(10000), myBacklogSince(0), myMonitor(), myMonitorMutex(), myMonitorWake(), myMonitorStop(false),
+  myService(), myWork(), myThreadsMutex(), myThreads(), myCurrentTask(nullptr), myCurrentWorker([](Worker *) {}), myWorkers(), myTaskQueue(256),
+  myTaskCount(0), myActiveTaskCount(0), myHoldCount(0), myPauseTasks(false), myIdleEpoch(0), myParkedCount(0),
+  myReactorParked(false), myLowLatency(false), myServicePerWorker(servicePerWorker), myNumaAware(false),
+  myTaskBudget(0), myAbortOverBudget(false), myOverBudgetCount(0), myOverBudgetMutex(), myOverBudget(),
+  myNextService(0),
+  myTimers(), myTimersMutex(), myTimerDriver(), myTimerArmed(0), myUringOnce(), myUring(),
+  myFileWatcherOnce(), myFileWatcher(), myBlockingOnce(), myBlockingService(), myBlockingWork(), myBlockingThreads()
 {
+  // one slot per pool thread, plus one for the thread that calls joinPool()
+  for (std::size_t i = 0; i <= maxThreads; i++) {
+    myWorkers.emplace_back(new Worker(i));
+    if (myServicePerWorker)
+      myWorkers.back()->service.reset(new boost::asio::io_service(1));
+  }
   myService.reset(new boost::asio::io_service(maxThreads));
   myService->stop();
+  // a single kernel-visible timer drives the whole wheel
+  myTimerDriver.reset(new boost::asio::steady_timer(*services().front()));
 }
 
 NX::Scheduler::~Scheduler()
 {
   this->stop();
-  myThreadGroup.join_all();
+  join();
   for(auto task : myThreadInitQueue) {
     delete task;
   }
@@ -50,12 +80,47 @@ NX::Scheduler::~Scheduler()
 
 void NX::Scheduler::addThread()
 {
-  myThreadGroup.add_thread(new boost::thread(boost::bind(&NX::Scheduler::dispatcher, this)));
+  // the new thread looks itself up when it retires, so it has to be registered before it can get that far
+  std::lock_guard<std::mutex> lock(myThreadsMutex);
+  std::unique_ptr<boost::thread> thread(new boost::thread(boost::bind(&NX::Scheduler::dispatcher, this, true)));
+  auto id = thread->get_id();
+  myThreads[id] = std::move(thread);
+}
+
+bool NX::Scheduler::reserveThread()
+{
+  std::size_t threads = myPoolThreads;
+  while (threads < myMaxThreads) {
+    if (myPoolThreads.compare_exchange_weak(threads, threads + 1))
+      return true;
+  }
+  return false;
+}
+
+bool NX::Scheduler::retireThread()
+{
+  std::size_t threads = myPoolThreads;
+  while (threads > myMinThreads) {
+    if (myPoolThreads.compare_exchange_weak(threads, threads - 1))
+      return true;
+  }
+  return false;
 }
 
-void NX::Scheduler::dispatcher()
+void NX::Scheduler::dispatcher(bool pooled)
 {
-  static const std::chrono::microseconds delay(200);
+  // idle rounds spent spinning before a worker parks itself
+  static const std::size_t spinLimit = 64;
+  // the slot comes first so a pool thread is already on its cores when the init tasks set up per-thread state
+  Worker * worker = acquireWorker();
+  if (pooled && !worker->cpus.empty()) {
+    NX::Topology::pinCurrentThread(worker->cpus);
+    if (myNumaAware && !worker->relocated) {
+      // first touch from a pinned thread places the ring on this node
+      worker->queue.relocate();
+      worker->relocated = true;
+    }
+  }
   for(auto task : myThreadInitQueue) {
     if (task->status() != NX::AbstractTask::Status::ABORTED) {
       task->create();
@@ -63,17 +128,291 @@ void NX::Scheduler::dispatcher()
       task->exit();
     }
   }
+  myCurrentWorker.reset(worker);
   myThreadCount++;
-  while (myService->poll_one() || queued())
+  std::size_t idleRounds = 0;
+  bool retired = false;
+  auto lastWork = std::chrono::steady_clock::now();
+  while (!myService->stopped())
   {
-    if (!drainTasks()) {
-      std::this_thread::sleep_for(delay);
+    std::size_t processed = myService->poll_one();
+    if (worker->service)
+      processed += worker->service->poll_one();
+    processed += drainTasks();
+    if (processed) {
+      idleRounds = 0;
+      lastWork = std::chrono::steady_clock::now();
+      balanceThreads();
+      continue;
     }
-    std::this_thread::yield();
-    if (myService->stopped())
+    if (drained())
       break;
+    if (myLowLatency || ++idleRounds < spinLimit) {
+      std::this_thread::yield();
+      continue;
+    }
+    idleRounds = 0;
+    // a worker that owns a reactor can't leave, its sockets would go unserviced
+    if (pooled && !worker->service &&
+        std::chrono::steady_clock::now() - lastWork >= std::chrono::milliseconds(myIdleTimeout.load()) &&
+        (retired = retireThread()))
+      break;
+    const std::int64_t parkedAt = clock();
+    park(worker);
+    bump(worker->parks);
+    bump(worker->idleNanos, clock() - parkedAt);
   }
   myThreadCount--;
+  myCurrentWorker.reset(nullptr);
+  releaseWorker(worker);
+  // let the others notice if this was the last of the work
+  if (drained())
+    wakeAll();
+  if (pooled && !retired)
+    myPoolThreads--;
+  if (retired) {
+    // nobody is going to join a retired thread, so it lets go of its own handle
+    std::lock_guard<std::mutex> lock(myThreadsMutex);
+    auto it = myThreads.find(boost::this_thread::get_id());
+    if (it != myThreads.end()) {
+      it->second->detach();
+      myThreads.erase(it);
+    }
+  }
+}
+
+namespace {
+  static const std::chrono::milliseconds parkTimeout(50);
+
+  void futexWait(std::atomic<std::uint32_t> & word, std::uint32_t expected) {
+#ifdef __linux__
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be 32 bits");
+    struct timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(parkTimeout).count();
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+#else
+    if (word.load() == expected)
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+#endif
+  }
+
+  void futexWake(std::atomic<std::uint32_t> & word, int count) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#endif
+  }
+}
+
+void NX::Scheduler::park(NX::Scheduler::Worker * worker)
+{
+  if (worker->service) {
+    // nobody else runs this worker's reactor, so it always parks inside it
+    worker->parked.store(true);
+    if (!queued() && !drained() && !myService->stopped())
+      worker->service->run_one();
+    worker->parked.store(false);
+    return;
+  }
+  // one idle worker blocks inside the io_service so I/O completions are picked up as soon as they happen,
+  // the rest sleep on the futex until scheduleAbstractTask() wakes them
+  bool expected = false;
+  if (myReactorParked.compare_exchange_strong(expected, true)) {
+    if (!queued() && !drained() && !myService->stopped())
+      myService->run_one();
+    myReactorParked.store(false);
+    return;
+  }
+  std::uint32_t epoch = myIdleEpoch.load();
+  myParkedCount++;
+  if (!queued() && !drained())
+    futexWait(myIdleEpoch, epoch);
+  myParkedCount--;
+}
+
+void NX::Scheduler::wakeOne()
+{
+  if (myServicePerWorker) {
+    for (auto & worker : myWorkers) {
+      if (worker->parked) {
+        worker->service->post([]{});
+        return;
+      }
+    }
+    return;
+  }
+  if (myParkedCount) {
+    myIdleEpoch++;
+    futexWake(myIdleEpoch, 1);
+  } else if (myReactorParked) {
+    // the interrupter behind post() is an eventfd on Linux, so this is enough to kick run_one()
+    myService->post([]{});
+  }
+}
+
+void NX::Scheduler::wakeAll()
+{
+  myIdleEpoch++;
+  futexWake(myIdleEpoch, INT_MAX);
+  if (myReactorParked)
+    myService->post([]{});
+  for (auto & worker : myWorkers) {
+    if (worker->parked)
+      worker->service->post([]{});
+  }
+}
+
+std::shared_ptr<boost::asio::io_service> NX::Scheduler::service() const
+{
+  if (!myServicePerWorker)
+    return myService;
+  if (Worker * worker = myCurrentWorker.get())
+    return worker->service;
+  return myWorkers[myNextService++ % myWorkers.size()]->service;
+}
+
+std::shared_ptr<NX::Uring> NX::Scheduler::uring()
+{
+  std::call_once(myUringOnce, [this]() { myUring.reset(new NX::Uring(this, *services().front())); });
+  return myUring;
+}
+
+std::shared_ptr<NX::FileWatcher> NX::Scheduler::fileWatcher()
+{
+  std::call_once(myFileWatcherOnce, [this]() { myFileWatcher.reset(new NX::FileWatcher(this, *services().front())); });
+  return myFileWatcher;
+}
+
+void NX::Scheduler::scheduleBlocking(TaskHandler && handler)
+{
+  if (!handler)
+    throw NX::Exception("empty handler provided");
+  std::call_once(myBlockingOnce, [this]() {
+    // enough threads to keep a disk (or a network filesystem) busy, not so many that they fight over it
+    const std::size_t threads = std::min<std::size_t>(std::max(2u, std::thread::hardware_concurrency()), 16);
+    myBlockingService.reset(new boost::asio::io_service(threads));
+    myBlockingWork.reset(new boost::asio::io_service::work(*myBlockingService));
+    auto service = myBlockingService;
+    for (std::size_t i = 0; i < threads; i++)
+      myBlockingThreads.create_thread([service]() { service->run(); });
+  });
+  // asio wants copyable handlers
+  auto shared = std::make_shared<TaskHandler>(std::move(handler));
+  hold();
+  myBlockingService->post([this, shared]() {
+    try {
+      (*shared)();
+    } catch(...) {
+      // nothing up the stack of a lane thread could handle it, and the hold must still be released
+    }
+    release();
+  });
+}
+
+std::vector<std::shared_ptr<boost::asio::io_service>> NX::Scheduler::services() const
+{
+  std::vector<std::shared_ptr<boost::asio::io_service>> services;
+  if (!myServicePerWorker) {
+    services.push_back(myService);
+    return services;
+  }
+  for (auto & worker : myWorkers)
+    services.push_back(worker->service);
+  return services;
+}
+
+void NX::Scheduler::setPlacement(bool pinCpus, bool numaAware)
+{
+  BOOST_ASSERT_MSG(myService->stopped(), "worker placement has to be set before start");
+  auto nodes = numaAware ? NX::Topology::nodes() : std::vector<std::vector<int>> { NX::Topology::cpus() };
+  myNumaAware = numaAware && nodes.size() > 1;
+  for (auto & worker : myWorkers) {
+    worker->cpus.clear();
+    worker->node = 0;
+    if (!pinCpus && !myNumaAware)
+      continue;
+    // neighbouring slots go to different nodes, so a partly grown pool still uses all of them
+    const std::size_t node = worker->index % nodes.size();
+    const std::vector<int> & cpus = nodes[node];
+    worker->node = node;
+    if (pinCpus)
+      worker->cpus.push_back(cpus[(worker->index / nodes.size()) % cpus.size()]);
+    else
+      worker->cpus = cpus;
+  }
+}
+
+int NX::Scheduler::serviceCpu(const boost::asio::io_service & service) const
+{
+  for (auto & worker : myWorkers) {
+    if (worker->service.get() == &service)
+      return worker->cpus.size() == 1 ? worker->cpus.front() : -1;
+  }
+  return -1;
+}
+
+NX::Scheduler::Worker * NX::Scheduler::acquireWorker()
+{
+  for (auto & worker : myWorkers) {
+    bool inactive = false;
+    if (worker->active.compare_exchange_strong(inactive, true))
+      return worker.get();
+  }
+  throw NX::Exception("scheduler has no free worker slots");
+}
+
+void NX::Scheduler::releaseWorker(NX::Scheduler::Worker * worker)
+{
+  // hand anything left behind to the injector so it doesn't depend on thieves finding it
+  NX::AbstractTask * task = nullptr;
+  while (worker->queue.pop(task))
+    myTaskQueue.push(task);
+  worker->active.store(false);
+}
+
+NX::AbstractTask * NX::Scheduler::nextTask(NX::Scheduler::Worker * worker)
+{
+  NX::AbstractTask * task = nullptr;
+  if (worker && worker->queue.pop(task))
+    return task;
+  if (myTaskQueue.pop(task)) {
+    if (worker)
+      bump(worker->injected);
+    return task;
+  }
+  // start with the next slot over so thieves spread out instead of all hitting the first worker;
+  // NUMA-aware workers go through their own node before reaching across the interconnect
+  const std::size_t count = myWorkers.size();
+  const std::size_t start = worker ? worker->index + 1 : 0;
+  const bool local = myNumaAware && worker;
+  for (int pass = local ? 0 : 1; pass < 2; pass++) {
+    for (std::size_t i = 0; i < count; i++) {
+      auto * victim = myWorkers[(start + i) % count].get();
+      if (local && (victim->node == worker->node) != (pass == 0))
+        continue;
+      if (victim != worker && victim->queue.steal(task)) {
+        if (worker)
+          bump(worker->steals);
+        return task;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void NX::Scheduler::requeue(NX::AbstractTask * task)
+{
+  // a yielded coroutine goes through the injector rather than the local deque, otherwise the LIFO pop
+  // would resume it immediately and starve whatever it is waiting on
+  myTaskCount++;
+  task->myQueuedAt = clock();
+  myTaskQueue.push(task);
+}
+
+std::int64_t NX::Scheduler::clock()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 void NX::Scheduler::makeCurrent (NX::AbstractTask * task)
@@ -85,11 +424,21 @@ std::size_t NX::Scheduler::drainTasks()
 {
   if (myPauseTasks) return 0;
   std::size_t processed = 0;
+  Worker * worker = myCurrentWorker.get();
   NX::AbstractTask * task = nullptr;
-  while (myTaskQueue.pop(task))
+  // one clock read per task: the end of one run is the start of the next
+  std::int64_t now = clock();
+  while ((task = nextTask(worker)))
   {
     myActiveTaskCount++;
     myTaskCount--;
+    if (worker && task->myQueuedAt)
+      worker->waitTime.record(now > task->myQueuedAt ? now - task->myQueuedAt : 0);
+    if (worker) {
+      worker->lastWait.store(task->myQueuedAt && now > task->myQueuedAt ? now - task->myQueuedAt : 0,
+                             std::memory_order_relaxed);
+      worker->runningSince.store(now, std::memory_order_relaxed);
+    }
     myCurrentTask.reset(task);
     if (myCurrentTask->status() != NX::AbstractTask::ABORTED) {
       if (myCurrentTask.get() && myCurrentTask->status() == NX::AbstractTask::INACTIVE)
@@ -100,7 +449,15 @@ std::size_t NX::Scheduler::drainTasks()
       }
       if (myCurrentTask.get() && myCurrentTask->status() == NX::AbstractTask::PENDING)
       {
-        myTaskQueue.push(myCurrentTask.release());
+        auto * pending = myCurrentTask.release();
+        // a coroutine that suspended is off its stack now; from here on wake() is the one to requeue it,
+        // unless a wake-up came in while it was still switching out
+        int suspending = Wakeup::SUSPENDING;
+        if (!pending->myWakeup || !pending->myWakeup->state.compare_exchange_strong(suspending, Wakeup::SUSPENDED)) {
+          if (suspending == Wakeup::WOKEN)
+            pending->myWakeup->state.store(Wakeup::RUNNING);
+          requeue(pending);
+        }
       }
       else if (auto pTask = myCurrentTask.release()) {
         pTask->exit();
@@ -109,6 +466,14 @@ std::size_t NX::Scheduler::drainTasks()
     }
     myActiveTaskCount--;
     processed++;
+    if (worker) {
+      const std::int64_t end = clock();
+      worker->runTime.record(end - now);
+      bump(worker->tasks);
+      now = end;
+    }
+    if (drained())
+      wakeAll();
     if (myPauseTasks) break;
   }
   return processed;
@@ -116,37 +481,171 @@ std::size_t NX::Scheduler::drainTasks()
 
 void NX::Scheduler::balanceThreads()
 {
-  while(myTaskCount > myThreadGroup.size() && myThreadGroup.size() < myMaxThreads)
+  if (myService->stopped())
+    return;
+  // growing past the minimum is the monitor's call, this runs far too often to look at queue latency
+  while (myPoolThreads < myMinThreads && reserveThread())
     addThread();
 }
 
+std::int64_t NX::Scheduler::queueDelay(std::int64_t now) const
+{
+  if (!myTaskCount)
+    return 0;
+  std::int64_t lastStart = 0, lastWait = 0;
+  for (auto & worker : myWorkers) {
+    const std::int64_t started = worker->runningSince.load(std::memory_order_relaxed);
+    if (started > lastStart) {
+      lastStart = started;
+      lastWait = worker->lastWait.load(std::memory_order_relaxed);
+    }
+  }
+  // the queue hasn't been empty since myBacklogSince and nothing left it since lastStart, so whatever was in it at
+  // the later of the two is still there; the last task to leave tells how long the queue kept it
+  const std::int64_t stalled = now - std::max<std::int64_t>(lastStart, myBacklogSince);
+  return std::max(stalled, lastWait);
+}
+
+void NX::Scheduler::monitor()
+{
+  std::int64_t lastGrowth = 0;
+  std::unique_lock<std::mutex> lock(myMonitorMutex);
+  while (!myMonitorStop) {
+    const std::int64_t growDelay = std::max<std::int64_t>(myGrowDelay, 0) * 1000;
+    // a few looks per grow delay, within reason
+    const std::int64_t tick = std::min<std::int64_t>(std::max<std::int64_t>(growDelay / 4, 1000000), 50000000);
+    myMonitorWake.wait_for(lock, std::chrono::nanoseconds(tick));
+    if (myMonitorStop)
+      break;
+    const std::int64_t now = clock();
+    if (!myTaskCount) {
+      myBacklogSince.store(now);
+      continue;
+    }
+    // an idle worker is woken by whoever queues, only grow when everyone is busy
+    if (myPoolThreads >= myMaxThreads || myParkedCount || myReactorParked || now - lastGrowth < growDelay)
+      continue;
+    if (queueDelay(now) >= growDelay && reserveThread()) {
+      addThread();
+      lastGrowth = now;
+    }
+  }
+}
+
 void NX::Scheduler::start()
 {
   BOOST_ASSERT_MSG(myService->stopped(), "call to start with a service already running");
   myService->reset();
   myWork.reset(new boost::asio::io_service::work(*myService));
+  if (myMonitor) {
+    myMonitor->join();
+    myMonitor.reset();
+  }
+  myMonitorStop = false;
+  myBacklogSince.store(clock());
+  myMonitor.reset(new boost::thread(boost::bind(&NX::Scheduler::monitor, this)));
+  if (myServicePerWorker) {
+    for (auto & worker : myWorkers) {
+      worker->service->reset();
+      worker->work.reset(new boost::asio::io_service::work(*worker->service));
+    }
+    // every slot owns a reactor (and possibly a listener shard), so they all need a thread from the start
+    while (reserveThread())
+      addThread();
+  }
   balanceThreads();
 }
 
 void NX::Scheduler::stop()
 {
+  {
+    std::lock_guard<std::mutex> lock(myMonitorMutex);
+    myMonitorStop = true;
+  }
+  myMonitorWake.notify_all();
   myWork.reset();
   myService->stop();
+  myBlockingWork.reset();
+  if (myBlockingService)
+    myBlockingService->stop();
+  for (auto & worker : myWorkers) {
+    if (!worker->service) continue;
+    worker->work.reset();
+    worker->service->stop();
+  }
+  wakeAll();
 }
 
 void NX::Scheduler::join()
 {
-  myThreadGroup.join_all();
+  // nothing is held by then, so the lane has no work left to wait for
+  myBlockingWork.reset();
+  myBlockingThreads.join_all();
+  if (myMonitor) {
+    myMonitor->join();
+    myMonitor.reset();
+  }
+  for (;;) {
+    std::unique_ptr<boost::thread> thread;
+    {
+      std::lock_guard<std::mutex> lock(myThreadsMutex);
+      if (myThreads.empty())
+        return;
+      thread = std::move(myThreads.begin()->second);
+      myThreads.erase(myThreads.begin());
+    }
+    thread->join();
+  }
 }
 
 NX::AbstractTask * NX::Scheduler::scheduleAbstractTask (NX::AbstractTask * task)
 {
   myTaskCount++;
-  myTaskQueue.push(task);
+  task->myQueuedAt = clock();
+  Worker * worker = myCurrentWorker.get();
+  // with a reactor per worker, completions keep their follow-up work on the same thread
+  if (worker && (myCurrentTask.get() || myServicePerWorker))
+    worker->queue.push(task);
+  else
+    myTaskQueue.push(task);
   balanceThreads();
+  wakeOne();
   return task;
 }
 
+void NX::Scheduler::scheduleAbstractTasks(NX::AbstractTask * const * tasks, std::size_t count)
+{
+  if (!count)
+    return;
+  myTaskCount += count;
+  const std::int64_t now = clock();
+  for (std::size_t i = 0; i < count; i++)
+    tasks[i]->myQueuedAt = now;
+  Worker * worker = myCurrentWorker.get();
+  if (worker && (myCurrentTask.get() || myServicePerWorker)) {
+    worker->queue.push(tasks, count);
+  } else {
+    for (std::size_t i = 0; i < count; i++)
+      myTaskQueue.push(tasks[i]);
+  }
+  balanceThreads();
+  wakeOne();
+}
+
+std::vector<NX::AbstractTask*> NX::Scheduler::scheduleBatch(std::vector<TaskHandler> && handlers)
+{
+  std::vector<NX::AbstractTask*> tasks;
+  tasks.reserve(handlers.size());
+  for (auto & handler : handlers) {
+    if (!handler)
+      throw NX::Exception("empty handler provided");
+  }
+  for (auto & handler : handlers)
+    tasks.push_back(new NX::Task(std::move(handler), this));
+  scheduleAbstractTasks(tasks.data(), tasks.size());
+  return tasks;
+}
+
 void NX::Scheduler::yield()
 {
   if (!myCurrentTask.get()) {
@@ -158,14 +657,59 @@ void NX::Scheduler::yield()
   myCurrentTask->yield();
 }
 
+std::shared_ptr<NX::Scheduler::Wakeup> NX::Scheduler::wakeup()
+{
+  if (!canYield())
+    throw NX::Exception("call to wait outside of a coroutine");
+  auto * task = myCurrentTask.get();
+  if (!task->myWakeup)
+    task->myWakeup = std::make_shared<Wakeup>(task);
+  return task->myWakeup;
+}
+
+void NX::Scheduler::suspend()
+{
+  auto wakeup = this->wakeup();
+  int running = Wakeup::RUNNING;
+  if (!wakeup->state.compare_exchange_strong(running, Wakeup::SUSPENDING)) {
+    // woken before it got to sleep
+    wakeup->state.store(Wakeup::RUNNING);
+    return;
+  }
+  // a parked coroutine is still work in progress, the pool mustn't wind down under it
+  Holder holder(this);
+  myCurrentTask->yield();
+}
+
+void NX::Scheduler::wake(const std::shared_ptr<Wakeup> & wakeup)
+{
+  int state = wakeup->state.load();
+  for (;;) {
+    switch (state) {
+      case Wakeup::WOKEN:
+        return;
+      case Wakeup::SUSPENDED:
+        if (wakeup->state.compare_exchange_weak(state, Wakeup::RUNNING)) {
+          scheduleAbstractTask(wakeup->task);
+          return;
+        }
+        break;
+      default:
+        // still running or on its way out, drainTasks() or suspend() will see this
+        if (wakeup->state.compare_exchange_weak(state, Wakeup::WOKEN))
+          return;
+        break;
+    }
+  }
+}
+
 void NX::Scheduler::joinPool() {
   do {
-    dispatcher();
-    std::this_thread::sleep_for(std::chrono::microseconds(200));
-  } while (myHoldCount);
+    dispatcher(false);
+  } while (myHoldCount && !myService->stopped());
 }
 
-NX::Task *NX::Scheduler::scheduleTask(CompletionHandler &&handler) {
+NX::Task *NX::Scheduler::scheduleTask(TaskHandler &&handler) {
   if (!handler)
     throw NX::Exception("empty handler provided");
   auto * task = new NX::Task(std::move(handler), this);
@@ -173,18 +717,15 @@ NX::Task *NX::Scheduler::scheduleTask(CompletionHandler &&handler) {
   return task;
 }
 
-NX::Task *NX::Scheduler::scheduleTask(const NX::Scheduler::duration &time, CompletionHandler && handler) {
+NX::Task *NX::Scheduler::scheduleTask(const NX::Scheduler::duration &time, TaskHandler && handler) {
   if (!handler)
     throw NX::Exception("empty handler provided");
   auto * taskObject = new NX::Task(std::move(handler), this);
-  std::shared_ptr<timer_type> timer(new timer_type(*myService));
-  timer->expires_from_now(time);
-  timer->async_wait(boost::bind(boost::bind(&Scheduler::scheduleAbstractTask, this, taskObject), timer));
-  taskObject->addCancellationHandler([=]() { timer->cancel(); });
+  scheduleTimer(taskObject, time);
   return taskObject;
 }
 
-NX::CoroutineTask *NX::Scheduler::scheduleCoroutine(CompletionHandler &&handler) {
+NX::CoroutineTask *NX::Scheduler::scheduleCoroutine(TaskHandler &&handler) {
   if (!handler)
     throw NX::Exception("empty handler provided");
   auto * task = new NX::CoroutineTask(std::move(handler), this);
@@ -192,22 +733,127 @@ NX::CoroutineTask *NX::Scheduler::scheduleCoroutine(CompletionHandler &&handler)
   return task;
 }
 
-NX::CoroutineTask *NX::Scheduler::scheduleCoroutine(const NX::Scheduler::duration &time, CompletionHandler &&handler) {
+NX::CoroutineTask *NX::Scheduler::scheduleCoroutine(const NX::Scheduler::duration &time, TaskHandler &&handler) {
   if (!handler)
     throw NX::Exception("empty handler provided");
   auto * taskObject = new NX::CoroutineTask(std::move(handler), this);
-  std::shared_ptr<timer_type> timer(new timer_type(*myService));
-  timer->expires_from_now(time);
-  timer->async_wait(boost::bind(boost::bind(&Scheduler::scheduleAbstractTask, this, taskObject), timer));
-  taskObject->addCancellationHandler([=]() { timer->cancel(); });
+  scheduleTimer(taskObject, time);
   return taskObject;
 }
 
+void NX::Scheduler::scheduleTimer(NX::AbstractTask * task, const NX::Scheduler::duration & time)
+{
+  std::vector<NX::AbstractTask*> expired;
+  {
+    std::lock_guard<std::mutex> lock(myTimersMutex);
+    // catch the wheel up first so the new deadline is filed relative to the present
+    myTimers.advance(myTimers.now(), expired);
+    auto delay = NX::TimerWheel::toTicks(std::chrono::microseconds(time.total_microseconds()));
+    task->myTimer = myTimers.insert(task, myTimers.now() + delay);
+    armTimers();
+  }
+  for (auto expiredTask : expired)
+    scheduleAbstractTask(expiredTask);
+}
+
+void NX::Scheduler::armTimers()
+{
+  if (myTimers.empty())
+    return;
+  auto next = myTimers.nextTick();
+  if (myTimerArmed && myTimerArmed <= next)
+    return;
+  myTimerArmed = next;
+  myTimerDriver->expires_at(myTimers.timeOf(next));
+  myTimerDriver->async_wait(boost::bind(&NX::Scheduler::onTimers, this, boost::asio::placeholders::error));
+}
+
+void NX::Scheduler::onTimers(const boost::system::error_code & error)
+{
+  // re-arming cancels the previous wait
+  if (error == boost::asio::error::operation_aborted)
+    return;
+  std::vector<NX::AbstractTask*> expired;
+  {
+    std::lock_guard<std::mutex> lock(myTimersMutex);
+    myTimerArmed = 0;
+    myTimers.advance(myTimers.now(), expired);
+    armTimers();
+  }
+  for (auto task : expired)
+    scheduleAbstractTask(task);
+}
+
+bool NX::Scheduler::cancelTimer(NX::AbstractTask * task)
+{
+  {
+    std::lock_guard<std::mutex> lock(myTimersMutex);
+    if (!myTimers.cancel(task->myTimer))
+      return false;
+  }
+  // off the wheel and never queued, nobody else can reach it now
+  task->abort();
+  delete task;
+  return true;
+}
+
+std::size_t NX::Scheduler::timers() const
+{
+  std::lock_guard<std::mutex> lock(myTimersMutex);
+  return myTimers.size();
+}
+
+std::int64_t NX::Scheduler::currentTaskRunTime() const
+{
+  Worker * worker = myCurrentWorker.get();
+  if (!worker || !myCurrentTask.get())
+    return 0;
+  return clock() - worker->runningSince.load(std::memory_order_relaxed);
+}
+
+void NX::Scheduler::reportOverBudget(OverBudgetTask && task)
+{
+  // only the most recent offenders are kept, the count covers all of them
+  static const std::size_t keep = 32;
+  myOverBudgetCount++;
+  std::lock_guard<std::mutex> lock(myOverBudgetMutex);
+  myOverBudget.push_back(std::move(task));
+  if (myOverBudget.size() > keep)
+    myOverBudget.pop_front();
+}
+
+NX::Scheduler::Stats NX::Scheduler::stats() const
+{
+  Stats stats;
+  stats.threads = myThreadCount;
+  stats.poolThreads = myPoolThreads;
+  stats.queued = myTaskCount;
+  stats.active = myActiveTaskCount;
+  stats.timers = timers();
+  stats.overBudget = myOverBudgetCount;
+  {
+    std::lock_guard<std::mutex> lock(myOverBudgetMutex);
+    stats.recentOverBudget.assign(myOverBudget.begin(), myOverBudget.end());
+  }
+  NX::LatencyHistogram::Snapshot waitTime, runTime;
+  for (auto & worker : myWorkers) {
+    stats.workers.push_back(Stats::WorkerStats {
+      worker->index, worker->node, worker->queue.size(), worker->active, worker->cpus,
+      worker->tasks, worker->steals, worker->injected, worker->parks, worker->idleNanos
+    });
+    waitTime.merge(worker->waitTime);
+    runTime.merge(worker->runTime);
+  }
+  stats.waitTime = waitTime.summary();
+  stats.runTime = runTime.summary();
+  return stats;
+}
+
 bool NX::Scheduler::canYield() const {
   return dynamic_cast<NX::CoroutineTask*>(myCurrentTask.get()) != nullptr;
 }
 
-NX::Task *NX::Scheduler::scheduleThreadInitTask(NX::Scheduler::CompletionHandler &&handler) {
+NX::Task *NX::Scheduler::scheduleThreadInitTask(NX::Scheduler::TaskHandler &&handler) {
   if (!handler)
     throw NX::Exception("empty handler provided");
   auto task = new NX::Task(std::move(handler), this, false);
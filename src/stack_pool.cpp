@@ -0,0 +1,103 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stack_pool.h"
+
+#include <boost/context/stack_traits.hpp>
+
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace {
+  std::atomic_size_t stackSize(0), poolSize(64), hits(0), misses(0);
+
+  std::size_t pageSize() {
+    static const std::size_t size = boost::context::stack_traits::page_size();
+    return size;
+  }
+
+  std::size_t mappedSize() {
+    std::size_t size = stackSize.load(std::memory_order_relaxed);
+    if (!size)
+      size = boost::context::stack_traits::default_size();
+    if (size < boost::context::stack_traits::minimum_size())
+      size = boost::context::stack_traits::minimum_size();
+    // whole pages, plus one for the guard
+    return ((size + pageSize() - 1) / pageSize() + 1) * pageSize();
+  }
+
+  void unmap(const boost::context::stack_context & sctx) {
+    ::munmap(static_cast<char*>(sctx.sp) - sctx.size, sctx.size);
+  }
+
+  struct FreeList: public std::vector<boost::context::stack_context> {
+    ~FreeList() {
+      for (auto & sctx : *this)
+        unmap(sctx);
+    }
+  };
+
+  thread_local FreeList freeList;
+}
+
+void NX::StackPool::configure(std::size_t size, std::size_t pool)
+{
+  stackSize.store(size);
+  poolSize.store(pool);
+}
+
+NX::StackPool::Stats NX::StackPool::stats()
+{
+  return Stats { hits.load(), misses.load(), mappedSize() - pageSize(), poolSize.load() };
+}
+
+boost::context::stack_context NX::StackPool::Allocator::allocate()
+{
+  const std::size_t size = mappedSize();
+  while (!freeList.empty()) {
+    boost::context::stack_context sctx = freeList.back();
+    freeList.pop_back();
+    if (sctx.size == size) {
+      hits.fetch_add(1, std::memory_order_relaxed);
+      return sctx;
+    }
+    unmap(sctx);
+  }
+  misses.fetch_add(1, std::memory_order_relaxed);
+  void * base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (base == MAP_FAILED)
+    throw std::bad_alloc();
+  // stacks grow down, the lowest page catches overflows
+  ::mprotect(base, pageSize(), PROT_NONE);
+  boost::context::stack_context sctx;
+  sctx.size = size;
+  sctx.sp = static_cast<char*>(base) + size;
+  return sctx;
+}
+
+void NX::StackPool::Allocator::deallocate(boost::context::stack_context & sctx)
+{
+  if (freeList.size() < poolSize.load(std::memory_order_relaxed) && sctx.size == mappedSize())
+    freeList.push_back(sctx);
+  else
+    unmap(sctx);
+}
@@ -21,10 +21,11 @@
 #include "task.h"
 #include "scheduler.h"
 #include "exception.h"
+#include "stack_pool.h"
 
 #include <iostream>
 
-NX::CoroutineTask::CoroutineTask (NX::Scheduler::CompletionHandler && handler, NX::Scheduler * scheduler, bool hold):
+NX::CoroutineTask::CoroutineTask (NX::Scheduler::TaskHandler && handler, NX::Scheduler * scheduler, bool hold):
   AbstractTask(scheduler, hold), myHandler(std::move(handler)), myScheduler(scheduler), myCoroutine(), myPullCa(nullptr), myStatus(INACTIVE)
 {
 }
@@ -34,7 +35,8 @@ void NX::CoroutineTask::create()
   if (myStatus == ABORTED) return;
   myStatus.store(CREATED);
   myScheduler->makeCurrent(this);
-  myCoroutine.reset(new NX::CoroutineTask::push_type(boost::bind(&NX::CoroutineTask::coroutine, this, _1)));
+  myCoroutine.reset(new NX::CoroutineTask::push_type(NX::StackPool::Allocator(),
+                                                     boost::bind(&NX::CoroutineTask::coroutine, this, _1)));
 }
 
 void NX::CoroutineTask::enter()
@@ -0,0 +1,215 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+constexpr std::size_t NX::TimerWheel::Levels;
+constexpr std::size_t NX::TimerWheel::SlotBits;
+constexpr std::size_t NX::TimerWheel::Slots;
+constexpr NX::TimerWheel::tick_type NX::TimerWheel::SlotMask;
+constexpr std::size_t NX::TimerWheel::EntriesPerBlock;
+
+NX::TimerWheel::TimerWheel():
+  myWheel(), myLevelSizes(), myBlocks(), myFreeList(nullptr), myEpoch(clock::now()), myCurrent(0), mySize(0)
+{
+  myLevelSizes.fill(0);
+}
+
+NX::TimerWheel::~TimerWheel()
+{
+}
+
+NX::TimerWheel::tick_type NX::TimerWheel::toTicks(NX::TimerWheel::clock::duration duration)
+{
+  // round up, a timer must never fire early
+  auto micro = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  return micro <= 0 ? 0 : static_cast<tick_type>((micro + 999) / 1000);
+}
+
+NX::TimerWheel::tick_type NX::TimerWheel::now() const
+{
+  return static_cast<tick_type>(std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - myEpoch).count());
+}
+
+NX::TimerWheel::Entry * NX::TimerWheel::allocate()
+{
+  if (!myFreeList) {
+    std::unique_ptr<Entry[]> block(new Entry[EntriesPerBlock]);
+    for (std::size_t i = 0; i < EntriesPerBlock; i++) {
+      block[i].generation = 0;
+      block[i].next = myFreeList;
+      myFreeList = &block[i];
+    }
+    myBlocks.emplace_back(std::move(block));
+  }
+  Entry * entry = myFreeList;
+  myFreeList = entry->next;
+  return entry;
+}
+
+void NX::TimerWheel::release(NX::TimerWheel::Entry * entry)
+{
+  // bumping the generation is what makes outstanding handles stale
+  entry->generation++;
+  entry->task = nullptr;
+  entry->slot = nullptr;
+  entry->prev = nullptr;
+  entry->next = myFreeList;
+  myFreeList = entry;
+}
+
+void NX::TimerWheel::link(NX::TimerWheel::Entry * entry)
+{
+  tick_type deadline = entry->deadline < myCurrent ? myCurrent : entry->deadline;
+  tick_type delta = deadline - myCurrent;
+  std::size_t level = 0;
+  while (level < Levels - 1 && delta >= (tick_type(1) << (SlotBits * (level + 1))))
+    level++;
+  if (delta >= (tick_type(1) << (SlotBits * Levels))) {
+    // beyond the wheel's range, park it in the furthest slot and re-file it when that comes around
+    deadline = myCurrent + (tick_type(1) << (SlotBits * Levels)) - 1;
+  }
+  Slot & slot = myWheel[level][(deadline >> (SlotBits * level)) & SlotMask];
+  entry->slot = &slot;
+  entry->level = level;
+  entry->prev = nullptr;
+  entry->next = slot.head;
+  if (slot.head)
+    slot.head->prev = entry;
+  slot.head = entry;
+  myLevelSizes[level]++;
+}
+
+void NX::TimerWheel::unlink(NX::TimerWheel::Entry * entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    entry->slot->head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  myLevelSizes[entry->level]--;
+}
+
+NX::TimerWheel::Handle NX::TimerWheel::insert(NX::AbstractTask * task, NX::TimerWheel::tick_type deadline)
+{
+  Entry * entry = allocate();
+  entry->task = task;
+  // the current slot has already been swept, so the earliest a new timer can fire is the next tick
+  entry->deadline = deadline <= myCurrent ? myCurrent + 1 : deadline;
+  link(entry);
+  mySize++;
+  Handle handle;
+  handle.entry = entry;
+  handle.generation = entry->generation;
+  return handle;
+}
+
+NX::AbstractTask * NX::TimerWheel::cancel(const NX::TimerWheel::Handle & handle)
+{
+  auto * entry = static_cast<Entry*>(handle.entry);
+  if (!entry || entry->generation != handle.generation || !entry->slot)
+    return nullptr;
+  NX::AbstractTask * task = entry->task;
+  unlink(entry);
+  release(entry);
+  mySize--;
+  return task;
+}
+
+void NX::TimerWheel::cascade(std::size_t level)
+{
+  Slot & slot = myWheel[level][(myCurrent >> (SlotBits * level)) & SlotMask];
+  Entry * entry = slot.head;
+  slot.head = nullptr;
+  while (entry) {
+    Entry * next = entry->next;
+    myLevelSizes[level]--;
+    link(entry);
+    entry = next;
+  }
+}
+
+void NX::TimerWheel::advance(NX::TimerWheel::tick_type to, std::vector<NX::AbstractTask*> & expired)
+{
+  while (myCurrent < to) {
+    if (!mySize) {
+      myCurrent = to;
+      return;
+    }
+    if (!myLevelSizes[0]) {
+      // nothing can expire before the next cascade, skip straight to it
+      tick_type next = nextTick();
+      if (next > to) {
+        myCurrent = to;
+        return;
+      }
+      myCurrent = next - 1;
+    }
+    myCurrent++;
+    for (std::size_t level = 1; level < Levels; level++) {
+      if (myCurrent & ((tick_type(1) << (SlotBits * level)) - 1))
+        break;
+      cascade(level);
+    }
+    Slot & slot = myWheel[0][myCurrent & SlotMask];
+    Entry * entry = slot.head;
+    slot.head = nullptr;
+    while (entry) {
+      Entry * next = entry->next;
+      myLevelSizes[0]--;
+      if (entry->deadline > myCurrent) {
+        link(entry);
+      } else {
+        expired.push_back(entry->task);
+        release(entry);
+        mySize--;
+      }
+      entry = next;
+    }
+  }
+}
+
+NX::TimerWheel::tick_type NX::TimerWheel::nextTick() const
+{
+  tick_type next = myCurrent + Slots;
+  if (myLevelSizes[0]) {
+    for (tick_type tick = myCurrent + 1; tick < next; tick++) {
+      if (myWheel[0][tick & SlotMask].head) {
+        next = tick;
+        break;
+      }
+    }
+  }
+  // the upper levels only matter at the tick their slot gets cascaded down
+  for (std::size_t level = 1; level < Levels; level++) {
+    if (!myLevelSizes[level])
+      continue;
+    const std::size_t shift = SlotBits * level;
+    for (tick_type index = (myCurrent >> shift) + 1; index <= (myCurrent >> shift) + Slots; index++) {
+      if (myWheel[level][index & SlotMask].head) {
+        next = std::min(next, index << shift);
+        break;
+      }
+    }
+  }
+  return next;
+}
@@ -0,0 +1,121 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "topology.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+std::vector<int> NX::Topology::parseCpuList(const std::string & list)
+{
+  std::vector<int> cpus;
+  std::vector<std::string> ranges;
+  boost::split(ranges, list, boost::is_any_of(","));
+  for (auto range : ranges) {
+    boost::trim(range);
+    if (range.empty())
+      continue;
+    auto dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; cpu++)
+        cpus.push_back(cpu);
+    } catch(const std::exception &) {
+      // malformed entry, skip it
+    }
+  }
+  return cpus;
+}
+
+std::vector<int> NX::Topology::cpus()
+{
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (!sched_getaffinity(0, sizeof(set), &set)) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &set))
+        cpus.push_back(cpu);
+  }
+#endif
+  if (cpus.empty()) {
+    for (int cpu = 0; cpu < static_cast<int>(boost::thread::hardware_concurrency()); cpu++)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int>> NX::Topology::nodes()
+{
+  namespace fs = boost::filesystem;
+  const std::vector<int> allowed = cpus();
+  std::map<int, std::vector<int>> byNode;
+  const fs::path root("/sys/devices/system/node");
+  boost::system::error_code error;
+  if (fs::is_directory(root, error)) {
+    for (fs::directory_iterator it(root, error), end; !error && it != end; it.increment(error)) {
+      const std::string name = it->path().filename().string();
+      if (name.compare(0, 4, "node") || name.size() == 4 || !std::all_of(name.begin() + 4, name.end(), ::isdigit))
+        continue;
+      std::ifstream file((it->path() / "cpulist").string());
+      std::string list;
+      std::getline(file, list);
+      std::vector<int> cpus;
+      for (int cpu : parseCpuList(list))
+        if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+          cpus.push_back(cpu);
+      if (!cpus.empty())
+        byNode[std::stoi(name.substr(4))] = std::move(cpus);
+    }
+  }
+  std::vector<std::vector<int>> nodes;
+  for (auto & node : byNode)
+    nodes.push_back(std::move(node.second));
+  if (nodes.empty())
+    nodes.push_back(allowed);
+  return nodes;
+}
+
+bool NX::Topology::pinCurrentThread(const std::vector<int> & cpus)
+{
+#ifdef __linux__
+  if (cpus.empty())
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus)
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,357 @@
+/*
+ * Nexus.js - The next-gen JavaScript platform
+ * Copyright (C) 2016  Abdullah A. Hassan <abdullah@webtomizer.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uring.h"
+#include "scheduler.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+  const unsigned FileTableSize = 256;
+
+  int setup(unsigned entries, io_uring_params * params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+  }
+
+  int enter(int fd, unsigned toSubmit) {
+    int result;
+    do {
+      result = static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, 0, 0, nullptr, 0));
+    } while (result < 0 && errno == EINTR);
+    return result;
+  }
+
+  int registerRing(int fd, unsigned opcode, const void * arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+  }
+
+  template<typename T>
+  T * at(void * base, std::uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char *>(base) + offset);
+  }
+
+  // what the kernel's user_data points at until the completion is reaped
+  struct Pending {
+    NX::Uring::Completion completion;
+    iovec vector;
+  };
+}
+
+NX::Uring::Uring(NX::Scheduler * scheduler, boost::asio::io_service & service, unsigned int entries):
+  myScheduler(scheduler), myService(service), myFd(-1), myEventFd(-1), myEvents(service), myEventCount(0),
+  mySqRing(nullptr), myCqRing(nullptr), mySqes(nullptr), mySqRingSize(0), myCqRingSize(0), mySqesSize(0),
+  mySqHead(nullptr), mySqTail(nullptr), mySqMask(nullptr), mySqArray(nullptr),
+  myCqHead(nullptr), myCqTail(nullptr), myCqMask(nullptr), myCqes(nullptr), mySqEntries(0), myCqEntries(0),
+  myMutex(), myInFlight(0), myBacklog(), myFiles(), myFreeFiles(), myFilesRegistered(false),
+  mySlab(nullptr), myFreeBuffers()
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  int fd = setup(entries, &params);
+  if (fd < 0)
+    return;
+  mySqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  myCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    mySqRingSize = myCqRingSize = std::max(mySqRingSize, myCqRingSize);
+  mySqRing = mmap(nullptr, mySqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (mySqRing == MAP_FAILED) {
+    mySqRing = nullptr;
+    close(fd);
+    return;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    myCqRing = mySqRing;
+  else {
+    myCqRing = mmap(nullptr, myCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (myCqRing == MAP_FAILED) {
+      myCqRing = nullptr;
+      munmap(mySqRing, mySqRingSize);
+      mySqRing = nullptr;
+      close(fd);
+      return;
+    }
+  }
+  mySqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  mySqes = mmap(nullptr, mySqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  myEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (mySqes == MAP_FAILED || myEventFd < 0 || registerRing(fd, IORING_REGISTER_EVENTFD, &myEventFd, 1) < 0) {
+    if (mySqes != MAP_FAILED)
+      munmap(mySqes, mySqesSize);
+    mySqes = nullptr;
+    if (myCqRing != mySqRing)
+      munmap(myCqRing, myCqRingSize);
+    munmap(mySqRing, mySqRingSize);
+    mySqRing = myCqRing = nullptr;
+    if (myEventFd >= 0)
+      close(myEventFd);
+    myEventFd = -1;
+    close(fd);
+    return;
+  }
+  mySqHead = at<unsigned>(mySqRing, params.sq_off.head);
+  mySqTail = at<unsigned>(mySqRing, params.sq_off.tail);
+  mySqMask = at<unsigned>(mySqRing, params.sq_off.ring_mask);
+  mySqArray = at<unsigned>(mySqRing, params.sq_off.array);
+  myCqHead = at<unsigned>(myCqRing, params.cq_off.head);
+  myCqTail = at<unsigned>(myCqRing, params.cq_off.tail);
+  myCqMask = at<unsigned>(myCqRing, params.cq_off.ring_mask);
+  myCqes = at<void>(myCqRing, params.cq_off.cqes);
+  mySqEntries = params.sq_entries;
+  myCqEntries = params.cq_entries;
+  myFd = fd;
+  // sparse tables need a 5.5 kernel, older ones just go without registered files
+  std::vector<int> files(FileTableSize, -1);
+  if (registerRing(myFd, IORING_REGISTER_FILES, files.data(), FileTableSize) == 0) {
+    myFilesRegistered = true;
+    myFiles.assign(FileTableSize, -1);
+    for (int slot = FileTableSize - 1; slot >= 0; slot--)
+      myFreeFiles.push_back(slot);
+  }
+  // pinned memory counts against RLIMIT_MEMLOCK, a refusal only costs the fixed-buffer fast path
+  void * slab = nullptr;
+  if (!posix_memalign(&slab, 4096, BufferCount * BufferSize)) {
+    std::vector<iovec> vectors(BufferCount);
+    for (std::size_t i = 0; i < BufferCount; i++)
+      vectors[i] = iovec { static_cast<char *>(slab) + i * BufferSize, BufferSize };
+    if (registerRing(myFd, IORING_REGISTER_BUFFERS, vectors.data(), BufferCount) == 0) {
+      mySlab = static_cast<char *>(slab);
+      for (int i = BufferCount - 1; i >= 0; i--)
+        myFreeBuffers.push_back(i);
+    } else
+      std::free(slab);
+  }
+  myEvents.assign(myEventFd);
+  arm();
+}
+
+NX::Uring::~Uring()
+{
+  if (myFd < 0)
+    return;
+  boost::system::error_code ignored;
+  myEvents.close(ignored);
+  close(myFd);
+  munmap(mySqes, mySqesSize);
+  if (myCqRing != mySqRing)
+    munmap(myCqRing, myCqRingSize);
+  munmap(mySqRing, mySqRingSize);
+  std::free(mySlab);
+}
+
+int NX::Uring::registerFile(int fd)
+{
+  std::lock_guard<std::mutex> lock(myMutex);
+  if (!myFilesRegistered || myFreeFiles.empty())
+    return -1;
+  int slot = myFreeFiles.back();
+  io_uring_files_update update;
+  std::memset(&update, 0, sizeof(update));
+  update.offset = static_cast<std::uint32_t>(slot);
+  update.fds = reinterpret_cast<std::uintptr_t>(&fd);
+  if (registerRing(myFd, IORING_REGISTER_FILES_UPDATE, &update, 1) != 1)
+    return -1;
+  myFreeFiles.pop_back();
+  myFiles[slot] = fd;
+  return slot;
+}
+
+void NX::Uring::unregisterFile(int slot)
+{
+  if (slot < 0)
+    return;
+  std::lock_guard<std::mutex> lock(myMutex);
+  int none = -1;
+  io_uring_files_update update;
+  std::memset(&update, 0, sizeof(update));
+  update.offset = static_cast<std::uint32_t>(slot);
+  update.fds = reinterpret_cast<std::uintptr_t>(&none);
+  registerRing(myFd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+  myFiles[slot] = -1;
+  myFreeFiles.push_back(slot);
+}
+
+NX::Uring::Buffer NX::Uring::acquireBuffer()
+{
+  std::lock_guard<std::mutex> lock(myMutex);
+  if (myFreeBuffers.empty())
+    return Buffer { nullptr, 0, -1 };
+  int index = myFreeBuffers.back();
+  myFreeBuffers.pop_back();
+  return Buffer { mySlab + index * BufferSize, BufferSize, index };
+}
+
+void NX::Uring::releaseBuffer(int index)
+{
+  std::lock_guard<std::mutex> lock(myMutex);
+  myFreeBuffers.push_back(index);
+}
+
+void NX::Uring::read(int fd, int slot, char * dest, std::size_t length, std::uint64_t offset, int buffer,
+                     Completion completion)
+{
+  submit(Operation {
+    static_cast<std::uint8_t>(buffer >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READV), slot >= 0 ? slot : fd,
+    slot >= 0, reinterpret_cast<std::uintptr_t>(dest), static_cast<std::uint32_t>(length), offset, 0, buffer,
+    std::move(completion)
+  });
+}
+
+void NX::Uring::write(int fd, int slot, const char * source, std::size_t length, std::uint64_t offset,
+                      Completion completion)
+{
+  submit(Operation {
+    IORING_OP_WRITEV, slot >= 0 ? slot : fd, slot >= 0, reinterpret_cast<std::uintptr_t>(source),
+    static_cast<std::uint32_t>(length), offset, 0, -1, std::move(completion)
+  });
+}
+
+void NX::Uring::fsync(int fd, int slot, bool dataOnly, Completion completion)
+{
+  submit(Operation {
+    IORING_OP_FSYNC, slot >= 0 ? slot : fd, slot >= 0, 0, 0, 0, dataOnly ? IORING_FSYNC_DATASYNC : 0u, -1,
+    std::move(completion)
+  });
+}
+
+void NX::Uring::submit(Operation && operation)
+{
+  myScheduler->hold();
+  std::lock_guard<std::mutex> lock(myMutex);
+  if (full()) {
+    myBacklog.emplace_back(std::move(operation));
+    return;
+  }
+  push(operation);
+}
+
+bool NX::Uring::full() const
+{
+  // myMutex is held; entries a short submission left in the ring still take up their slots
+  const unsigned unsubmitted = *mySqTail - __atomic_load_n(mySqHead, __ATOMIC_ACQUIRE);
+  return myInFlight >= myCqEntries || unsubmitted >= mySqEntries;
+}
+
+void NX::Uring::push(Operation & operation)
+{
+  // myMutex is held
+  auto * pending = new Pending { std::move(operation.completion), iovec { nullptr, 0 } };
+  const unsigned tail = *mySqTail;
+  const unsigned index = tail & *mySqMask;
+  io_uring_sqe * sqe = static_cast<io_uring_sqe*>(mySqes) + index;
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = operation.opcode;
+  sqe->fd = operation.fd;
+  sqe->flags = operation.fixedFile ? IOSQE_FIXED_FILE : 0;
+  sqe->off = operation.offset;
+  sqe->user_data = reinterpret_cast<std::uintptr_t>(pending);
+  switch (operation.opcode) {
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV:
+      // the vector has to outlive the submission on older kernels, so it lives with the completion
+      pending->vector = iovec { reinterpret_cast<void *>(operation.address), operation.length };
+      sqe->addr = reinterpret_cast<std::uintptr_t>(&pending->vector);
+      sqe->len = 1;
+      break;
+    case IORING_OP_READ_FIXED:
+      sqe->addr = operation.address;
+      sqe->len = operation.length;
+      sqe->buf_index = static_cast<std::uint16_t>(operation.buffer);
+      break;
+    case IORING_OP_FSYNC:
+      sqe->fsync_flags = operation.flags;
+      break;
+  }
+  mySqArray[index] = index;
+  __atomic_store_n(mySqTail, tail + 1, __ATOMIC_RELEASE);
+  myInFlight++;
+  // anything a short submission left behind goes along with this one
+  const unsigned head = __atomic_load_n(mySqHead, __ATOMIC_ACQUIRE);
+  if (enter(myFd, tail + 1 - head) >= 0)
+    return;
+  // a failed enter consumed nothing, so without SQPOLL the entries can be taken back and failed instead of hanging
+  const int error = -errno;
+  auto failed = std::make_shared<std::vector<Pending *>>();
+  for (unsigned entry = head; entry != tail + 1; entry++) {
+    auto * unsubmitted = static_cast<io_uring_sqe*>(mySqes) + mySqArray[entry & *mySqMask];
+    failed->push_back(reinterpret_cast<Pending *>(unsubmitted->user_data));
+  }
+  __atomic_store_n(mySqTail, head, __ATOMIC_RELEASE);
+  myInFlight -= failed->size();
+  myService.post([this, failed, error]() {
+    for (auto * item : *failed) {
+      std::unique_ptr<Pending> pending(item);
+      try {
+        pending->completion(error);
+      } catch(...) {
+      }
+      myScheduler->release();
+    }
+  });
+}
+
+void NX::Uring::arm()
+{
+  auto self = this;
+  myEvents.async_read_some(boost::asio::buffer(&myEventCount, sizeof(myEventCount)),
+    [self](const boost::system::error_code & error, std::size_t) {
+      if (error)
+        return;
+      self->reap();
+      self->arm();
+    });
+}
+
+void NX::Uring::reap()
+{
+  std::vector<std::pair<Pending *, int>> completed;
+  unsigned head = *myCqHead;
+  const unsigned tail = __atomic_load_n(myCqTail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    auto * cqe = static_cast<io_uring_cqe*>(myCqes) + (head & *myCqMask);
+    completed.emplace_back(reinterpret_cast<Pending *>(cqe->user_data), cqe->res);
+  }
+  __atomic_store_n(myCqHead, head, __ATOMIC_RELEASE);
+  {
+    std::lock_guard<std::mutex> lock(myMutex);
+    myInFlight -= completed.size();
+    while (!myBacklog.empty() && !full()) {
+      push(myBacklog.front());
+      myBacklog.pop_front();
+    }
+  }
+  for (auto & item : completed) {
+    std::unique_ptr<Pending> pending(item.first);
+    try {
+      pending->completion(item.second);
+    } catch(...) {
+      // a throwing completion must not take the reactor (and the rest of the batch) down with it
+    }
+    myScheduler->release();
+  }
+}
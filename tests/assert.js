@@ -0,0 +1,6 @@
+/**
+ * Throws unless condition holds. An error nothing catches makes nexus exit non-zero, which is what ctest goes by.
+ */
+export function assert(condition, message) {
+  if (!condition) throw new Error(message);
+}
@@ -0,0 +1,19 @@
+import { assert } from '../assert.js';
+
+// reactions must keep their FIFO order across drain batches (the default budget is 1024 per batch)
+const order = [];
+for (let i = 0; i < 5000; i++)
+  Promise.resolve(i).then(v => order.push(v));
+
+const length = 100000;
+const started = Date.now();
+let chain = Promise.resolve(0);
+for (let i = 0; i < length; i++)
+  chain = chain.then(v => v + 1);
+
+chain.then(v => {
+  const elapsed = Date.now() - started;
+  assert(v === length, 'promise chain lost a step');
+  assert(order.length === 5000 && order.every((v, i) => v === i), 'microtasks ran out of order');
+  console.log(`${length} chained reactions in ${elapsed}ms (${Math.round(length / Math.max(elapsed, 1))}/ms)`);
+});
@@ -0,0 +1,25 @@
+import { assert } from '../assert.js';
+
+const before = Nexus.Scheduler.stats();
+assert(Array.isArray(before.workers) && before.workers.length > 0, 'stats() did not list the workers');
+
+let done = 0;
+for (let i = 0; i < 100; i++)
+  Nexus.Scheduler.schedule(() => { done++; });
+
+setTimeout(() => {
+  const stats = Nexus.Scheduler.stats();
+  const tasks = stats.workers.reduce((sum, worker) => sum + worker.tasks, 0);
+  assert(done === 100, 'scheduled tasks did not all run');
+  assert(tasks >= 100, 'workers did not count the tasks they ran');
+  assert(stats.runTime.count >= 100 && stats.waitTime.count >= 100, 'histograms missed tasks');
+  for (const summary of [stats.waitTime, stats.runTime]) {
+    assert(summary.p50 <= summary.p99 && summary.p99 <= summary.p999 && summary.p999 <= summary.max,
+           'percentiles out of order');
+  }
+  for (const worker of stats.workers) {
+    for (const key of ['index', 'node', 'tasks', 'steals', 'injected', 'parks', 'idleTime', 'queueDepth'])
+      assert(typeof worker[key] === 'number', `worker.${key} is not a number`);
+  }
+  console.log(`ran ${tasks} tasks, p99 run time ${stats.runTime.p99}ms`);
+}, 50);
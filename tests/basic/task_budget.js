@@ -0,0 +1,56 @@
+import { assert } from '../assert.js';
+
+// run with --task-budget, and again with --abort-over-budget
+const { taskBudget: budget, abortOverBudget: abort } = Nexus.Scheduler.stats();
+
+function sleep(ms) {
+  return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+function spin(ms) {
+  const end = Date.now() + ms;
+  while (Date.now() < end);
+}
+
+async function start() {
+  assert(budget > 0, 'no task budget was given');
+
+  // a coroutine hogging the VM is made to yield, so a timer that comes due meanwhile still gets its turn
+  let firedAt = 0, spunUntil = 0;
+  const due = Date.now() + 10;
+  setTimeout(() => { firedAt = Date.now(); }, 10);
+  Nexus.Scheduler.schedule(function spinningCoroutine() {
+    spin(budget * 20);
+    spunUntil = Date.now();
+  }, { coroutine: true });
+  while (!spunUntil)
+    await sleep(budget);
+  assert(firedAt && firedAt < spunUntil, 'the timer waited for the coroutine to finish');
+  assert(firedAt - due < budget * 5, `the timer fired ${firedAt - due}ms late with a ${budget}ms budget`);
+
+  let stats = Nexus.Scheduler.stats();
+  const yielded = stats.recentOverBudget.find(task => task.stack.includes('spinningCoroutine'));
+  assert(stats.overBudget > 0 && yielded, 'the coroutine going over budget was not recorded');
+  assert(yielded.action === 'yielded' && yielded.runTime >= budget, 'the coroutine was not made to yield');
+
+  // a plain task can't yield, it is only reported unless over budget means terminated
+  let finished = false;
+  Nexus.Scheduler.schedule(function spinningTask() {
+    spin(budget * 10);
+    finished = true;
+  });
+  await sleep(budget * 20);
+  stats = Nexus.Scheduler.stats();
+  const plain = stats.recentOverBudget.find(task => task.stack.includes('spinningTask'));
+  assert(plain, 'the plain task going over budget was not recorded');
+  if (abort)
+    assert(plain.action === 'aborted' && !finished, 'the plain task was not terminated');
+  else
+    assert(plain.action === 'reported' && finished, 'the plain task was stopped without --abort-over-budget');
+  console.log(`${stats.overBudget} tasks over a ${budget}ms budget, timer ${firedAt - due}ms late`);
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
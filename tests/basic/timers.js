@@ -0,0 +1,24 @@
+import { assert } from '../assert.js';
+
+const started = Date.now();
+let cleared = true;
+const pending = setTimeout(() => { cleared = false; }, 50);
+clearTimeout(pending);
+
+setTimeout((a, b) => {
+  assert(a === 1 && b === 'two', 'setTimeout did not forward its arguments');
+  assert(Date.now() - started >= 100, 'setTimeout fired early');
+  console.log('timeout fired');
+}, 100, 1, 'two');
+
+let ticks = 0;
+const interval = setInterval(() => {
+  if (++ticks === 5) {
+    clearInterval(interval);
+    setTimeout(() => {
+      assert(ticks === 5, 'setInterval kept firing after clearInterval');
+      assert(cleared, 'clearTimeout did not cancel the timer');
+      console.log('interval cleared after 5 ticks');
+    }, 50);
+  }
+}, 10);
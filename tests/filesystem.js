@@ -1 +1,53 @@
-console.log(Nexus.FileSystem.stat("enwik8").lastModified);
+import { assert } from './assert.js';
+
+const FileType = Nexus.FileSystem.FileType;
+
+async function start() {
+  const stats = await Nexus.FileSystem.stat("enwik8");
+  console.log(stats.lastModified);
+  assert(stats.type === FileType.Regular && stats.size > 0, 'stat did not find enwik8');
+  assert((await Nexus.FileSystem.stat("does-not-exist")).type === FileType.NotFound, 'stat found a missing file');
+
+  const entries = await Nexus.FileSystem.readdir(".");
+  assert(entries.some(entry => entry.name === "enwik8" && entry.type === FileType.Regular), 'readdir missed enwik8');
+
+  // batched and collected walks see the same tree
+  const walked = await Nexus.FileSystem.walk(".");
+  let batches = 0, streamed = 0;
+  const total = await Nexus.FileSystem.walk(".", batch => {
+    batches++;
+    streamed += batch.length;
+  }, { batchSize: 64 });
+  assert(total === walked.length && streamed === total, 'batched walk saw a different tree');
+  assert(batches >= Math.ceil(total / 64), 'batches were larger than asked for');
+  assert(walked.length >= entries.length, 'walk saw less than readdir');
+
+  const files = walked.filter(entry => entry.type === FileType.Regular).map(entry => entry.path);
+  const sizes = await Nexus.FileSystem.statMany(files.concat(["does-not-exist"]));
+  assert(sizes.length === files.length + 1, 'statMany lost results');
+  assert(sizes.slice(0, -1).every(stat => stat.type === FileType.Regular), 'statMany results are out of order');
+  assert(sizes[sizes.length - 1].type === FileType.NotFound, 'statMany found a missing file');
+
+  // only a missing path is NotFound, a stat that fails for another reason is an error
+  assert((await Nexus.FileSystem.stat("enwik8/child")).type === FileType.NotFound, 'a path under a file was found');
+  const tooLong = "x".repeat(8192);
+  let rejected = false;
+  try {
+    await Nexus.FileSystem.stat(tooLong);
+  } catch (e) {
+    rejected = true;
+  }
+  assert(rejected, 'stat passed off a name that is too long as missing');
+  const [failed] = await Nexus.FileSystem.statMany([tooLong]);
+  assert(failed.type === FileType.StatusError && failed.error, 'statMany passed off a name that is too long as missing');
+
+  const visible = entries.filter(entry => entry.name[0] !== '.').length;
+  assert((await Nexus.FileSystem.glob("*")).length === visible, 'glob * differs from readdir');
+  const globbed = await Nexus.FileSystem.glob("**/enwik*", { stat: true });
+  assert(globbed.some(entry => entry.path === "enwik8" && entry.size === stats.size), 'glob missed enwik8');
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
@@ -0,0 +1,67 @@
+import { assert } from '../assert.js';
+
+const path = 'async_file.bin';
+const size = 16 * 1024 * 1024, block = 4096;
+
+function mbps(bytes, ms) {
+  return (bytes / 1048576 / Math.max(ms, 1) * 1000).toFixed(1);
+}
+
+async function readAll(device) {
+  const stream = new Nexus.IO.ReadableStream(device);
+  let total = 0, checksum = 0;
+  stream.on('data', buffer => {
+    const bytes = new Uint8Array(buffer);
+    for (let i = 0; i < bytes.length; i += block) checksum = (checksum + bytes[i]) % 65521;
+    total += bytes.length;
+  });
+  await stream.resume();
+  return { total, checksum };
+}
+
+async function randomReads(device, count) {
+  let checksum = 0;
+  for (let i = 0; i < count; i++) {
+    const offset = ((i * 7919) % (size / block)) * block;
+    await device.seek(offset, 'begin');
+    const bytes = new Uint8Array(await device.read(block));
+    assert(bytes.length === block && bytes[0] === (offset / block) % 251, 'random read returned the wrong block');
+    checksum = (checksum + bytes[0]) % 65521;
+  }
+  return checksum;
+}
+
+async function start() {
+  const data = new Uint8Array(size);
+  for (let i = 0; i < size; i += block) data.fill((i / block) % 251, i, i + block);
+
+  const sink = new Nexus.IO.WritableStream(new Nexus.IO.AsyncFileSinkDevice(path));
+  for (let i = 0; i < size; i += 1024 * 1024)
+    await sink.write(data.subarray(i, i + 1024 * 1024));
+  await sink.close();
+
+  let started = Date.now();
+  const async = await readAll(new Nexus.IO.AsyncFilePullDevice(path));
+  const asyncTime = Date.now() - started;
+  started = Date.now();
+  const sync = await readAll(new Nexus.IO.FilePullDevice(path));
+  const syncTime = Date.now() - started;
+  assert(async.total === size && sync.total === size, 'sequential read came up short');
+  assert(async.checksum === sync.checksum, 'async and blocking reads disagree');
+
+  started = Date.now();
+  const asyncRandom = await randomReads(new Nexus.IO.AsyncFilePullDevice(path), 2048);
+  const asyncRandomTime = Date.now() - started;
+  started = Date.now();
+  const syncRandom = await randomReads(new Nexus.IO.FilePullDevice(path), 2048);
+  const syncRandomTime = Date.now() - started;
+  assert(asyncRandom === syncRandom, 'async and blocking random reads disagree');
+
+  console.log(`sequential: io_uring ${mbps(size, asyncTime)} MiB/s, blocking ${mbps(size, syncTime)} MiB/s`);
+  console.log(`random ${block}B: io_uring ${mbps(2048 * block, asyncRandomTime)} MiB/s, blocking ${mbps(2048 * block, syncRandomTime)} MiB/s`);
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
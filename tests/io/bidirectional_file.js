@@ -0,0 +1,48 @@
+import { assert } from '../assert.js';
+
+const path = 'bidirectional_file.bin';
+const blockSize = 4096;
+const blocks = 64;
+
+function block(index) {
+  const data = new Uint8Array(blockSize);
+  data.fill(index % 256);
+  return data;
+}
+
+async function start() {
+  const device = new Nexus.IO.BidirectionalFileDevice(path);
+  await device.allocate(0, blockSize * blocks);
+  assert(device.size >= blockSize * blocks, 'allocate did not grow the file');
+
+  // every block written by its own task, in no particular order
+  const writes = [];
+  for (let i = blocks - 1; i >= 0; i--)
+    writes.push(device.writeAt(i * blockSize, block(i)));
+  const written = await Promise.all(writes);
+  assert(written.every(n => n === blockSize), 'a positional write came up short');
+  await device.syncRange(0, blockSize * blocks);
+
+  const reads = [];
+  for (let i = 0; i < blocks; i++)
+    reads.push(device.readAt(i * blockSize, blockSize));
+  const buffers = await Promise.all(reads);
+  buffers.forEach((buffer, i) => {
+    const bytes = new Uint8Array(buffer);
+    assert(bytes.length === blockSize && bytes[0] === i % 256 && bytes[blockSize - 1] === i % 256,
+           'block ' + i + ' was read back wrong');
+  });
+  assert((await device.readAt(blockSize * blocks - 10, 100)).byteLength === 10, 'readAt ran past the end of the file');
+
+  // the cursor based interface hands each caller its own range too
+  await device.readSeek(blockSize, 'begin');
+  const [first, second] = await Promise.all([device.read(blockSize), device.read(blockSize)]);
+  const seen = [new Uint8Array(first)[0], new Uint8Array(second)[0]].sort();
+  assert(seen[0] === 1 && seen[1] === 2, 'concurrent reads overlapped');
+  await device.syncRange();
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
@@ -0,0 +1,88 @@
+import { assert } from '../assert.js';
+
+const count = 50000;
+
+function mbps(bytes, ms) {
+  return (bytes / 1048576 / Math.max(ms, 1) * 1000).toFixed(1);
+}
+
+async function writeLines(device) {
+  const stream = new Nexus.IO.WritableStream(device);
+  let bytes = 0;
+  for (let i = 0; i < count; i++) {
+    const line = new Uint8Array(64).fill(48 + i % 10);
+    line[63] = 10;
+    await stream.write(line);
+    bytes += line.length;
+  }
+  // one large write goes out by reference rather than copied
+  await stream.write(new Uint8Array(1024 * 1024).fill(33));
+  bytes += 1024 * 1024;
+  await stream.close();
+  return bytes;
+}
+
+async function check(path, bytes) {
+  const device = new Nexus.IO.FilePullDevice(path);
+  const data = new Uint8Array(await device.read(bytes + 1));
+  assert(data.length === bytes, `${path} has ${data.length} bytes instead of ${bytes}`);
+  for (let i = 0; i < count; i += 997)
+    assert(data[i * 64] === 48 + i % 10 && data[i * 64 + 63] === 10, `${path} has the wrong data at line ${i}`);
+  assert(data[bytes - 1] === 33, `${path} lost the large write`);
+}
+
+async function start() {
+  let started = Date.now();
+  const plainBytes = await writeLines(new Nexus.IO.FileSinkDevice('buffered_sink_plain.bin'));
+  const plainTime = Date.now() - started;
+
+  const buffered = new Nexus.IO.BufferedSinkDevice(new Nexus.IO.FileSinkDevice('buffered_sink.bin'),
+    { flushSize: 256 * 1024, flushInterval: 5, durability: 'close' });
+  started = Date.now();
+  const bufferedBytes = await writeLines(buffered);
+  const bufferedTime = Date.now() - started;
+
+  await check('buffered_sink_plain.bin', plainBytes);
+  await check('buffered_sink.bin', bufferedBytes);
+
+  const stats = buffered.stats;
+  assert(stats.writes === count + 1, 'not every write went through the buffer');
+  assert(stats.bytes === bufferedBytes, 'flushed byte count is off');
+  assert(stats.syscalls < count / 100, `${stats.syscalls} syscalls for ${count} small writes`);
+  console.log(`${count} x 64 byte writes: plain ${mbps(plainBytes, plainTime)} MiB/s, ~${count + 1} syscalls; ` +
+              `buffered ${mbps(bufferedBytes, bufferedTime)} MiB/s, ${stats.syscalls} syscalls in ${stats.flushes} flushes`);
+
+  let threw = false;
+  try {
+    new Nexus.IO.BufferedSinkDevice(new Nexus.IO.FileSinkDevice('buffered_sink.bin'), { durability: 'sometimes' });
+  } catch (e) {
+    threw = true;
+  }
+  assert(threw, 'an unknown durability mode was accepted');
+
+  // fdatasync only works on files
+  threw = false;
+  try {
+    new Nexus.IO.BufferedSinkDevice(new Nexus.IO.FileSinkDevice('/dev/null'), { durability: 'periodic' });
+  } catch (e) {
+    threw = true;
+  }
+  assert(threw, 'durability was accepted for something other than a file');
+
+  // a closed sink's descriptor may belong to someone else by now
+  const closed = new Nexus.IO.WritableStream(new Nexus.IO.BufferedSinkDevice(new Nexus.IO.FileSinkDevice('buffered_sink.bin')));
+  await closed.write(new Uint8Array(16));
+  await closed.close();
+  let rejected = false;
+  try {
+    await closed.write(new Uint8Array(16));
+  } catch (e) {
+    rejected = true;
+  }
+  assert(rejected, 'a write after close was accepted');
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
@@ -0,0 +1,54 @@
+import { assert } from '../assert.js';
+
+const path = 'file_map.bin';
+const size = 3 * 1024 * 1024 + 17;
+
+async function start() {
+  const data = new Uint8Array(size);
+  for (let i = 0; i < size; i++) data[i] = (i * 31) % 256;
+  const sink = new Nexus.IO.WritableStream(new Nexus.IO.FileSinkDevice(path));
+  await sink.write(data);
+  await sink.close();
+
+  const device = new Nexus.IO.FileMapDevice(path, 'sequential');
+  assert(device.size === size, 'mapped size differs from the file size');
+
+  // writing to a view must reach neither the file nor any other view
+  const offset = 1025;
+  const original = (offset * 31) % 256;
+  const view = new Uint8Array(device.view(offset, 16));
+  const other = new Uint8Array(device.view(offset, 16));
+  assert(view.length === 16 && view[0] === original, 'view starts at the wrong offset');
+  view[0] = original ^ 0xff;
+  assert(view[0] === (original ^ 0xff), 'view could not be written to');
+  assert(other[0] === original, 'writing to a view changed another view');
+  assert(new Uint8Array(device.view(offset, 1))[0] === original, 'writing to a view changed later views');
+  await device.seek(offset, 'begin');
+  assert(new Uint8Array(await device.read(1))[0] === original, 'writing to a view changed what reads see');
+  await device.seek(0, 'begin');
+  const file = new Uint8Array(await new Nexus.IO.FilePullDevice(path).read(offset + 1));
+  assert(file[offset] === original, 'writing to a view changed the file');
+  assert(device.view(size - 4, 100).byteLength === 4, 'view was not clamped to the end of the file');
+
+  // existing streams read through it unchanged
+  const stream = new Nexus.IO.ReadableStream(device);
+  let offset = 0;
+  stream.on('data', buffer => {
+    const bytes = new Uint8Array(buffer);
+    for (let i = 0; i < bytes.length; i += 4093)
+      assert(bytes[i] === ((offset + i) * 31) % 256, 'streamed data differs from the file');
+    offset += bytes.length;
+  });
+  await stream.resume();
+  assert(offset === size, 'stream stopped short of the end of the file');
+
+  device.advise('random');
+  await device.seek(size - 1, 'begin');
+  const last = new Uint8Array(await device.read(10));
+  assert(last.length === 1 && last[0] === ((size - 1) * 31) % 256, 'read after seek returned the wrong byte');
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
@@ -0,0 +1,50 @@
+import { assert } from '../assert.js';
+
+const path = 'file_push.bin';
+const size = 5 * 1024 * 1024 + 123;
+
+async function readAll(device) {
+  const stream = new Nexus.IO.ReadableStream(device);
+  const chunks = [];
+  let offset = 0;
+  stream.on('data', buffer => {
+    const bytes = new Uint8Array(buffer);
+    for (let i = 0; i < bytes.length; i += 997)
+      assert(bytes[i] === ((offset + i) * 13) % 256, 'pushed data differs from the file');
+    offset += bytes.length;
+    chunks.push(bytes.length);
+  });
+  await stream.resume();
+  assert(offset === size, 'stream stopped short of the end of the file');
+  return chunks;
+}
+
+async function start() {
+  const data = new Uint8Array(size);
+  for (let i = 0; i < size; i++) data[i] = (i * 13) % 256;
+  const sink = new Nexus.IO.WritableStream(new Nexus.IO.FileSinkDevice(path));
+  await sink.write(data);
+  await sink.close();
+
+  const fixed = new Nexus.IO.FilePushDevice(path);
+  assert(fixed.chunkSize === 0, 'chunk size should adapt by default');
+  fixed.chunkSize = 16 * 1024;
+  const fixedChunks = await readAll(fixed);
+  assert(fixedChunks.every(length => length <= 16 * 1024), 'a chunk was larger than the chunk size');
+
+  const adaptive = await readAll(new Nexus.IO.FilePushDevice(path));
+  assert(Math.max(...adaptive) > 64 * 1024, 'adaptive chunks never grew for a fast consumer');
+
+  const small = await readAll(new Nexus.IO.FilePushDevice(path, 1024 * 1024));
+  assert(small.every(length => length <= 1024 * 1024), 'explicit chunk size was not used');
+
+  // the pool rounds buffers up to a power of two, chunks must not follow it
+  const odd = await readAll(new Nexus.IO.FilePushDevice(path, 100000));
+  assert(odd.every(length => length <= 100000), 'a chunk was rounded up to the buffer size');
+  assert(odd.some(length => length === 100000), 'chunks never filled the chunk size');
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
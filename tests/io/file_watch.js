@@ -0,0 +1,55 @@
+import { assert } from '../assert.js';
+
+const directory = '.';
+const path = 'file_watch.log';
+
+function bytes(text) {
+  const data = new Uint8Array(text.length);
+  for (let i = 0; i < text.length; i++) data[i] = text.charCodeAt(i);
+  return data;
+}
+
+async function append(file, text) {
+  return file.writeAt(file.size, bytes(text));
+}
+
+async function start() {
+  // start from an empty file, then keep appending to it
+  const sink = new Nexus.IO.WritableStream(new Nexus.IO.FileSinkDevice(path));
+  await sink.close();
+  const file = new Nexus.IO.BidirectionalFileDevice(path);
+
+  // a directory watch reports changes to its entries by name
+  const watch = new Nexus.IO.FileWatchDevice(directory, { events: ['modify'] });
+  assert(watch.path === directory, 'path was not kept');
+  const changes = [];
+  watch.on('change', change => {
+    changes.push(change);
+    if (change.name === path)
+      watch.pause();
+  });
+  const watching = watch.resume();
+  await append(file, 'first\n');
+  await watching;
+  assert(changes.some(change => change.name === path && change.type === 'modify'), 'the write was not seen');
+  assert(changes.every(change => change.path === directory + '/' + change.name), 'change path was not joined');
+
+  // following picks up what is appended after the end of the file
+  const tail = new Nexus.IO.FilePushDevice(path, { follow: true });
+  assert(tail.follow, 'follow option was not applied');
+  let text = '';
+  tail.on('data', buffer => {
+    text += String.fromCharCode.apply(null, new Uint8Array(buffer));
+    if (text === 'first\n')
+      append(file, 'second\n');
+    else if (text === 'first\nsecond\n')
+      tail.pause();
+  });
+  await tail.resume();
+  assert(text === 'first\nsecond\n', 'follow missed the appended line: ' + JSON.stringify(text));
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});
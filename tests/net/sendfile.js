@@ -0,0 +1,206 @@
+import { assert } from '../assert.js';
+
+const path = 'sendfile.bin';
+// more than one sendfile() call's worth, so the transfer has to resume between chunks
+const size = 5 * 1024 * 1024 + 123;
+const prefix = 'prefix';
+
+function ascii(bytes) {
+  let text = '';
+  for (let i = 0; i < bytes.length; i++)
+    text += String.fromCharCode(bytes[i]);
+  return text;
+}
+
+function concat(chunks) {
+  const data = new Uint8Array(chunks.reduce((total, chunk) => total + chunk.length, 0));
+  let offset = 0;
+  for (const chunk of chunks) {
+    data.set(chunk, offset);
+    offset += chunk.length;
+  }
+  return data;
+}
+
+function indexOf(data, text, from) {
+  outer: for (let i = from; i + text.length <= data.length; i++) {
+    for (let j = 0; j < text.length; j++)
+      if (data[i + j] !== text.charCodeAt(j)) continue outer;
+    return i;
+  }
+  return -1;
+}
+
+function checkFile(body, offset, what, mask = 0) {
+  assert(body.length === offset + size, `${what} has ${body.length - offset} file bytes instead of ${size}`);
+  for (let i = 0; i < size; i += 997)
+    assert(body[offset + i] === ((i * 13) % 256 ^ mask), `${what} differs from the file at ${i}`);
+  assert(body[offset + size - 1] === (((size - 1) * 13) % 256 ^ mask), `${what} lost the end of the file`);
+}
+
+const invert = {
+  process(buffer) {
+    return new Uint8Array(buffer).map(byte => byte ^ 0xff);
+  }
+};
+
+/**
+ * Connects to the port, sends the request if there is one and collects what comes back until done() is happy with
+ * it or the peer hangs up.
+ */
+async function exchange(port, request, done) {
+  const socket = new Nexus.IO.TCPSocketDevice();
+  await socket.connect('127.0.0.1', String(port));
+  const stream = new Nexus.IO.ReadableStream(socket);
+  const chunks = [];
+  let received = 0;
+  stream.on('data', buffer => {
+    chunks.push(new Uint8Array(buffer));
+    received += buffer.byteLength;
+    if (done && done(chunks, received))
+      socket.close();
+  });
+  if (request)
+    await new Nexus.IO.WritableStream(socket).write(Uint8Array.from(request, c => c.charCodeAt(0)));
+  try {
+    await stream.resume();
+  } catch (e) {
+    // the server closing its end shows up as an error
+  }
+  socket.close();
+  return concat(chunks);
+}
+
+function parseResponse(data) {
+  const headerEnd = indexOf(data, '\r\n\r\n', 0);
+  assert(headerEnd > 0, 'no header block in the response');
+  const lines = ascii(data.subarray(0, headerEnd)).split('\r\n');
+  const headers = {};
+  for (const line of lines.slice(1)) {
+    const colon = line.indexOf(':');
+    headers[line.substr(0, colon).trim().toLowerCase()] = line.substr(colon + 1).trim();
+  }
+  let offset = headerEnd + 4;
+  if ('content-length' in headers)
+    return { status: lines[0], headers, body: data.subarray(offset), chunks: 0 };
+  const parts = [];
+  for (;;) {
+    const lineEnd = indexOf(data, '\r\n', offset);
+    assert(lineEnd > offset, 'a chunk header is missing');
+    const length = parseInt(ascii(data.subarray(offset, lineEnd)), 16);
+    offset = lineEnd + 2;
+    if (length === 0)
+      break;
+    assert(data[offset + length] === 13 && data[offset + length + 1] === 10, 'a chunk is not followed by CRLF');
+    parts.push(data.subarray(offset, offset + length));
+    offset += length + 2;
+  }
+  assert(offset + 2 === data.length, 'bytes after the last chunk');
+  return { status: lines[0], headers, body: concat(parts), chunks: parts.length };
+}
+
+/**
+ * True once a whole response is in, judging by its Content-Length or the terminating chunk.
+ */
+function responseComplete(chunks, received) {
+  const head = ascii(chunks[0].subarray(0, Math.min(chunks[0].length, 1024)));
+  const headerEnd = head.indexOf('\r\n\r\n');
+  if (headerEnd < 0)
+    return false;
+  const length = /\r\ncontent-length:\s*(\d+)/i.exec(head);
+  if (length)
+    return received >= headerEnd + 4 + Number(length[1]);
+  const last = chunks[chunks.length - 1];
+  return last.length >= 5 && ascii(last.subarray(last.length - 5)) === '0\r\n\r\n';
+}
+
+async function testSocket(port) {
+  const errors = [];
+  let connections = 0, lateData = 0;
+  const acceptor = new Nexus.Net.TCP.Acceptor();
+  acceptor.on('connection', async socket => {
+    const late = connections++ > 0;
+    try {
+      const inStream = new Nexus.IO.ReadableStream(new Nexus.IO.FilePushDevice(path));
+      const outStream = new Nexus.IO.WritableStream(socket);
+      const disconnect = inStream.pipe(outStream);
+      // added after pipe(), these still have to see the data, so the file must not bypass them
+      if (late) {
+        inStream.pushFilter(invert);
+        inStream.on('data', buffer => { lateData += buffer.byteLength; });
+      }
+      await inStream.resume();
+      await disconnect();
+      await inStream.close();
+      await outStream.close();
+    } catch (e) {
+      errors.push(e);
+    }
+  });
+  acceptor.bind('127.0.0.1', port, true);
+  acceptor.listen();
+  const data = await exchange(port, null, null);
+  const filtered = await exchange(port, null, null);
+  acceptor.close();
+  assert(!errors.length, `socket transfer failed: ${errors[0]}`);
+  checkFile(data, 0, 'the socket transfer');
+  checkFile(filtered, 0, 'the filtered socket transfer', 0xff);
+  assert(lateData === size, 'a data listener added after pipe() missed the file');
+}
+
+async function testResponse(port) {
+  const errors = [];
+  const server = new Nexus.Net.HTTP.Server();
+  server.on('connection', async connection => {
+    const { request, response } = connection;
+    try {
+      const inStream = new Nexus.IO.ReadableStream(new Nexus.IO.FilePushDevice(path));
+      const outStream = new Nexus.IO.WritableStream(response);
+      response.set('Content-Type', 'application/octet-stream').status(200);
+      // once something went out the response is chunked and the file follows as one more chunk
+      if (request.url === '/chunked')
+        await outStream.write(Uint8Array.from(prefix, c => c.charCodeAt(0)));
+      const disconnect = inStream.pipe(outStream);
+      await inStream.resume();
+      await disconnect();
+      await inStream.close();
+      await outStream.close();
+    } catch (e) {
+      errors.push(e);
+    }
+  });
+  server.bind('127.0.0.1', port, true);
+  server.listen();
+
+  const whole = parseResponse(await exchange(port, 'GET /whole HTTP/1.1\r\nHost: localhost\r\n\r\n', responseComplete));
+  assert(/^HTTP\/1\.1 200/.test(whole.status), `unexpected status line '${whole.status}'`);
+  assert(whole.headers['content-length'] === String(size), 'the whole file was not sent with its Content-Length');
+  assert(!('transfer-encoding' in whole.headers), 'a Content-Length response was also chunked');
+  checkFile(whole.body, 0, 'the Content-Length body');
+
+  const chunked = parseResponse(await exchange(port, 'GET /chunked HTTP/1.1\r\nHost: localhost\r\n\r\n', responseComplete));
+  assert(/^HTTP\/1\.1 200/.test(chunked.status), `unexpected status line '${chunked.status}'`);
+  assert(chunked.headers['transfer-encoding'] === 'chunked', 'the response after a write was not chunked');
+  assert(chunked.chunks === 2, `expected the prefix and the file as two chunks, got ${chunked.chunks}`);
+  assert(ascii(chunked.body.subarray(0, prefix.length)) === prefix, 'the chunk written before the file was lost');
+  checkFile(chunked.body, prefix.length, 'the chunked body');
+
+  server.close();
+  assert(!errors.length, `response transfer failed: ${errors[0]}`);
+}
+
+async function start() {
+  const data = new Uint8Array(size);
+  for (let i = 0; i < size; i++) data[i] = (i * 13) % 256;
+  const sink = new Nexus.IO.WritableStream(new Nexus.IO.FileSinkDevice(path));
+  await sink.write(data);
+  await sink.close();
+
+  await testSocket(10001);
+  await testResponse(10002);
+}
+
+start().catch(e => {
+  console.error(e);
+  throw e;
+});